@@ -0,0 +1,151 @@
+/* File:     bench.h
+ * Purpose:  Timing, statistics and CSV/JSON output for mpi_bench.c.
+ *
+ * Usage:    bench_time(comm, warmup, reps, run, ctx, times);   on rank 0
+ *           of comm, times[r] is the slowest rank's time of repetition r
+ *           bench_stats(times, reps, &row.stats);
+ *           bench_write_csv(out, rows, count);  or bench_write_json
+ *           bench_wait(&request);               sleep instead of spin
+ *
+ * Note:     Every repetition starts with a barrier and is timed on each
+ *           rank from the barrier to the end of its work; the time of a
+ *           repetition is the maximum over the ranks, which is what a
+ *           user waits for.  Nothing is printed inside the timed region.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <mpi.h>
+
+#define BENCH_NAME 32
+
+typedef struct {
+   double min, median, p95, mean;
+} bench_stats_t;
+
+/* One configuration of a sweep */
+typedef struct {
+   char label[BENCH_NAME];       /* e.g. a release, to compare runs */
+   char kernel[BENCH_NAME];
+   char mode[8];                 /* strong or weak */
+   char unit[BENCH_NAME];        /* what throughput counts */
+   int procs, threads, warmup, reps;
+   long size;                    /* the global problem size */
+   double work;                  /* units per repetition */
+   bench_stats_t stats;
+   double speedup, efficiency;
+   double throughput;            /* units per second, at the median */
+   double check;                 /* result, to see that it is right */
+} bench_row_t;
+
+/* One repetition of a kernel; returns its result */
+typedef double (*bench_run_fn)(void* ctx);
+
+/*------------------------------------------------------------------
+ * Function:     bench_wait
+ * Purpose:      MPI_Wait that sleeps between tests, so ranks that wait
+ *               don't take cores from ranks that work when the box is
+ *               oversubscribed
+ */
+static inline void bench_wait(MPI_Request* request) {
+   struct timespec pause = {0, 200000};   /* 0.2 ms */
+   int done = 0;
+
+   MPI_Test(request, &done, MPI_STATUS_IGNORE);
+   while (!done) {
+      nanosleep(&pause, NULL);
+      MPI_Test(request, &done, MPI_STATUS_IGNORE);
+   }
+}  /* bench_wait */
+
+/*------------------------------------------------------------------
+ * Function:     bench_time
+ * Purpose:      Run warmup untimed and reps timed repetitions of run on
+ *               all ranks of comm
+ * Output args:  times:  on rank 0 of comm, the time of each repetition
+ *                  (the slowest rank's)
+ * Return val:   The result of the last repetition
+ */
+static inline double bench_time(MPI_Comm comm, int warmup, int reps, bench_run_fn run,
+      void* ctx, double* times) {
+   double start, elapsed, result = 0.0;
+   int r;
+
+   for (r = 0; r < warmup; r++) result = run(ctx);
+   for (r = 0; r < reps; r++) {
+      MPI_Barrier(comm);
+      start = MPI_Wtime();
+      result = run(ctx);
+      elapsed = MPI_Wtime() - start;
+      MPI_Reduce(&elapsed, &times[r], 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+   }
+   return result;
+}  /* bench_time */
+
+static inline int bench_double_cmp(const void* a, const void* b) {
+   double x = *(const double*) a, y = *(const double*) b;
+
+   return (x > y) - (x < y);
+}  /* bench_double_cmp */
+
+/*------------------------------------------------------------------
+ * Function:     bench_stats
+ * Purpose:      Minimum, median, 95th percentile (nearest rank) and
+ *               mean of n > 0 times
+ */
+static inline void bench_stats(const double* times, int n, bench_stats_t* s) {
+   double* sorted = malloc(n*sizeof(double));
+   double sum = 0.0;
+   int i, rank95;
+
+   memcpy(sorted, times, n*sizeof(double));
+   qsort(sorted, n, sizeof(double), bench_double_cmp);
+   for (i = 0; i < n; i++) sum += sorted[i];
+   rank95 = (95*n + 99)/100;            /* ceil(0.95 n) */
+   s->min = sorted[0];
+   s->median = (n % 2) ? sorted[n/2] : (sorted[n/2 - 1] + sorted[n/2])/2.0;
+   s->p95 = sorted[rank95 - 1];
+   s->mean = sum/n;
+   free(sorted);
+}  /* bench_stats */
+
+/*------------------------------------------------------------------
+ * Function:     bench_write_csv, bench_write_json
+ * Purpose:      Write the rows, one per configuration
+ */
+static inline void bench_write_csv(FILE* out, const bench_row_t* rows, int count) {
+   int i;
+
+   fprintf(out, "label,kernel,mode,procs,threads,size,warmup,reps,"
+         "min_s,median_s,p95_s,mean_s,speedup,efficiency,throughput,unit,check\n");
+   for (i = 0; i < count; i++)
+      fprintf(out, "%s,%s,%s,%d,%d,%ld,%d,%d,%.9g,%.9g,%.9g,%.9g,%.6g,%.6g,%.6g,%s,%.17g\n",
+            rows[i].label, rows[i].kernel, rows[i].mode, rows[i].procs, rows[i].threads,
+            rows[i].size, rows[i].warmup, rows[i].reps, rows[i].stats.min,
+            rows[i].stats.median, rows[i].stats.p95, rows[i].stats.mean, rows[i].speedup,
+            rows[i].efficiency, rows[i].throughput, rows[i].unit, rows[i].check);
+}  /* bench_write_csv */
+
+static inline void bench_write_json(FILE* out, const bench_row_t* rows, int count) {
+   int i;
+
+   fprintf(out, "[\n");
+   for (i = 0; i < count; i++)
+      fprintf(out, "  {\"label\": \"%s\", \"kernel\": \"%s\", \"mode\": \"%s\", "
+            "\"procs\": %d, \"threads\": %d, \"size\": %ld, \"warmup\": %d, \"reps\": %d, "
+            "\"min_s\": %.9g, \"median_s\": %.9g, \"p95_s\": %.9g, \"mean_s\": %.9g, "
+            "\"speedup\": %.6g, \"efficiency\": %.6g, \"throughput\": %.6g, \"unit\": \"%s\", "
+            "\"check\": %.17g}%s\n",
+            rows[i].label, rows[i].kernel, rows[i].mode, rows[i].procs, rows[i].threads,
+            rows[i].size, rows[i].warmup, rows[i].reps, rows[i].stats.min,
+            rows[i].stats.median, rows[i].stats.p95, rows[i].stats.mean, rows[i].speedup,
+            rows[i].efficiency, rows[i].throughput, rows[i].unit, rows[i].check,
+            i + 1 < count ? "," : "");
+   fprintf(out, "]\n");
+}  /* bench_write_json */
+
+#endif /* BENCH_H */
@@ -0,0 +1,461 @@
+/* File:     mpi_bench.c
+ * Purpose:  One benchmark driver for the kernels of the other programs:
+ *              mc           Monte Carlo pi (../Final/toss_kernel.h)
+ *              rect_block   midpoint rule, block partition (../Homework2)
+ *              rect_cyclic  midpoint rule, cyclic partition
+ *              rect_bcyclic midpoint rule, cyclic partition of chunks
+ *                           (../Trapezoidal_Rule/partition.h)
+ *              trap         trapezoidal rule (../Trapezoidal_Rule)
+ *              series       sum of the arithmetic series (../Project1)
+ *              matvec       dense row-block y = A*x and MPI_Allgatherv of y
+ *              gemm         row-block C = A*B with ../Homework3/gemm.h
+ *           swept over process counts, thread counts and problem sizes,
+ *           with warmup and repeated runs.
+ *
+ * Input:    Options (lists are comma separated):
+ *              -k kernels   default all
+ *              -m mode      strong (the size is the global problem) or
+ *                           weak (the size is per process x thread)
+ *              -p procs     default 1, 2, 4, ... and the number started
+ *              -t threads   OpenMP threads per process, default 1
+ *              -n sizes     points, tosses or terms; the matrix order for
+ *                           matvec and gemm (in weak mode, the number of
+ *                           rows per process x thread); default per kernel
+ *              -w warmup    untimed runs, default 2
+ *              -r reps      timed runs, default 10
+ *              -f format    csv or json
+ *              -o file      where to write it (default stdout)
+ *              -l label     tag of every row, e.g. a release
+ * Output:   A line per configuration while the sweep runs; then, if -f
+ *           or -o is given, one row per configuration: min, median and
+ *           95th percentile time, speedup and efficiency against the
+ *           configuration with the fewest processes x threads, and
+ *           throughput at the median
+ *
+ * Compile:  mpicc -g -Wall -O3 -march=native -fopenmp -o mpi_bench mpi_bench.c -lm -ldl
+ * Run:      mpirun --oversubscribe -np <largest process count> ./mpi_bench
+ *              -k trap,gemm -p 1,2,4 -t 1,2 -r 20 -f csv -o trap_gemm.csv
+ *
+ * Note:     Every process count is run inside the one launch: the first
+ *           p ranks of MPI_COMM_WORLD get their own communicator and the
+ *           rest sleep until they are done, so the idle ranks don't take
+ *           cores from the busy ones when the box is oversubscribed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <omp.h>
+#include <mpi.h>
+#include "bench.h"
+#include "../Final/toss_kernel.h"
+#include "../Trapezoidal_Rule/omp_quad.h"
+#include "../Trapezoidal_Rule/partition.h"
+#include "../Homework3/gemm.h"
+
+#define MAX_LIST   64
+#define MAX_ROWS   4096
+#define BLOCK_LOW(id,p,n)  ((long)(id)*(n)/(p))
+#define SEED       20200501ULL
+
+/* A kernel's state on one process */
+typedef struct {
+   MPI_Comm comm;
+   int rank, procs;
+   long size;                /* global points, tosses or terms; matrix rows */
+   long cols;                /* matrix columns (and inner dimension) */
+   long first, count;        /* my block */
+   integrand_t f;
+   toss_fn toss;
+   double *a, *b, *c, *y;
+   int *counts, *displs;
+} kernel_ctx_t;
+
+typedef struct {
+   const char* name;
+   const char* unit;
+   long default_size;
+   int matrix;               /* size is a matrix order */
+   double (*run)(void* ctx);
+} kernel_t;
+
+double Run_mc(void* ctx);
+double Run_rect_block(void* ctx);
+double Run_rect_cyclic(void* ctx);
+double Run_rect_bcyclic(void* ctx);
+double Run_trap(void* ctx);
+double Run_series(void* ctx);
+double Run_matvec(void* ctx);
+double Run_gemm(void* ctx);
+
+static const kernel_t kernels[] = {
+   {"mc",          "tosses", 1L << 26, 0, Run_mc},
+   {"rect_block",  "points", 1L << 24, 0, Run_rect_block},
+   {"rect_cyclic", "points", 1L << 24, 0, Run_rect_cyclic},
+   {"rect_bcyclic", "points", 1L << 24, 0, Run_rect_bcyclic},
+   {"trap",        "points", 1L << 24, 0, Run_trap},
+   {"series",      "terms",  1L << 27, 0, Run_series},
+   {"matvec",      "flops",  4096,     1, Run_matvec},
+   {"gemm",        "flops",  1024,     1, Run_gemm},
+};
+#define KERNEL_COUNT (int)(sizeof(kernels)/sizeof(kernels[0]))
+
+int Parse_list(const char* spec, long* list);
+void Setup(const kernel_t* k, MPI_Comm comm, long size, long cols, kernel_ctx_t* ctx);
+void Teardown(kernel_ctx_t* ctx);
+void Scale(bench_row_t* rows, int count);
+
+int main(int argc, char* argv[]) {
+   int my_rank, comm_sz, provided, opt, i, ki, si, pi, ti;
+   int use[KERNEL_COUNT], weak = 0, warmup = 2, reps = 10, json = 0, data = 0;
+   int proc_count = 0, thread_count = 1, size_count = 0, row_count = 0;
+   long procs[MAX_LIST], threads[MAX_LIST] = {1}, sizes[MAX_LIST], size, cols, workers;
+   char label[BENCH_NAME] = "dev", host[MPI_MAX_PROCESSOR_NAME];
+   const char* out_name = NULL;
+   double* times, check;
+   bench_row_t* rows = NULL, *row;
+   kernel_ctx_t ctx;
+   MPI_Comm sub;
+   MPI_Request done;
+   FILE *out = stdout, *progress = stdout;
+
+   /* Only the master thread of each rank makes MPI calls */
+   MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+   MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+   MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+
+   for (i = 0; i < KERNEL_COUNT; i++) use[i] = 1;
+   while ((opt = getopt(argc, argv, "k:m:p:t:n:w:r:f:o:l:")) != -1) {
+      switch (opt) {
+         case 'k':
+            if (strcmp(optarg, "all") != 0)
+               for (i = 0; i < KERNEL_COUNT; i++) {
+                  size_t len = strlen(kernels[i].name);
+                  const char* p = strstr(optarg, kernels[i].name);
+
+                  /* whole names only: rect_block doesn't match rect */
+                  while (p != NULL && ((p != optarg && p[-1] != ',') || (p[len] != ',' && p[len] != '\0')))
+                     p = strstr(p + 1, kernels[i].name);
+                  use[i] = (p != NULL);
+               }
+            break;
+         case 'm': weak = (strcmp(optarg, "weak") == 0); break;
+         case 'p': proc_count = Parse_list(optarg, procs); break;
+         case 't': thread_count = Parse_list(optarg, threads); break;
+         case 'n': size_count = Parse_list(optarg, sizes); break;
+         case 'w': warmup = atoi(optarg); break;
+         case 'r': reps = atoi(optarg); break;
+         case 'f': json = (strcmp(optarg, "json") == 0); data = 1; break;
+         case 'o': out_name = optarg; data = 1; break;
+         case 'l': snprintf(label, sizeof(label), "%s", optarg); break;
+         default:
+            if (my_rank == 0)
+               fprintf(stderr, "usage: %s [-k kernels] [-m strong|weak] [-p procs] [-t threads] "
+                     "[-n sizes] [-w warmup] [-r reps] [-f csv|json] [-o file] [-l label]\n", argv[0]);
+            MPI_Finalize();
+            return 1;
+      }
+   }
+   if (out_name != NULL && strstr(out_name, ".json") != NULL) json = 1;
+   if (proc_count == 0) {
+      for (i = 1; i < comm_sz; i *= 2) procs[proc_count++] = i;
+      procs[proc_count++] = comm_sz;
+   }
+   if (reps < 1) reps = 1;
+
+   if (my_rank == 0) {
+      if (data && out_name == NULL) progress = stderr;
+      if (out_name != NULL && (out = fopen(out_name, "w")) == NULL) {
+         fprintf(stderr, "Can't open %s\n", out_name);
+         MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      MPI_Get_processor_name(host, &i);
+      fprintf(progress, "# %s: %d ranks started, %d processors, %s scaling, %d warmup + %d runs, label %s\n",
+            host, comm_sz, omp_get_num_procs(), weak ? "weak" : "strong", warmup, reps, label);
+      fprintf(progress, "# %-12s %6s %7s %12s %12s %12s %8s %6s %14s\n", "kernel", "procs",
+            "threads", "size", "median (s)", "p95 (s)", "speedup", "eff", "throughput");
+      rows = malloc(MAX_ROWS*sizeof(bench_row_t));
+   }
+   times = malloc(reps*sizeof(double));
+
+   for (ki = 0; ki < KERNEL_COUNT; ki++) {
+      if (!use[ki]) continue;
+      for (si = 0; si < (size_count ? size_count : 1); si++)
+         for (pi = 0; pi < proc_count; pi++) {
+            if (procs[pi] < 1 || procs[pi] > comm_sz) continue;
+            MPI_Comm_split(MPI_COMM_WORLD, my_rank < procs[pi] ? 0 : MPI_UNDEFINED, my_rank, &sub);
+            if (sub != MPI_COMM_NULL) {
+               for (ti = 0; ti < thread_count; ti++) {
+                  omp_set_num_threads((int) threads[ti]);
+                  workers = weak ? procs[pi]*threads[ti] : 1;
+                  size = size_count ? sizes[si] : kernels[ki].default_size;
+                  cols = kernels[ki].matrix ? size : 0;
+                  Setup(&kernels[ki], sub, size*workers, cols, &ctx);
+                  check = bench_time(sub, warmup, reps, kernels[ki].run, &ctx, times);
+                  if (my_rank == 0 && row_count < MAX_ROWS) {
+                     row = &rows[row_count++];
+                     memset(row, 0, sizeof(*row));
+                     row->check = check;
+                     snprintf(row->label, sizeof(row->label), "%s", label);
+                     snprintf(row->kernel, sizeof(row->kernel), "%s", kernels[ki].name);
+                     snprintf(row->mode, sizeof(row->mode), "%s", weak ? "weak" : "strong");
+                     snprintf(row->unit, sizeof(row->unit), "%s", kernels[ki].unit);
+                     row->procs = (int) procs[pi];
+                     row->threads = (int) threads[ti];
+                     row->size = ctx.size;
+                     row->warmup = warmup;
+                     row->reps = reps;
+                     row->work = kernels[ki].matrix
+                        ? 2.0*ctx.size*ctx.cols*(kernels[ki].run == Run_gemm ? ctx.cols : 1)
+                        : (double) ctx.size;
+                     bench_stats(times, reps, &row->stats);
+                     row->throughput = row->work/row->stats.median;
+                     Scale(rows, row_count);
+                     fprintf(progress, "  %-12s %6d %7d %12ld %12.6f %12.6f %8.2f %5.0f%% %10.4g %s/s\n",
+                           row->kernel, row->procs, row->threads, row->size, row->stats.median,
+                           row->stats.p95, row->speedup, 100.0*row->efficiency, row->throughput,
+                           row->unit);
+                     fflush(progress);
+                  }
+                  Teardown(&ctx);
+               }
+               MPI_Comm_free(&sub);
+            }
+
+            /* The idle ranks wait here, asleep */
+            MPI_Ibarrier(MPI_COMM_WORLD, &done);
+            bench_wait(&done);
+         }
+   }
+
+   if (my_rank == 0) {
+      if (data) {
+         if (json) bench_write_json(out, rows, row_count);
+         else bench_write_csv(out, rows, row_count);
+      }
+      if (out != stdout) fclose(out);
+      free(rows);
+   }
+   free(times);
+
+   MPI_Finalize();
+   return 0;
+}  /* main */
+
+/*------------------------------------------------------------------
+ * Function:     Parse_list
+ * Purpose:      Read a comma separated list of counts, such as 1,2,4 or
+ *               1e6,1e7
+ * Return val:   The number of entries
+ */
+int Parse_list(const char* spec, long* list) {
+   const char* p = spec;
+   char* end;
+   int count = 0;
+
+   while (*p != '\0' && count < MAX_LIST) {
+      list[count++] = (long) strtod(p, &end);
+      if (end == p) break;
+      p = (*end == ',') ? end + 1 : end;
+   }
+   return count;
+}  /* Parse_list */
+
+/*------------------------------------------------------------------
+ * Function:     Setup
+ * Purpose:      My block of the problem, with its data
+ * Input args:   size:  global points, tosses or terms, or matrix rows
+ *               cols:  matrix columns, 0 for the other kernels
+ */
+void Setup(const kernel_t* k, MPI_Comm comm, long size, long cols, kernel_ctx_t* ctx) {
+   long i, j, m;
+   int p;
+
+   memset(ctx, 0, sizeof(*ctx));
+   ctx->comm = comm;
+   MPI_Comm_rank(comm, &ctx->rank);
+   MPI_Comm_size(comm, &ctx->procs);
+   ctx->size = size;
+   ctx->cols = cols;
+   ctx->first = BLOCK_LOW(ctx->rank, ctx->procs, size);
+   ctx->count = BLOCK_LOW(ctx->rank + 1, ctx->procs, size) - ctx->first;
+   integrand_lookup("pi", &ctx->f, NULL);
+   ctx->toss = toss_kernel_select(NULL);
+
+   if (!k->matrix) return;
+   m = ctx->count;
+   ctx->a = malloc((m*cols + 1)*sizeof(double));
+   ctx->b = malloc((cols*cols + 1)*sizeof(double));
+   ctx->c = malloc((m*cols + 1)*sizeof(double));
+   ctx->y = malloc((size + 1)*sizeof(double));
+   ctx->counts = malloc(ctx->procs*sizeof(int));
+   ctx->displs = malloc(ctx->procs*sizeof(int));
+   /* Small integers, so every product and sum is exact */
+#  pragma omp parallel for private(j)
+   for (i = 0; i < m; i++)
+      for (j = 0; j < cols; j++)
+         ctx->a[i*cols + j] = (double)((ctx->first + i + 2*j) % 7) - 3.0;
+#  pragma omp parallel for private(j)
+   for (i = 0; i < cols; i++)
+      for (j = 0; j < cols; j++)
+         ctx->b[i*cols + j] = (double)((3*i + j) % 5) - 2.0;
+   for (p = 0; p < ctx->procs; p++) {
+      ctx->displs[p] = (int) BLOCK_LOW(p, ctx->procs, size);
+      ctx->counts[p] = (int)(BLOCK_LOW(p + 1, ctx->procs, size) - ctx->displs[p]);
+   }
+}  /* Setup */
+
+void Teardown(kernel_ctx_t* ctx) {
+   free(ctx->a);
+   free(ctx->b);
+   free(ctx->c);
+   free(ctx->y);
+   free(ctx->counts);
+   free(ctx->displs);
+}  /* Teardown */
+
+/*------------------------------------------------------------------
+ * Function:     Scale
+ * Purpose:      Speedup and efficiency of the last row against the row
+ *               of the same kernel, mode and per-worker size with the
+ *               fewest processes x threads
+ */
+void Scale(bench_row_t* rows, int count) {
+   bench_row_t* last = &rows[count-1], *base = last;
+   long workers = (long) last->procs*last->threads, base_workers = workers;
+   int i, weak = strcmp(last->mode, "weak") == 0;
+   double ratio;
+
+   for (i = 0; i < count - 1; i++) {
+      long w = (long) rows[i].procs*rows[i].threads;
+
+      if (strcmp(rows[i].kernel, last->kernel) != 0 || strcmp(rows[i].mode, last->mode) != 0)
+         continue;
+      /* same problem: the same global size (strong) or size per worker (weak) */
+      if (weak ? rows[i].size/w != last->size/workers : rows[i].size != last->size)
+         continue;
+      if (w < base_workers) {
+         base = &rows[i];
+         base_workers = w;
+      }
+   }
+   ratio = (double) workers/base_workers;
+   if (weak) {
+      last->efficiency = base->stats.median/last->stats.median;
+      last->speedup = last->efficiency*ratio;
+   } else {
+      last->speedup = base->stats.median/last->stats.median;
+      last->efficiency = last->speedup/ratio;
+   }
+}  /* Scale */
+
+/* Monte Carlo: pi from my block of tosses, threads splitting it */
+double Run_mc(void* ctx_p) {
+   kernel_ctx_t* ctx = ctx_p;
+   long long hits = 0, total = 0;
+
+#  pragma omp parallel reduction(+: hits)
+   {
+      int t = omp_get_thread_num(), nt = omp_get_num_threads();
+      long lo = BLOCK_LOW(t, nt, ctx->count);
+
+      hits = ctx->toss(SEED, ctx->first + lo, BLOCK_LOW(t + 1, nt, ctx->count) - lo);
+   }
+   MPI_Reduce(&hits, &total, 1, MPI_LONG_LONG, MPI_SUM, 0, ctx->comm);
+   return 4.0*total/ctx->size;
+}  /* Run_mc */
+
+/* Midpoint rule for pi on [0, 1], my block of rectangles */
+double Run_rect_block(void* ctx_p) {
+   kernel_ctx_t* ctx = ctx_p;
+   double h = 1.0/ctx->size, local, total = 0.0;
+
+   local = h*omp_grid_sum(&ctx->f, 0.0, h, ctx->first + 0.5, ctx->count, 1);
+   MPI_Reduce(&local, &total, 1, MPI_DOUBLE, MPI_SUM, 0, ctx->comm);
+   return total;
+}  /* Run_rect_block */
+
+/* Midpoint rule for pi on [0, 1], rectangles rank, rank+p, ... */
+double Run_rect_cyclic(void* ctx_p) {
+   kernel_ctx_t* ctx = ctx_p;
+   double h = 1.0/ctx->size, local, total = 0.0;
+   long count = (ctx->size - ctx->rank + ctx->procs - 1)/ctx->procs;
+
+   local = h*omp_grid_sum(&ctx->f, 0.0, h, ctx->rank + 0.5, count, ctx->procs);
+   MPI_Reduce(&local, &total, 1, MPI_DOUBLE, MPI_SUM, 0, ctx->comm);
+   return total;
+}  /* Run_rect_cyclic */
+
+/* Midpoint rule for pi on [0, 1], chunks of PART_CHUNK rectangles dealt
+ * out round robin */
+double Run_rect_bcyclic(void* ctx_p) {
+   kernel_ctx_t* ctx = ctx_p;
+   double h = 1.0/ctx->size, local = 0.0, total = 0.0;
+   partition_t part;
+   part_run_t run;
+   long k;
+
+   part_init(&part, PART_BLOCK_CYCLIC, ctx->size, ctx->procs, PART_CHUNK);
+   for (k = 0; k < part_runs(&part, ctx->rank); k++) {
+      part_run(&part, ctx->rank, k, &run);
+      local += h*omp_grid_sum(&ctx->f, 0.0, h, run.first + 0.5, run.count, run.stride);
+   }
+   MPI_Reduce(&local, &total, 1, MPI_DOUBLE, MPI_SUM, 0, ctx->comm);
+   return total;
+}  /* Run_rect_bcyclic */
+
+/* Trapezoidal rule for pi on [0, 1], my block of trapezoids */
+double Run_trap(void* ctx_p) {
+   kernel_ctx_t* ctx = ctx_p;
+   double h = 1.0/ctx->size, local = 0.0, total = 0.0;
+
+   if (ctx->count > 0)
+      local = Trap_omp(&ctx->f, ctx->first*h, (ctx->first + ctx->count)*h, ctx->count);
+   MPI_Reduce(&local, &total, 1, MPI_DOUBLE, MPI_SUM, 0, ctx->comm);
+   return total;
+}  /* Run_trap */
+
+/* Sum of 1 + i over my block of terms */
+double Run_series(void* ctx_p) {
+   kernel_ctx_t* ctx = ctx_p;
+   double local = 0.0, total = 0.0;
+   long i;
+
+#  pragma omp parallel for reduction(+: local) schedule(static)
+   for (i = ctx->first; i < ctx->first + ctx->count; i++)
+      local += 1.0 + (double) i;
+   MPI_Reduce(&local, &total, 1, MPI_DOUBLE, MPI_SUM, 0, ctx->comm);
+   return total;
+}  /* Run_series */
+
+/* y = A*x for my rows, x = the first row of B, then everyone gets y */
+double Run_matvec(void* ctx_p) {
+   kernel_ctx_t* ctx = ctx_p;
+   long i, j, n = ctx->cols;
+   double sum, check = 0.0;
+
+#  pragma omp parallel for private(j, sum) schedule(static)
+   for (i = 0; i < ctx->count; i++) {
+      sum = 0.0;
+      for (j = 0; j < n; j++) sum += ctx->a[i*n + j]*ctx->b[j];
+      ctx->c[i] = sum;
+   }
+   MPI_Allgatherv(ctx->c, (int) ctx->count, MPI_DOUBLE, ctx->y, ctx->counts, ctx->displs,
+         MPI_DOUBLE, ctx->comm);
+   for (i = 0; i < ctx->size; i += 97) check += ctx->y[i];
+   return check;
+}  /* Run_matvec */
+
+/* C = A*B for my rows of A and C */
+double Run_gemm(void* ctx_p) {
+   kernel_ctx_t* ctx = ctx_p;
+   long n = ctx->cols;
+   double check = 0.0;
+
+   memset(ctx->c, 0, ctx->count*n*sizeof(double));
+   gemm((int) ctx->count, (int) n, (int) n, ctx->a, (int) n, ctx->b, (int) n, ctx->c, (int) n);
+   if (ctx->count > 0) check = ctx->c[0] + ctx->c[ctx->count*n - 1];
+   MPI_Reduce(ctx->rank == 0 ? MPI_IN_PLACE : &check, &check, 1, MPI_DOUBLE, MPI_SUM, 0, ctx->comm);
+   return check;
+}  /* Run_gemm */
@@ -0,0 +1,110 @@
+/***********************************************************
+* Program:
+    Final Project: Pi estimation, hybrid MPI + OpenMP
+*
+* Run one MPI process per node (or socket) and let OpenMP threads
+* inside each process share its block of tosses.  Only the master
+* thread calls MPI, so MPI_THREAD_FUNNELED is enough.
+*
+* Compile:  mpicc -O3 -fopenmp -o hybrid_mpi hybrid_mpi.c -lm
+* Run:      OMP_PROC_BIND=spread mpirun -np <ranks> --map-by ppr:1:node:pe=<threads>
+*               ./hybrid_mpi <threads_per_rank> <number_of_tosses> [seed]
+*************************************************************/
+#include <mpi.h>
+#include <omp.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "toss_kernel.h"
+
+// Marcos
+#define MASTER 0      /* rank of the master */
+#define BLOCK_LOW(id,p,n)   ((id)*(n)/(p))
+#define BLOCK_HIGH(id,p,n)  (BLOCK_LOW((id)+1,p,n)-1)
+
+int main(int argc, char *argv[]) {
+    int rank, nprocs, provided, thread_count;
+    long long number_of_tosses, number_in_circle = 0, circles;
+    long long rank_first, rank_count;
+    double pi_estimate;
+    double PI25DT = 3.141592653589793238462643;
+    double start_time, elapsed;
+    unsigned long long seed;
+    const char* isa;
+    toss_fn toss;
+
+    /* Start up MPI; only the master thread of each rank makes MPI calls */
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (provided < MPI_THREAD_FUNNELED) {
+        if (rank == MASTER) {
+            printf("MPI library does not support MPI_THREAD_FUNNELED\n");
+        }
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    /* Get input <threads_per_rank> <number_of_tosses> [seed] from the command line */
+    if (argc != 3 && argc != 4){
+        if (rank == MASTER) {
+            printf("usage: mpirun -np <number_of_processes> ./hybrid_mpi <threads_per_rank> <number_of_tosses> [seed] \n");
+        }
+        MPI_Finalize();
+        exit(-1);
+    } else {
+        thread_count = strtol(argv[1], NULL, 10);
+        number_of_tosses = strtoll(argv[2], NULL, 10);
+    }
+    if (thread_count < 1 || number_of_tosses < 1) {
+        if (rank == MASTER) {
+            printf("threads_per_rank and number_of_tosses must be positive\n");
+        }
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    /* Same seed everywhere, so the estimate does not depend on ranks x threads */
+    if (rank == MASTER) {
+        seed = (argc == 4) ? strtoull(argv[3], NULL, 10) : (unsigned long long) time(NULL);
+    }
+    MPI_Bcast(&seed, 1, MPI_UNSIGNED_LONG_LONG, MASTER, MPI_COMM_WORLD);
+
+    toss = toss_kernel_select(&isa);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start_time = MPI_Wtime();
+
+    /* Block partitioning at both levels: each rank takes a block of the
+     * tosses, each of its threads a block of the rank's block */
+    rank_first = BLOCK_LOW(rank, nprocs, number_of_tosses);
+    rank_count = BLOCK_HIGH(rank, nprocs, number_of_tosses) - rank_first + 1;
+
+    # pragma omp parallel num_threads(thread_count) reduction(+: number_in_circle)
+    {
+        int my_thread = omp_get_thread_num();
+        int my_count = omp_get_num_threads();
+        long long first = rank_first + BLOCK_LOW(my_thread, my_count, rank_count);
+        long long last = rank_first + BLOCK_HIGH(my_thread, my_count, rank_count);
+
+        number_in_circle += toss(seed, first, last - first + 1);
+    }
+
+    /* One reduction per rank, made by the master thread */
+    MPI_Reduce(&number_in_circle, &circles, 1, MPI_LONG_LONG, MPI_SUM, MASTER, MPI_COMM_WORLD);
+    elapsed = MPI_Wtime() - start_time;
+
+    /* Print the result */
+    if (rank == MASTER) {
+        pi_estimate = (4*circles)/((double) number_of_tosses);
+        printf("Pi is approximately %.16f, Error is %.16f\n", pi_estimate, fabs(pi_estimate - PI25DT));
+        printf("%d ranks x %d threads, %.3f s, %.3e tosses/s\n",
+               nprocs, thread_count, elapsed, number_of_tosses / elapsed);
+        printf("Seed is %llu, toss kernel is %s\n", seed, isa);
+    }
+    /* Shut down MPI */
+    MPI_Finalize();
+    return 0;
+}/*  main  */
@@ -1,24 +1,90 @@
 /***********************************************************
-* Program: 
+* Program:
     Final Project: Pi estimation
+*
+* Long runs can checkpoint: give a checkpoint file name and every
+* rank periodically saves where it is in its block of tosses and how
+* many hits it has so far to <name>.<rank>.  Rerunning the same
+* command after a crash resumes each rank from its last checkpoint;
+* the checkpoint file comes after the seed, so the run must be given
+* its seed on the command line, and the rerun the same seed.  The
+* checkpoints are removed only after the result has been printed.
 *************************************************************/
-#include <mpi.h>  
+#include <mpi.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include "toss_kernel.h"
 
 // Marcos
 #define MASTER 0      /* rank of the master */
 #define BLOCK_LOW(id,p,n)   ((id)*(n)/(p))
 #define BLOCK_HIGH(id,p,n)  (BLOCK_LOW((id)+1,p,n)-1)
+#define MAX_NAME 256                  /* length of a checkpoint file name */
+#define CHECKPOINT_CHUNK (1LL << 26)  /* tosses between checkpoint-time checks */
+#define CHECKPOINT_SECONDS 60.0       /* default time between checkpoints */
+
+/*------------------------------------------------------------------
+ * Function:     write_checkpoint
+ * Purpose:      Save the state of this rank: the run it belongs to,
+ *               the next toss to make (which is all the random number
+ *               generator needs to resume) and the hits so far.  The
+ *               file is written under a temporary name and renamed, so
+ *               a crash while writing leaves the previous checkpoint.
+ * Input args:   path:  checkpoint file of this rank
+ *               seed, number_of_tosses, nprocs, rank:  the run
+ *               next:  next toss of this rank
+ *               hits:  hits among the tosses before next
+ */
+void write_checkpoint(const char* path, unsigned long long seed, long long number_of_tosses,
+                      int nprocs, int rank, long long next, long long hits) {
+    char tmp[MAX_NAME + 8];
+    FILE* fp;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "rank %d: cannot write checkpoint %s: %s\n", rank, tmp, strerror(errno));
+        return;
+    }
+    fprintf(fp, "%llu %lld %d %d %lld %lld\n", seed, number_of_tosses, nprocs, rank, next, hits);
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+        fprintf(stderr, "rank %d: cannot write checkpoint %s: %s\n", rank, path, strerror(errno));
+    }
+}  /* write_checkpoint */
+
+/*------------------------------------------------------------------
+ * Function:     read_checkpoint
+ * Purpose:      Load the state saved by write_checkpoint
+ * Input args:   path:  checkpoint file of this rank
+ * Output args:  seed, number_of_tosses, nprocs, rank, next, hits
+ * Return val:   1 if a complete checkpoint was read, else 0
+ */
+int read_checkpoint(const char* path, unsigned long long* seed, long long* number_of_tosses,
+                    int* nprocs, int* rank, long long* next, long long* hits) {
+    FILE* fp = fopen(path, "r");
+    int ok;
+
+    if (fp == NULL) return 0;
+    ok = (fscanf(fp, "%llu %lld %d %d %lld %lld", seed, number_of_tosses, nprocs, rank, next, hits) == 6);
+    fclose(fp);
+    return ok;
+}  /* read_checkpoint */
 
 int main(int argc, char *argv[]) {
-    int rank, nprocs;
-    long long i, number_of_tosses, number_in_circle = 0, circles;
+    int rank, nprocs, resumed = 0, found, saved_nprocs, saved_rank;
+    long long number_of_tosses, number_in_circle = 0, circles;
+    long long first, last, next, count, saved_tosses, saved_next, saved_hits;
     double pi_estimate;
-    double x, y;
+    double interval = CHECKPOINT_SECONDS, last_checkpoint;
+    unsigned long long seed, saved_seed;
+    char checkpoint[MAX_NAME] = "";
+    char* end;
+    const char* isa;
+    toss_fn toss;
     double PI25DT = 3.141592653589793238462643;
 
     /* Start up MPI */
@@ -27,37 +93,95 @@ int main(int argc, char *argv[]) {
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
     /* Get input <number_of_tosses> from the command line */
-    if (argc!= 2){
-        printf("usage: mpirun -np <number_of_processes> ./ProgramName <number_of_tosses> \n");
+    if (argc < 2 || argc > 5){
+        if (rank == MASTER) {
+            printf("usage: mpirun -np <number_of_processes> ./ProgramName <number_of_tosses> [seed] [checkpoint_file] [checkpoint_seconds] \n");
+            printf("to resume, rerun with the same number of processes, number_of_tosses, seed and checkpoint_file\n");
+        }
         MPI_Finalize();
         exit(-1);
     } else {
-        number_of_tosses = atoi(argv[1]);
+        errno = 0;
+        number_of_tosses = strtoll(argv[1], &end, 10);
+        if (errno != 0 || *end != '\0' || number_of_tosses < 1) {
+            if (rank == MASTER) {
+                printf("number_of_tosses must be a positive 64-bit integer\n");
+            }
+            MPI_Finalize();
+            exit(-1);
+        }
     }
+    if (argc > 3) snprintf(checkpoint, sizeof(checkpoint), "%s.%d", argv[3], rank);
+    if (argc > 4) interval = strtod(argv[4], NULL);
 
-    /* Random number generator */
-    unsigned int seed = (unsigned) time(NULL);
-	srand(seed + rank);
+    /* Random number generator: every rank uses the same seed, taken from
+     * the command line or from the clock on the master, and toss i always
+     * uses the same random numbers, so a run is reproducible from its seed
+     * whatever the number of processes.  When resuming, the master's
+     * checkpoint decides the seed. */
+    if (rank == MASTER) {
+        seed = (argc > 2) ? strtoull(argv[2], NULL, 10) : (unsigned long long) time(NULL);
+        if (checkpoint[0] != '\0'
+              && read_checkpoint(checkpoint, &saved_seed, &saved_tosses, &saved_nprocs, &saved_rank, &saved_next, &saved_hits)
+              && saved_tosses == number_of_tosses && saved_nprocs == nprocs) {
+            seed = saved_seed;
+        }
+    }
+    MPI_Bcast(&seed, 1, MPI_UNSIGNED_LONG_LONG, MASTER, MPI_COMM_WORLD);
+
+    /* Pick the widest SIMD toss kernel this CPU supports */
+    toss = toss_kernel_select(&isa);
+
+    /* Use Block Partitioning: the kernel starts at the first toss of this rank */
+    first = BLOCK_LOW(rank, nprocs, number_of_tosses);
+    last = BLOCK_HIGH(rank, nprocs, number_of_tosses);
+    next = first;
+
+    /* Resume from this rank's checkpoint if it belongs to the same run */
+    if (checkpoint[0] != '\0'
+          && read_checkpoint(checkpoint, &saved_seed, &saved_tosses, &saved_nprocs, &saved_rank, &saved_next, &saved_hits)
+          && saved_seed == seed && saved_tosses == number_of_tosses && saved_nprocs == nprocs
+          && saved_rank == rank && saved_next >= first && saved_next <= last + 1) {
+        next = saved_next;
+        number_in_circle = saved_hits;
+        resumed = 1;
+    }
+    MPI_Reduce(&resumed, &found, 1, MPI_INT, MPI_SUM, MASTER, MPI_COMM_WORLD);
+    if (rank == MASTER && found > 0) {
+        printf("Resumed %d of %d ranks from checkpoint\n", found, nprocs);
+    }
 
-    /* Use Block Partitioning */
-    for (i = BLOCK_LOW(rank, nprocs, number_of_tosses); i <= BLOCK_HIGH(rank, nprocs, number_of_tosses); i++) {
-	   x = rand_r(&seed)/(double)RAND_MAX;
-	   y = rand_r(&seed)/(double)RAND_MAX;
-	   if( (x*x+y*y) <= 1.0 ){
-           number_in_circle++;
+    /* Toss in chunks so the time since the last checkpoint can be checked */
+    last_checkpoint = MPI_Wtime();
+    while (next <= last) {
+        count = (last - next + 1 < CHECKPOINT_CHUNK) ? last - next + 1 : CHECKPOINT_CHUNK;
+        number_in_circle += toss(seed, next, count);
+        next += count;
+        if (checkpoint[0] != '\0' && next <= last && MPI_Wtime() - last_checkpoint >= interval) {
+            write_checkpoint(checkpoint, seed, number_of_tosses, nprocs, rank, next, number_in_circle);
+            last_checkpoint = MPI_Wtime();
         }
     }
 
     /* Add up the integrals calculated by each process */
-    MPI_Reduce(&number_in_circle, &circles, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&number_in_circle, &circles, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
 
     /* Print the result */
     if (rank == 0) {
         pi_estimate = (4*circles)/((double) number_of_tosses);
         printf("Pi is approximately %.16f, Error is %.16f\n", pi_estimate, fabs(pi_estimate - PI25DT));
+        printf("Seed is %llu, toss kernel is %s\n", seed, isa);
+        fflush(stdout);
+    }
+
+    /* The run is complete once the master has printed it: only then are
+     * the checkpoints no longer needed */
+    if (checkpoint[0] != '\0') {
+        MPI_Barrier(MPI_COMM_WORLD);
+        remove(checkpoint);
     }
     /* Shut down MPI */
-    MPI_Finalize(); 
+    MPI_Finalize();
     return 0;
 }/*  main  */
 
@@ -0,0 +1,108 @@
+/***********************************************************
+* Program:
+    Final Project: Pi estimation, quasi-Monte Carlo
+*
+* Estimate pi (the area of the quarter disc, times 4) twice with the
+* same number of points: once with pseudo-random darts and once with a
+* low-discrepancy (Sobol or Halton) sequence.  Print the error of each
+* against PI25DT, and how many pseudo-random darts would be needed on
+* average to match the quasi-random error.
+*
+* Each rank takes a contiguous segment of the sequence and jumps to its
+* start directly, so the ranks only meet in the final reduction.
+*
+* Compile:  mpicc -O3 -o mpi_qmc mpi_qmc.c -lm
+* Run:      mpirun -np <number_of_processes> ./mpi_qmc <number_of_points>
+*               [sobol|halton] [scramble: 0|1] [seed]
+*************************************************************/
+#include <mpi.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "toss_kernel.h"
+#include "qmc.h"
+
+// Marcos
+#define MASTER 0      /* rank of the master */
+#define BLOCK_LOW(id,p,n)   ((id)*(n)/(p))
+#define BLOCK_HIGH(id,p,n)  (BLOCK_LOW((id)+1,p,n)-1)
+#define DART_VARIANCE (16.0 * 0.25 * M_PI * (1.0 - 0.25 * M_PI))   /* of 4*[hit] */
+
+int main(int argc, char *argv[]) {
+    int rank, nprocs, kind = QMC_SOBOL, scrambled = 0;
+    long long i, number_of_points, first, last;
+    long long local[2] = {0, 0},      /* hits: pseudo-random, quasi-random */
+              global[2];
+    double x, y, prng_estimate, qmc_estimate, qmc_error;
+    double PI25DT = 3.141592653589793238462643;
+    double start_time, prng_time, qmc_time;
+    unsigned long long seed;
+    qmc_seq_t seq;
+
+    /* Start up MPI */
+    MPI_Init(NULL, NULL);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    /* Get input from the command line */
+    if (argc < 2 || argc > 5 || (argc > 2 && strcmp(argv[2], "sobol") != 0 && strcmp(argv[2], "halton") != 0)) {
+        if (rank == MASTER) {
+            printf("usage: mpirun -np <number_of_processes> ./mpi_qmc <number_of_points> [sobol|halton] [scramble: 0|1] [seed] \n");
+        }
+        MPI_Finalize();
+        exit(-1);
+    }
+    number_of_points = strtoll(argv[1], NULL, 10);
+    if (argc > 2 && strcmp(argv[2], "halton") == 0) kind = QMC_HALTON;
+    if (argc > 3) scrambled = atoi(argv[3]);
+
+    if (rank == MASTER) {
+        seed = (argc > 4) ? strtoull(argv[4], NULL, 10) : (unsigned long long) time(NULL);
+    }
+    MPI_Bcast(&seed, 1, MPI_UNSIGNED_LONG_LONG, MASTER, MPI_COMM_WORLD);
+
+    first = BLOCK_LOW(rank, nprocs, number_of_points);
+    last = BLOCK_HIGH(rank, nprocs, number_of_points);
+
+    /* Pseudo-random darts */
+    start_time = MPI_Wtime();
+    local[0] = toss_kernel_select(NULL)(seed, first, last - first + 1);
+    prng_time = MPI_Wtime() - start_time;
+
+    /* Quasi-random darts: skip straight to this rank's segment */
+    start_time = MPI_Wtime();
+    qmc_init(&seq, kind, first, scrambled, seed);
+    for (i = first; i <= last; i++) {
+        qmc_next(&seq, &x, &y);
+        local[1] += (x*x + y*y <= 1.0);
+    }
+    qmc_time = MPI_Wtime() - start_time;
+
+    /* Add up the hits of each process */
+    MPI_Reduce(local, global, 2, MPI_LONG_LONG, MPI_SUM, MASTER, MPI_COMM_WORLD);
+
+    /* Print the result */
+    if (rank == MASTER) {
+        prng_estimate = (4*global[0])/((double) number_of_points);
+        qmc_estimate = (4*global[1])/((double) number_of_points);
+        qmc_error = fabs(qmc_estimate - PI25DT);
+        printf("Pseudo-random: Pi is approximately %.16f, Error is %.16f (%.3f s)\n",
+               prng_estimate, fabs(prng_estimate - PI25DT), prng_time);
+        printf("%s%s: Pi is approximately %.16f, Error is %.16f (%.3f s)\n",
+               kind == QMC_SOBOL ? "Sobol" : "Halton", scrambled ? " (scrambled)" : "",
+               qmc_estimate, qmc_error, qmc_time);
+        printf("Expected pseudo-random error with %lld points: %.3e\n",
+               number_of_points, sqrt(DART_VARIANCE / number_of_points));
+        if (qmc_error > 0.0) {
+            printf("Pseudo-random points needed for the same error: %.3e (%.1fx)\n",
+                   DART_VARIANCE / (qmc_error * qmc_error),
+                   DART_VARIANCE / (qmc_error * qmc_error) / number_of_points);
+        }
+        printf("Seed is %llu\n", seed);
+    }
+    /* Shut down MPI */
+    MPI_Finalize();
+    return 0;
+}/*  main  */
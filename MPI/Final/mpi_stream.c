@@ -0,0 +1,155 @@
+/***********************************************************
+* Program:
+    Final Project: Pi estimation to a target precision
+*
+* Instead of a fixed number of tosses, the ranks toss in rounds and
+* stop as soon as the 95% confidence interval on pi is narrower than
+* the requested tolerance.  The counts of each round are combined with
+* MPI_Iallreduce while the next round is being tossed, so the check
+* costs no waiting; the price is that the decision lags one round.
+* The round is tossed in pieces of TEST_TOSSES with an MPI_Test after
+* each, so the reduction progresses during the tossing even when the
+* MPI library has no progress thread.
+*
+* Compile:  mpicc -O3 -o mpi_stream mpi_stream.c -lm
+* Run:      mpirun -np <number_of_processes> ./mpi_stream <tolerance>
+*               [tosses_per_round] [max_tosses] [seed]
+*************************************************************/
+#include <mpi.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include "toss_kernel.h"
+
+// Marcos
+#define MASTER 0      /* rank of the master */
+#define BLOCK_LOW(id,p,n)   ((id)*(n)/(p))
+#define BLOCK_HIGH(id,p,n)  (BLOCK_LOW((id)+1,p,n)-1)
+#define Z_95 1.959963984540054   /* two-sided 95% normal quantile */
+#define DEFAULT_ROUND 10000000LL  /* tosses per round, all ranks together */
+#define TEST_TOSSES (1LL << 20)   /* tosses of a rank between MPI_Tests */
+
+/*------------------------------------------------------------------
+ * Function:     estimate
+ * Purpose:      Estimate pi and the half width of its 95% confidence
+ *               interval from the hit count.  Each toss is a sample
+ *               4*[hit]; for 0/1 samples the sum of squares equals the
+ *               sum, so the counts carry the running variance exactly
+ *               and are all that has to be reduced.
+ * Input args:   hits:    darts inside the circle
+ *               tosses:  darts thrown
+ * Output args:  half_width:  half width of the interval
+ * Return val:   the estimate of pi
+ */
+double estimate(long long hits, long long tosses, double* half_width) {
+    double p = hits / (double) tosses;
+    double variance = 16.0 * p * (1.0 - p) * tosses / (tosses > 1 ? tosses - 1 : 1);
+
+    *half_width = Z_95 * sqrt(variance / tosses);
+    return 4.0 * p;
+}  /* estimate */
+
+int main(int argc, char *argv[]) {
+    int rank, nprocs, round, stop = 0, done;
+    long long round_tosses = DEFAULT_ROUND, max_tosses = LLONG_MAX;
+    long long first, count, my_count, tossed, piece;
+    long long local[2] = {0, 0},      /* hits, tosses of this rank so far */
+              sendbuf[2],             /* copy of local being reduced */
+              global[2] = {0, 0};     /* hits, tosses of all ranks */
+    double tolerance, pi_estimate, half_width;
+    double PI25DT = 3.141592653589793238462643;
+    double start_time, round_start, now;
+    unsigned long long seed;
+    const char* isa;
+    toss_fn toss;
+    MPI_Request request = MPI_REQUEST_NULL;
+
+    /* Start up MPI */
+    MPI_Init(NULL, NULL);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    /* Get input from the command line */
+    if (argc < 2 || argc > 5) {
+        if (rank == MASTER) {
+            printf("usage: mpirun -np <number_of_processes> ./mpi_stream <tolerance> [tosses_per_round] [max_tosses] [seed] \n");
+        }
+        MPI_Finalize();
+        exit(-1);
+    }
+    tolerance = strtod(argv[1], NULL);
+    if (argc > 2) round_tosses = strtoll(argv[2], NULL, 10);
+    if (argc > 3) max_tosses = strtoll(argv[3], NULL, 10);
+    if (tolerance <= 0.0 || round_tosses < 1 || max_tosses < 1) {
+        if (rank == MASTER) {
+            printf("tolerance, tosses_per_round and max_tosses must be positive\n");
+        }
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    if (rank == MASTER) {
+        seed = (argc > 4) ? strtoull(argv[4], NULL, 10) : (unsigned long long) time(NULL);
+    }
+    MPI_Bcast(&seed, 1, MPI_UNSIGNED_LONG_LONG, MASTER, MPI_COMM_WORLD);
+
+    toss = toss_kernel_select(&isa);
+
+    start_time = round_start = MPI_Wtime();
+    for (round = 0; !stop; round++) {
+        /* Toss this round (block partitioned) while the reduction of
+         * the previous round is in flight */
+        count = round_tosses;
+        if (max_tosses - round * round_tosses < count) {
+            count = max_tosses - round * round_tosses;
+        }
+        first = round * round_tosses + BLOCK_LOW(rank, nprocs, count);
+        my_count = BLOCK_HIGH(rank, nprocs, count) - BLOCK_LOW(rank, nprocs, count) + 1;
+        for (tossed = 0; tossed < my_count; tossed += piece) {
+            piece = (my_count - tossed < TEST_TOSSES) ? my_count - tossed : TEST_TOSSES;
+            local[0] += toss(seed, first + tossed, piece);
+            MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+        }
+        local[1] += my_count;
+
+        /* Totals up to the previous round are ready: report and decide.
+         * Every rank sees the same totals, so they all stop together. */
+        if (round > 0) {
+            MPI_Wait(&request, MPI_STATUS_IGNORE);
+            pi_estimate = estimate(global[0], global[1], &half_width);
+            now = MPI_Wtime();
+            if (rank == MASTER) {
+                printf("round %d: %lld tosses, pi = %.12f +/- %.3e, %.3e tosses/s\n",
+                       round - 1, global[1], pi_estimate, half_width,
+                       count / (now - round_start));
+                fflush(stdout);
+            }
+            round_start = now;
+            stop = (half_width <= tolerance);
+        }
+        if ((round + 1) * round_tosses >= max_tosses) {
+            stop = 1;
+        }
+
+        /* Start combining the totals including this round */
+        sendbuf[0] = local[0];
+        sendbuf[1] = local[1];
+        MPI_Iallreduce(sendbuf, global, 2, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD, &request);
+    }
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+
+    /* Print the result, including the round tossed while deciding to stop */
+    if (rank == MASTER) {
+        pi_estimate = estimate(global[0], global[1], &half_width);
+        printf("Pi is approximately %.16f +/- %.3e (95%%), Error is %.16f\n",
+               pi_estimate, half_width, fabs(pi_estimate - PI25DT));
+        printf("%lld tosses in %d rounds, %.3f s\n", global[1], round, MPI_Wtime() - start_time);
+        printf("Seed is %llu, toss kernel is %s\n", seed, isa);
+    }
+    /* Shut down MPI */
+    MPI_Finalize();
+    return 0;
+}/*  main  */
@@ -8,53 +8,68 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include "toss_kernel.h"
+
+#define BLOCK_LOW(id,p,n)   ((id)*(n)/(p))
+#define BLOCK_HIGH(id,p,n)  (BLOCK_LOW((id)+1,p,n)-1)
 
 /*------------------------------------------------------------------
  * Function:     toss_darts
  * Purpose:      toss darts randomly to find out the number in circles.
+ *               Each thread takes a contiguous block of tosses and
+ *               hands it to the SIMD toss kernel.
  * Input args:   total_tosses:  number of tosses
+ *               seed:  seed shared by all threads
+ *               toss:  toss kernel chosen at startup
  * Output args:  circles:  the total number of circles
  */
-long long toss_darts (long long total_tosses, long long* circles){
-	long long i, number_in_circle = 0;        
-	double x, y;
+void toss_darts (long long total_tosses, unsigned long long seed, toss_fn toss, long long* circles){
+	long long first, last, number_in_circle;
     int rank = omp_get_thread_num();
     int thread_count = omp_get_num_threads();
 
-	unsigned int seed = (unsigned) time(NULL);
-	srand(seed + rank);
-
-	for (i = rank; i <= total_tosses; i += thread_count) {
-	   x = rand_r(&seed)/(double)RAND_MAX;
-	   y = rand_r(&seed)/(double)RAND_MAX;
-	   if( (x*x+y*y) <= 1.0 ){
-           number_in_circle++;
-        }
-    }
+	first = BLOCK_LOW(rank, thread_count, total_tosses);
+	last = BLOCK_HIGH(rank, thread_count, total_tosses);
+	number_in_circle = toss(seed, first, last - first + 1);
 
     # pragma omp critical
     *circles += number_in_circle;
 }
 
 int main(int argc, char* argv[]){
-    int thread_count = strtol(argv[1], NULL, 10);
-    long long number_of_tosses, circles;
+    int thread_count;
+    long long number_of_tosses, circles = 0;
+    unsigned long long seed;
+    const char* isa;
+    toss_fn toss;
     double pi_estimate;
     double PI25DT = 3.141592653589793238462643;
 
    /* Get input from the command line */
-   if (argc != 3){
-        printf("usage: ./ open_mpi <thread_count> <number_of_tosses> \n");
+   if (argc != 3 && argc != 4){
+        printf("usage: ./ open_mpi <thread_count> <number_of_tosses> [seed] \n");
         exit(-1);
     } else {
-        number_of_tosses = atoi(argv[2]);
+        thread_count = strtol(argv[1], NULL, 10);
+        number_of_tosses = strtoll(argv[2], NULL, 10);
     }
+    if (thread_count < 1 || number_of_tosses < 1) {
+        printf("thread_count and number_of_tosses must be positive\n");
+        exit(-1);
+    }
+
+    /* Same seed for every thread; toss i always uses the same random numbers */
+    seed = (argc == 4) ? strtoull(argv[3], NULL, 10) : (unsigned long long) time(NULL);
+
+    /* Pick the widest SIMD toss kernel this CPU supports */
+    toss = toss_kernel_select(&isa);
 
     # pragma omp parallel num_threads(thread_count)
-    toss_darts(number_of_tosses, &circles);
+    toss_darts(number_of_tosses, seed, toss, &circles);
 
     /* Estimate PI using the formula*/
     pi_estimate = (4*circles)/((double) number_of_tosses);
 	printf("Pi is approximately %.16f, Error is %.16f\n", pi_estimate, fabs(pi_estimate - PI25DT));
+    printf("Seed is %llu, toss kernel is %s\n", seed, isa);
     return 0;
 }/*  main  */
\ No newline at end of file
@@ -0,0 +1,167 @@
+/* File:     philox.h
+ * Purpose:  Counter-based random number streams (Philox4x32-10) for the
+ *           Monte Carlo programs.  A stream is identified by a 64-bit
+ *           seed and a 64-bit stream id; the n-th block of a stream is
+ *           a pure function of (seed, stream id, n), so any rank or
+ *           thread can jump straight to its own part of the sequence
+ *           without generating what comes before it.
+ *
+ * Usage:    rng_stream_t s;
+ *           rng_init(&s, seed, stream_id);
+ *           rng_skip(&s, first_block);
+ *           rng_fill_uniform(&s, buf, count);
+ *
+ * Note:     One block is four 32-bit words, i.e. two doubles with 53
+ *           random bits each.  The Monte Carlo programs use stream 0
+ *           and give each toss a fixed position in it, so the estimate
+ *           for a given seed does not depend on how many ranks or
+ *           threads the tosses are split across.
+ *
+ * Reference: Salmon et al., "Parallel random numbers: as easy as
+ *           1, 2, 3", SC'11.
+ */
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>
+
+#define PHILOX_M0 0xD2511F53u      /* round multipliers */
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u      /* key schedule (Weyl) constants */
+#define PHILOX_W1 0xBB67AE85u
+#define RNG_DOUBLES_PER_BLOCK 2
+
+/* One Philox round followed by a key bump */
+#define PHILOX_ROUND(y0, y1, y2, y3, k0, k1, p0, p1) do { \
+   p0 = (uint64_t) PHILOX_M0 * (y0);                     \
+   p1 = (uint64_t) PHILOX_M1 * (y2);                     \
+   y0 = (uint32_t)((p1) >> 32) ^ (y1) ^ (k0);            \
+   y1 = (uint32_t)(p1);                                  \
+   y2 = (uint32_t)((p0) >> 32) ^ (y3) ^ (k1);            \
+   y3 = (uint32_t)(p0);                                  \
+   k0 += PHILOX_W0;                                      \
+   k1 += PHILOX_W1;                                      \
+} while (0)
+
+typedef struct {
+   uint32_t key[2];        /* from the seed */
+   uint32_t stream[2];     /* high half of the 128-bit counter */
+   uint64_t counter;       /* next block to be generated */
+} rng_stream_t;
+
+/*------------------------------------------------------------------
+ * Function:     philox4x32_10
+ * Purpose:      Ten Philox rounds applied in place to one counter
+ *               block
+ * Input args:   k0, k1:  key words
+ * In/out args:  x0..x3:  counter on input, random block on output
+ */
+static inline void philox4x32_10(uint32_t* x0, uint32_t* x1, uint32_t* x2,
+      uint32_t* x3, uint32_t k0, uint32_t k1) {
+   uint64_t p0, p1;
+   uint32_t y0 = *x0, y1 = *x1, y2 = *x2, y3 = *x3;
+
+   /* Unrolled by hand so that loops over blocks have no inner loop
+    * and can be vectorized */
+   PHILOX_ROUND(y0, y1, y2, y3, k0, k1, p0, p1);
+   PHILOX_ROUND(y0, y1, y2, y3, k0, k1, p0, p1);
+   PHILOX_ROUND(y0, y1, y2, y3, k0, k1, p0, p1);
+   PHILOX_ROUND(y0, y1, y2, y3, k0, k1, p0, p1);
+   PHILOX_ROUND(y0, y1, y2, y3, k0, k1, p0, p1);
+   PHILOX_ROUND(y0, y1, y2, y3, k0, k1, p0, p1);
+   PHILOX_ROUND(y0, y1, y2, y3, k0, k1, p0, p1);
+   PHILOX_ROUND(y0, y1, y2, y3, k0, k1, p0, p1);
+   PHILOX_ROUND(y0, y1, y2, y3, k0, k1, p0, p1);
+   PHILOX_ROUND(y0, y1, y2, y3, k0, k1, p0, p1);
+   *x0 = y0; *x1 = y1; *x2 = y2; *x3 = y3;
+}  /* philox4x32_10 */
+
+/*------------------------------------------------------------------
+ * Function:     rng_init
+ * Purpose:      Position a stream at its first block
+ * Input args:   seed:       run seed, shared by all ranks and threads
+ *               stream_id:  which of the 2^64 independent streams
+ * Output args:  s:  the stream
+ */
+static inline void rng_init(rng_stream_t* s, uint64_t seed,
+      uint64_t stream_id) {
+   s->key[0] = (uint32_t) seed;
+   s->key[1] = (uint32_t)(seed >> 32);
+   s->stream[0] = (uint32_t) stream_id;
+   s->stream[1] = (uint32_t)(stream_id >> 32);
+   s->counter = 0;
+}  /* rng_init */
+
+/*------------------------------------------------------------------
+ * Function:     rng_skip
+ * Purpose:      Jump a stream forward by nblocks blocks in O(1)
+ * In/out args:  s:  the stream
+ */
+static inline void rng_skip(rng_stream_t* s, uint64_t nblocks) {
+   s->counter += nblocks;
+}  /* rng_skip */
+
+/*------------------------------------------------------------------
+ * Function:     rng_block
+ * Purpose:      Generate the block at absolute position ctr of a
+ *               stream, leaving the stream untouched
+ * Output args:  out:  four random words
+ */
+static inline void rng_block(const rng_stream_t* s, uint64_t ctr,
+      uint32_t out[4]) {
+   uint32_t x0 = (uint32_t) ctr, x1 = (uint32_t)(ctr >> 32);
+   uint32_t x2 = s->stream[0], x3 = s->stream[1];
+
+   philox4x32_10(&x0, &x1, &x2, &x3, s->key[0], s->key[1]);
+   out[0] = x0; out[1] = x1; out[2] = x2; out[3] = x3;
+}  /* rng_block */
+
+/*------------------------------------------------------------------
+ * Function:     rng_to_double
+ * Purpose:      Map two random words to a double in [0, 1) with 53
+ *               random bits
+ */
+static inline double rng_to_double(uint32_t hi, uint32_t lo) {
+   /* 31 bits from hi and 22 from lo, both exact as signed ints, so the
+    * conversion vectorizes without 64-bit integer-to-double support */
+   return (double)(int32_t)(hi >> 1) * 0x1.0p-31
+        + (double)(int32_t)(lo >> 10) * 0x1.0p-53;
+}  /* rng_to_double */
+
+/*------------------------------------------------------------------
+ * Function:     rng_fill_uniform
+ * Purpose:      Fill out[0..n-1] with uniform doubles in [0, 1) and
+ *               advance the stream past the blocks used
+ * Input args:   n:  number of doubles; the stream advances by
+ *                   ceil(n/2) blocks
+ * In/out args:  s:  the stream
+ * Output args:  out
+ * Note:         Iterations are independent, so the compiler can
+ *               vectorize the block loop (gcc -O3 does).
+ */
+static inline void rng_fill_uniform(rng_stream_t* s, double* out,
+      long long n) {
+   long long i, nblocks = n / RNG_DOUBLES_PER_BLOCK;
+   uint64_t base = s->counter;
+   uint32_t k0 = s->key[0], k1 = s->key[1];
+   uint32_t s0 = s->stream[0], s1 = s->stream[1];
+   uint32_t x0, x1, x2, x3, last[4];
+
+   for (i = 0; i < nblocks; i++) {
+      x0 = (uint32_t)(base + i);
+      x1 = (uint32_t)((base + i) >> 32);
+      x2 = s0;
+      x3 = s1;
+      philox4x32_10(&x0, &x1, &x2, &x3, k0, k1);
+      out[2*i]     = rng_to_double(x0, x1);
+      out[2*i + 1] = rng_to_double(x2, x3);
+   }
+   if (n % RNG_DOUBLES_PER_BLOCK) {
+      rng_block(s, base + nblocks, last);
+      out[n - 1] = rng_to_double(last[0], last[1]);
+      nblocks++;
+   }
+   s->counter = base + nblocks;
+}  /* rng_fill_uniform */
+
+#endif /* PHILOX_H */
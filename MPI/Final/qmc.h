@@ -0,0 +1,150 @@
+/* File:     qmc.h
+ * Purpose:  Two-dimensional low-discrepancy (quasi-random) sequences
+ *           for the Monte Carlo programs: Sobol in Gray-code order and
+ *           Halton in bases 2 and 3, each with optional randomization.
+ *
+ * Usage:    qmc_seq_t q;
+ *           qmc_init(&q, QMC_SOBOL, first_index, scrambled, seed);
+ *           qmc_next(&q, &x, &y);      (repeat)
+ *
+ * Note:     Point i of either sequence can be computed directly from
+ *           i, so a rank that owns points first..last starts at first
+ *           without generating the points before it and no rank ever
+ *           talks to another.  The union of the segments is always the
+ *           first n points, whatever the number of processes.
+ *
+ *           Scrambling is a random digital shift (XOR) for Sobol and
+ *           a random Cranley-Patterson rotation (shift mod 1) for
+ *           Halton.  Both keep the low discrepancy of the point set
+ *           and make the estimate unbiased.  The shifts are drawn from
+ *           stream 1 of the Philox generator, so all ranks agree on
+ *           them.
+ */
+#ifndef QMC_H
+#define QMC_H
+
+#include <stdint.h>
+#include "philox.h"
+
+#define QMC_SOBOL  0
+#define QMC_HALTON 1
+#define QMC_BITS   64     /* bits per Sobol coordinate */
+#define QMC_DIGITS3 40    /* base-3 digits per Halton coordinate (3^40 < 2^64) */
+
+typedef struct {
+   int      kind;                  /* QMC_SOBOL or QMC_HALTON */
+   uint64_t index;                 /* index of the next point */
+   uint64_t v[2][QMC_BITS];        /* Sobol direction numbers */
+   uint64_t x[2];                  /* Sobol: current point as integers */
+   uint64_t digital_shift[2];      /* Sobol scrambling */
+   uint64_t h2, h3;                /* Halton: radical inverses of index,
+                                      scaled by 2^64 and 3^40 */
+   uint64_t pow3[QMC_DIGITS3];     /* 3^(39-k) */
+   unsigned char d3[QMC_DIGITS3];  /* base-3 digits of index */
+   double   rotation[2];           /* Halton scrambling */
+} qmc_seq_t;
+
+/*------------------------------------------------------------------
+ * Function:     qmc_init
+ * Purpose:      Position a sequence at point first
+ * Input args:   kind:       QMC_SOBOL or QMC_HALTON
+ *               first:      index of the first point to generate
+ *               scrambled:  nonzero to randomize the sequence
+ *               seed:       run seed, used only when scrambled
+ * Output args:  q:  the sequence
+ */
+static inline void qmc_init(qmc_seq_t* q, int kind, uint64_t first,
+      int scrambled, unsigned long long seed) {
+   rng_stream_t s;
+   uint32_t w[4];
+   uint64_t g, i;
+   int d, k;
+
+   q->kind = kind;
+   q->index = first;
+
+   /* Dimension 0 is the van der Corput sequence; dimension 1 uses the
+    * primitive polynomial x + 1, i.e. m_k = 1, 3, 5, 15, ... */
+   for (k = 0; k < QMC_BITS; k++) {
+      q->v[0][k] = 1ull << (QMC_BITS - 1 - k);
+      q->v[1][k] = (k == 0) ? 1ull << (QMC_BITS - 1)
+                            : q->v[1][k-1] ^ (q->v[1][k-1] >> 1);
+   }
+
+   q->digital_shift[0] = q->digital_shift[1] = 0;
+   q->rotation[0] = q->rotation[1] = 0.0;
+   if (scrambled) {
+      rng_init(&s, seed, 1);
+      rng_block(&s, 0, w);
+      q->digital_shift[0] = ((uint64_t) w[0] << 32) | w[1];
+      q->digital_shift[1] = ((uint64_t) w[2] << 32) | w[3];
+      q->rotation[0] = rng_to_double(w[0], w[1]);
+      q->rotation[1] = rng_to_double(w[2], w[3]);
+   }
+
+   /* Point i in Gray-code order is the XOR of the direction numbers
+    * selected by the bits of i ^ (i >> 1) */
+   g = first ^ (first >> 1);
+   for (d = 0; d < 2; d++) {
+      q->x[d] = 0;
+      for (k = 0; k < QMC_BITS; k++) {
+         if ((g >> k) & 1) q->x[d] ^= q->v[d][k];
+      }
+   }
+
+   /* Halton: keep the radical inverses as exact integers, base 2 by
+    * reversing the bits of first and base 3 from its digits */
+   q->h2 = 0;
+   for (k = 0; k < QMC_BITS; k++) {
+      if ((first >> k) & 1) q->h2 |= 1ull << (QMC_BITS - 1 - k);
+   }
+   q->h3 = 0;
+   i = first;
+   for (k = QMC_DIGITS3 - 1; k >= 0; k--) {
+      q->pow3[k] = (k == QMC_DIGITS3 - 1) ? 1 : 3 * q->pow3[k+1];
+   }
+   for (k = 0; k < QMC_DIGITS3; k++) {
+      q->d3[k] = (unsigned char)(i % 3);
+      q->h3 += q->d3[k] * q->pow3[k];
+      i /= 3;
+   }
+}  /* qmc_init */
+
+/*------------------------------------------------------------------
+ * Function:     qmc_next
+ * Purpose:      Return the next point of the sequence in [0, 1)^2
+ * In/out args:  q:  the sequence
+ * Output args:  x_p, y_p:  the point
+ */
+static inline void qmc_next(qmc_seq_t* q, double* x_p, double* y_p) {
+   double x, y;
+   int k;
+
+   if (q->kind == QMC_SOBOL) {
+      *x_p = (double)((q->x[0] ^ q->digital_shift[0]) >> 11) * 0x1.0p-53;
+      *y_p = (double)((q->x[1] ^ q->digital_shift[1]) >> 11) * 0x1.0p-53;
+      /* Going from i to i+1 flips one bit of the Gray code: the lowest
+       * zero bit of i */
+      q->x[0] ^= q->v[0][__builtin_ctzll(~q->index)];
+      q->x[1] ^= q->v[1][__builtin_ctzll(~q->index)];
+   } else {
+      x = (double)(q->h2 >> 11) * 0x1.0p-53 + q->rotation[0];
+      y = (double) q->h3 / ((double) q->pow3[0] * 3.0) + q->rotation[1];
+      *x_p = (x >= 1.0) ? x - 1.0 : x;
+      *y_p = (y >= 1.0) ? y - 1.0 : y;
+      /* Add one to index in both bases; the carries run from the
+       * most significant digit of the radical inverse down */
+      q->h2 ^= ~0ull << (QMC_BITS - 1 - __builtin_ctzll(~q->index));
+      for (k = 0; k < QMC_DIGITS3 && q->d3[k] == 2; k++) {
+         q->d3[k] = 0;
+         q->h3 -= 2 * q->pow3[k];
+      }
+      if (k < QMC_DIGITS3) {
+         q->d3[k]++;
+         q->h3 += q->pow3[k];
+      }
+   }
+   q->index++;
+}  /* qmc_next */
+
+#endif /* QMC_H */
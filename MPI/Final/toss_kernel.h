@@ -0,0 +1,171 @@
+/* File:     toss_kernel.h
+ * Purpose:  Vectorized dart-tossing kernel for the Monte Carlo pi
+ *           programs, with SSE2, AVX2 and AVX-512 builds of the same
+ *           loop and a run-time choice between them.
+ *
+ * Usage:    toss_fn toss = toss_kernel_select(&isa_name);
+ *           hits = toss(seed, first, count);
+ *
+ * Note:     The kernel fuses random number generation with the test.
+ *           Each lane runs Philox on its own counter and gets two
+ *           darts from the block: tosses 2b and 2b+1 use words (0, 1)
+ *           and (2, 3) of block b of stream 0.  A dart is a pair of
+ *           31-bit integer coordinates, and x*x+y*y <= 2^62 is
+ *           evaluated as the sign bit of a 64-bit subtraction, so the
+ *           loop has no branch and no integer-to-double conversion
+ *           and the hit count is a plain sum of 0s and 1s.  The result
+ *           depends only on (seed, first, count), so all variants
+ *           return the same count.
+ *
+ *           The variants are one C loop compiled with different gcc
+ *           target attributes rather than hand-written intrinsics;
+ *           build with -O3 so that the loop is vectorized.
+ */
+#ifndef TOSS_KERNEL_H
+#define TOSS_KERNEL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "philox.h"
+
+#define TOSS_CHUNK 4096   /* blocks per inner loop, so the counter can
+                             be carried in 32-bit lanes */
+
+/* 1 if the dart with 32-bit random coordinates a, b lands in the
+ * quarter circle, else 0 */
+#define TOSS_IN_CIRCLE(a, b)                                           \
+   (((uint64_t)((a) >> 1) * ((a) >> 1) + (uint64_t)((b) >> 1) * ((b) >> 1) \
+     - ((1ull << 62) + 1)) >> 63)
+
+typedef long long (*toss_fn)(unsigned long long seed, long long first,
+      long long count);
+
+/*------------------------------------------------------------------
+ * Function:     toss_one
+ * Purpose:      Scalar test of a single toss, for the ends of a range
+ *               that do not cover a whole block
+ * Input args:   s:  stream 0 of the run
+ *               t:  toss index
+ * Return val:   1 if toss t lands in the circle, else 0
+ */
+static inline long long toss_one(const rng_stream_t* s, long long t) {
+   uint32_t w[4];
+
+   rng_block(s, (uint64_t) t / 2, w);
+   return (t % 2) ? TOSS_IN_CIRCLE(w[2], w[3]) : TOSS_IN_CIRCLE(w[0], w[1]);
+}  /* toss_one */
+
+/* Loop shared by all variants: count the darts among tosses
+ * first..first+count-1 that land in the quarter circle */
+#define TOSS_KERNEL_BODY                                               \
+   rng_stream_t s;                                                     \
+   long long i, block, nblocks, hits = 0;                              \
+   uint64_t chunk_hits;                                                \
+   uint32_t j, n, lo, hi, x0, x1, x2, x3;                              \
+                                                                       \
+   rng_init(&s, seed, 0);                                              \
+   if (count > 0 && first % 2) {                                       \
+      hits += toss_one(&s, first);                                     \
+      first++;                                                         \
+      count--;                                                         \
+   }                                                                   \
+   if (count % 2) {                                                    \
+      hits += toss_one(&s, first + count - 1);                         \
+      count--;                                                         \
+   }                                                                   \
+   block = first / 2;                                                  \
+   nblocks = count / 2;                                                \
+   for (i = 0; i < nblocks; i += TOSS_CHUNK) {                         \
+      n = (uint32_t)((nblocks - i < TOSS_CHUNK) ? nblocks - i : TOSS_CHUNK); \
+      lo = (uint32_t)(uint64_t)(block + i);                            \
+      hi = (uint32_t)((uint64_t)(block + i) >> 32);                    \
+      chunk_hits = 0;                                                  \
+      for (j = 0; j < n; j++) {                                        \
+         /* 64-bit counter block+i+j kept as two 32-bit lanes */       \
+         x0 = lo + j;                                                  \
+         x1 = hi + (x0 < lo);                                          \
+         x2 = s.stream[0];                                             \
+         x3 = s.stream[1];                                             \
+         philox4x32_10(&x0, &x1, &x2, &x3, s.key[0], s.key[1]);        \
+         chunk_hits += TOSS_IN_CIRCLE(x0, x1) + TOSS_IN_CIRCLE(x2, x3); \
+      }                                                                \
+      hits += (long long) chunk_hits;                                  \
+   }                                                                   \
+   return hits;
+
+/*------------------------------------------------------------------
+ * Function:     toss_generic
+ * Purpose:      Kernel built for the compiler's default target
+ * Input args:   seed:   run seed
+ *               first:  index of the first toss
+ *               count:  number of tosses
+ * Return val:   number of darts inside the circle
+ */
+static long long toss_generic(unsigned long long seed, long long first,
+      long long count) {
+   TOSS_KERNEL_BODY
+}  /* toss_generic */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TOSS_HAVE_X86_VARIANTS
+
+__attribute__((target("sse2")))
+static long long toss_sse2(unsigned long long seed, long long first,
+      long long count) {
+   TOSS_KERNEL_BODY
+}  /* toss_sse2 */
+
+__attribute__((target("avx2")))
+static long long toss_avx2(unsigned long long seed, long long first,
+      long long count) {
+   TOSS_KERNEL_BODY
+}  /* toss_avx2 */
+
+__attribute__((target("avx512f,avx512dq,avx512vl")))
+static long long toss_avx512(unsigned long long seed, long long first,
+      long long count) {
+   TOSS_KERNEL_BODY
+}  /* toss_avx512 */
+#endif
+
+/*------------------------------------------------------------------
+ * Function:     toss_kernel_select
+ * Purpose:      Pick the widest kernel the CPU supports.  Setting the
+ *               environment variable TOSS_ISA to generic, sse2, avx2
+ *               or avx512 caps the choice, e.g. for benchmarking.
+ * Output args:  name:  name of the chosen variant (may be NULL)
+ * Return val:   the kernel
+ */
+static toss_fn toss_kernel_select(const char** name) {
+   toss_fn fn = toss_generic;
+   const char* chosen = "generic";
+#ifdef TOSS_HAVE_X86_VARIANTS
+   const char* cap = getenv("TOSS_ISA");
+   int level = 3;
+
+   if (cap != NULL) {
+      if (strcmp(cap, "generic") == 0) level = 0;
+      else if (strcmp(cap, "sse2") == 0) level = 1;
+      else if (strcmp(cap, "avx2") == 0) level = 2;
+   }
+
+   __builtin_cpu_init();
+   if (level >= 3 && __builtin_cpu_supports("avx512f")
+         && __builtin_cpu_supports("avx512dq")
+         && __builtin_cpu_supports("avx512vl")) {
+      fn = toss_avx512;
+      chosen = "avx512";
+   } else if (level >= 2 && __builtin_cpu_supports("avx2")) {
+      fn = toss_avx2;
+      chosen = "avx2";
+   } else if (level >= 1 && __builtin_cpu_supports("sse2")) {
+      fn = toss_sse2;
+      chosen = "sse2";
+   }
+#endif
+   if (name != NULL) *name = chosen;
+   return fn;
+}  /* toss_kernel_select */
+
+#endif /* TOSS_KERNEL_H */
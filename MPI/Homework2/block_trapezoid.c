@@ -1,8 +1,7 @@
 #include <stdio.h>
 #include <mpi.h>
-
-#define BLOCK_LOW(id,p,n)   ((id)*(n)/(p))
-#define BLOCK_HIGH(id,p,n)  (BLOCK_LOW((id)+1,p,n)-1)
+#include "../Trapezoidal_Rule/integrand.h"
+#include "../Trapezoidal_Rule/partition.h"
 
 // Get input
 void Get_input(int my_rank, int comm_sz, int* n_p) {
@@ -14,35 +13,58 @@ void Get_input(int my_rank, int comm_sz, int* n_p) {
    MPI_Bcast(n_p, 1, MPI_INT, 0, MPI_COMM_WORLD);
 }
 
-// Pi function
-double f(double x) {
-   return (4.0/(1.0 + x*x));
-}
-
-// Trapezoidal Rule
+// Trapezoidal Rule, evaluating f in batches (integrand.h; link with -lm -ldl)
 double Trap(
-      double left_endpt  /* in */, 
-      double right_endpt /* in */, 
-      int    trap_count  /* in */, 
-      double base_len    /* in */) {
-   double estimate, x;
-   int i;
-
-   estimate = (f(left_endpt) + f(right_endpt))/2.0;
-   for (i = 1; i <= trap_count-1; i++) {
-      x = left_endpt + i*base_len;
-      estimate += f(x);
-   }
+      const integrand_t* f  /* in */,
+      double left_endpt     /* in */,
+      double right_endpt    /* in */,
+      int    trap_count     /* in */,
+      double base_len       /* in */) {
+   double estimate, ends[2] = {left_endpt, right_endpt}, f_ends[2];
+
+   f->eval(2, ends, f_ends);
+   estimate = (f_ends[0] + f_ends[1])/2.0;
+   estimate += integrand_grid_sum(f, left_endpt, base_len, 1, trap_count-1, 1);
    estimate = estimate*base_len;
 
    return estimate;
 }
 
-int main(void) {
+// The trapezoids first, first + stride, ... of a run of partition.h,
+// trapezoid i being [i*h, (i+1)*h]
+double Trap_run(const integrand_t* f, const part_run_t* run, double h) {
+   if (run->count <= 0) return 0.0;
+   if (run->stride == 1)
+      return Trap(f, run->first*h, (run->first + run->count)*h, run->count, h);
+   return (integrand_grid_sum(f, 0.0, h, run->first, run->count, run->stride)
+         + integrand_grid_sum(f, 0.0, h, run->first + 1, run->count, run->stride))*h/2.0;
+}
+
+// What part_autotune times: trapezoids first .. first+count-1
+typedef struct {
+   const integrand_t* f;
+   double h;
+} probe_t;
+
+double Probe(long first, long count, void* ctx) {
+   probe_t* probe = ctx;
+   part_run_t run = {first, count, 1};
+
+   return Trap_run(probe->f, &run, probe->h);
+}
 
-    int my_rank, comm_sz, n, local_n;   
+int main(int argc, char* argv[]) {
+
+    int my_rank, comm_sz, n;   
     double h;
-    double local_a, local_b, local_int, total_int;
+    double local_int, total_int;
+    integrand_t f;      /* first argument, default pi */
+    const char* layout = argc > 2 ? argv[2] : "block";   /* second argument */
+    part_kind_t kind;
+    long chunk, k;
+    partition_t part;
+    part_run_t run;
+    probe_t probe;
 
     /* Let the system do what it needs to start up MPI */
     MPI_Init(NULL, NULL);
@@ -51,14 +73,35 @@ int main(void) {
     /* Find out how many processes are being used */
     MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
 
+    if (integrand_lookup(argc > 1 ? argv[1] : "pi", &f, my_rank == 0 ? stderr : NULL) != 0) {
+        if (my_rank == 0) integrand_list(stderr);
+        MPI_Finalize();
+        return 1;
+    }
+    if (part_parse(layout, &kind, &chunk) != 0) {
+        if (my_rank == 0) fprintf(stderr, "unknown layout %s: block, cyclic, block-cyclic[,chunk] or auto\n", layout);
+        MPI_Finalize();
+        return 1;
+    }
+
     Get_input(my_rank, comm_sz, &n);
 
     h = (double) 1/n;
 
-    local_a = BLOCK_LOW(my_rank, comm_sz, n);
-    local_b = BLOCK_HIGH(my_rank, comm_sz, n);
-
-    local_int = Trap(local_a, local_b, n, h);
+    /* Trapezoids BLOCK_LOW <= i < BLOCK_LOW of the next rank, from
+     * x = i*h, or the runs of the layout given */
+    part_init(&part, kind, n, comm_sz, chunk);
+    if (kind == PART_AUTO) {
+        probe.f = &f;
+        probe.h = h;
+        part_autotune(&part, n, Probe, &probe, MPI_COMM_WORLD);
+    }
+    local_int = 0.0;
+    for (k = 0; k < part_runs(&part, my_rank); k++) {
+        part_run(&part, my_rank, k, &run);
+        local_int += Trap_run(&f, &run, h);
+    }
+    part_free(&part);
 
     /* Add up the integrals calculated by each process */
     MPI_Reduce(&local_int, &total_int, 1, MPI_DOUBLE, MPI_SUM, 0,
@@ -66,7 +109,8 @@ int main(void) {
 
     /* Print the result */
     if (my_rank == 0) {
-        printf("With n = %d trapezoids, The estimate of the integral from 0 to 1 = %.15e\n", n, total_int);
+        printf("With n = %d trapezoids (%s), The estimate of the integral of %s from 0 to 1 = %.15e\n",
+               n, part_kind_name[kind], f.formula, total_int);
     }
 
     /* Shut down MPI */
@@ -1,31 +1,56 @@
 /***********************************************************
 * Program: Pi Calculation
 * Using the Rectangular Rule
-* Using cyclic partitioning 
+* Integrand chosen by name as the first argument (default pi,
+* see ../Trapezoidal_Rule/integrand.h); link with -lm -ldl
+* Using cyclic partitioning of chunks of bins (block-cyclic of
+* ../Trapezoidal_Rule/partition.h), so each rank evaluates runs of
+* contiguous bins; the second argument chooses another layout:
+* cyclic (bin i to rank i % nprocs), block-cyclic,chunk, block
+* or auto (blocks sized by measured speed)
 * 
 *************************************************************/
 
 #include "mpi.h"
 #include <math.h>
 #include <stdio.h>
+#include "../Trapezoidal_Rule/integrand.h"
+#include "../Trapezoidal_Rule/partition.h"
 
 #define MAX_NAME 80   /* length of characters for naming a process */
 #define MASTER 0      /* rank of the master */
 
+/* What part_autotune times: the rectangles first .. first+count-1 */
+typedef struct {
+    const integrand_t* f;
+    double step;
+} probe_t;
+
+double Probe(long first, long count, void* ctx) {
+    probe_t* probe = ctx;
+
+    return integrand_grid_sum(probe->f, 0.0, probe->step, first + 0.5, count, 1);
+}
+
 int main(int argc, char *argv[]) {
 
     int rank,                                           /* rank variable to identify the process */
         nprocs,                                         /* number of processes */
-        i,
         len;                                            /* variable for storing name of processes */
 
     int n = 10000;                                      /* the number of bins */
-    double PI25DT = 3.141592653589793238462643;         /* 25-digit-PI*/
-    double mypi,                                        /* value from each process */
+    double exact,                                       /* integral from 0 to 1, if known */
+           mypi,                                        /* value from each process */
            pi,                                          /* value of PI in total*/
            step,                                        /* the step */
-           sum,                                         /* sum of area under the curve */
-           x;
+           sum;                                         /* sum of area under the curve */
+    integrand_t f;                                      /* function we're integrating */
+    const char* layout = argc > 2 ? argv[2] : "block-cyclic";   /* how the bins are divided */
+    part_kind_t kind;
+    long chunk, k;
+    partition_t part;
+    part_run_t run;
+    probe_t probe;
 
     char name[MAX_NAME];        /* char array for storing the name of each process */
 
@@ -41,8 +66,21 @@ int main(int argc, char *argv[]) {
     printf("Number of the processes = %d, ProcessID = %d\n", nprocs, rank);
     // end TO DO
 
+    if (integrand_lookup(argc > 1 ? argv[1] : "pi", &f, rank == MASTER ? stderr : NULL) != 0) {
+        if (rank == MASTER) integrand_list(stderr);
+        MPI_Finalize();
+        return 1;
+    }
+    if (part_parse(layout, &kind, &chunk) != 0) {
+        if (rank == MASTER) fprintf(stderr, "unknown layout %s: block, cyclic, block-cyclic[,chunk] or auto\n", layout);
+        MPI_Finalize();
+        return 1;
+    }
+
     MPI_Get_processor_name(name, &len);
 
+    /* Start together, so the time is the slowest rank's work */
+    MPI_Barrier(MPI_COMM_WORLD);
     start_time = MPI_Wtime();
 
     /* Broadcast the number of bins to all processes */
@@ -55,25 +93,40 @@ int main(int argc, char *argv[]) {
 
     /* Calculating for each process */
     step = 1.0 / (double) n;
+    part_init(&part, kind, n, nprocs, chunk);
+    if (kind == PART_AUTO) {
+        probe.f = &f;
+        probe.step = step;
+        part_autotune(&part, n, Probe, &probe, MPI_COMM_WORLD);
+    }
     sum = 0.0;
-    for (i = rank; i < n; i += nprocs) {
-        x = step * ((double)i + 0.5);
-        sum += (4.0/(1.0 + x*x));
+    for (k = 0; k < part_runs(&part, rank); k++) {
+        part_run(&part, rank, k, &run);
+        sum += integrand_grid_sum(&f, 0.0, step, run.first + 0.5, run.count, run.stride);
     }
 
     mypi = step * sum;
 
-    printf("This is my sum: %.16f from rank: %d name: %s\n", mypi, rank, name);
-
     /* Now we can reduce all those sums to one value which is Pi */
     // TO DO
     MPI_Reduce(&mypi, &pi, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
     // end TO DO
 
+    /* Stop the clock before printing anything */
+    end_time = MPI_Wtime();
+    computation_time = end_time - start_time;
+
+    printf("This is my sum: %.16f from rank: %d name: %s (%ld bins, %s)\n", mypi, rank, name,
+           part_count(&part, rank), part_kind_name[kind]);
+    part_free(&part);
+
     if (rank == 0) {
-        printf("Pi is approximately %.16f, Error is %.16f\n", pi, fabs(pi - PI25DT));
-        end_time = MPI_Wtime();
-        computation_time = end_time - start_time;
+        if (f.antiderivative != NULL) {
+            exact = f.antiderivative(1.0) - f.antiderivative(0.0);
+            printf("Integral of %s is approximately %.16f, Error is %.16f\n", f.formula, pi, fabs(pi - exact));
+        } else {
+            printf("Integral of %s is approximately %.16f\n", f.formula, pi);
+        }
         printf("Time of calculating PI is: %f\n", computation_time);
     }
     /* Terminate MPI execution environment */
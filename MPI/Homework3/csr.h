@@ -0,0 +1,574 @@
+/* File:     csr.h
+ * Purpose:  Distributed sparse matrices in CSR form: a parallel Matrix
+ *           Market reader, nnz-balanced row partitioning and y = A*x
+ *           with a halo exchange of only the entries of x each process
+ *           actually uses.
+ *
+ * Usage:    dist_csr_t A;
+ *           if (csr_read_mtx(comm, "A.mtx", &A) != 0) ...
+ *           csr_spmv(&A, x, y);    x: A.ncols_local entries starting at
+ *                                     global column A.first_col,
+ *                                  y: A.nrows entries starting at
+ *                                     global row A.first_row
+ *           csr_free(&A);
+ *
+ * Layout:   Process q owns rows row_start[q] .. row_start[q+1]-1 and the
+ *           same slice of x and y when A is square (equal blocks of x
+ *           otherwise).  Its rows are stored as two CSR matrices: diag,
+ *           whose columns index its own part of x, and offd, whose
+ *           columns index the ghost entries it receives from other
+ *           processes.  csr_spmv starts the halo exchange, multiplies
+ *           diag while the messages are in flight, then adds offd.
+ */
+#ifndef CSR_H
+#define CSR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include "mpi.h"
+
+#define CSR_BLOCK_LOW(id,p,n)  ((long)(id)*(n)/(p))
+#define MTX_MAX_LINE  1024       /* longest data line of a .mtx file */
+#define MTX_READ_MAX  (1L << 30) /* bytes per MPI_File_read_at */
+#define TAG_HALO      21
+
+typedef struct {
+   long i, j;     /* 0-based global row and column */
+   double v;
+} csr_entry_t;
+
+typedef struct {
+   int*    ptr;   /* row i is ptr[i] .. ptr[i+1]-1 */
+   int*    col;
+   double* val;
+} csr_part_t;
+
+typedef struct {
+   MPI_Comm comm;
+   long     nrows_global, ncols_global, nnz_global;
+   long*    row_start;     /* [nprocs+1] first row of each process */
+   long*    col_start;     /* [nprocs+1] first entry of x of each process */
+   long     first_row, first_col;
+   int      nrows, ncols_local, nnz;
+   csr_part_t diag, offd;
+
+   /* Halo: ghost k is global column ghost_col[k]; the ghosts from
+    * process recv_proc[r] are recv_ptr[r] .. recv_ptr[r+1]-1, and
+    * send_idx[send_ptr[s] .. send_ptr[s+1]-1] are the entries of my x
+    * that process send_proc[s] needs */
+   int      nghost, nrecv, nsend;
+   long*    ghost_col;
+   int     *recv_proc, *recv_ptr, *send_proc, *send_ptr, *send_idx;
+   double  *ghost, *send_buf;
+   MPI_Request* req;
+} dist_csr_t;
+
+/*------------------------------------------------------------------
+ * Function:     csr_owner
+ * Purpose:      Find the process whose range in start[] holds index
+ */
+static int csr_owner(const long* start, int nprocs, long index) {
+   int lo = 0, hi = nprocs - 1, mid;
+
+   while (lo < hi) {
+      mid = (lo + hi + 1) / 2;
+      if (start[mid] <= index) lo = mid;
+      else hi = mid - 1;
+   }
+   return lo;
+}  /* csr_owner */
+
+static int csr_entry_cmp(const void* a, const void* b) {
+   const csr_entry_t *x = a, *y = b;
+
+   if (x->i != y->i) return (x->i < y->i) ? -1 : 1;
+   if (x->j != y->j) return (x->j < y->j) ? -1 : 1;
+   return 0;
+}  /* csr_entry_cmp */
+
+static int csr_long_cmp(const void* a, const void* b) {
+   long x = *(const long*) a, y = *(const long*) b;
+
+   return (x < y) ? -1 : (x > y);
+}  /* csr_long_cmp */
+
+/*------------------------------------------------------------------
+ * Function:     csr_entry_type
+ * Purpose:      Build a derived datatype for csr_entry_t so entries
+ *               can be sent in a single message
+ */
+static void csr_entry_type(MPI_Datatype* entry_t_p) {
+   int blocklengths[3] = {1, 1, 1};
+   MPI_Datatype types[3] = {MPI_LONG, MPI_LONG, MPI_DOUBLE};
+   MPI_Aint displacements[3] = {offsetof(csr_entry_t, i),
+      offsetof(csr_entry_t, j), offsetof(csr_entry_t, v)};
+   MPI_Datatype tmp;
+
+   MPI_Type_create_struct(3, blocklengths, displacements, types, &tmp);
+   MPI_Type_create_resized(tmp, 0, sizeof(csr_entry_t), entry_t_p);
+   MPI_Type_free(&tmp);
+   MPI_Type_commit(entry_t_p);
+}  /* csr_entry_type */
+
+/*------------------------------------------------------------------
+ * Function:     mtx_read_header
+ * Purpose:      Read the banner and size line of a Matrix Market file
+ * Output args:  info[0..6] = rows, cols, entries, offset of the first
+ *               data byte, file size, pattern (1 if no values),
+ *               symmetry (0 general, 1 symmetric, -1 skew-symmetric)
+ * Return val:   0, or -1 with a message on stderr
+ */
+static int mtx_read_header(const char* path, long info[7]) {
+   char line[MTX_MAX_LINE], object[64], format[64], field[64], symm[64];
+   FILE* fp = fopen(path, "r");
+
+   if (fp == NULL) {
+      fprintf(stderr, "cannot open %s\n", path);
+      return -1;
+   }
+   if (fgets(line, sizeof(line), fp) == NULL
+         || sscanf(line, "%%%%MatrixMarket %63s %63s %63s %63s", object, format, field, symm) != 4
+         || strcasecmp(object, "matrix") != 0 || strcasecmp(format, "coordinate") != 0) {
+      fprintf(stderr, "%s: not a Matrix Market coordinate matrix\n", path);
+      fclose(fp);
+      return -1;
+   }
+   if (strcasecmp(field, "complex") == 0 || strcasecmp(symm, "hermitian") == 0) {
+      fprintf(stderr, "%s: complex matrices are not supported\n", path);
+      fclose(fp);
+      return -1;
+   }
+   info[5] = (strcasecmp(field, "pattern") == 0);
+   info[6] = (strcasecmp(symm, "symmetric") == 0) ? 1
+           : (strcasecmp(symm, "skew-symmetric") == 0) ? -1 : 0;
+
+   do {
+      if (fgets(line, sizeof(line), fp) == NULL) {
+         fprintf(stderr, "%s: no size line\n", path);
+         fclose(fp);
+         return -1;
+      }
+   } while (line[0] == '%');
+   if (sscanf(line, "%ld %ld %ld", &info[0], &info[1], &info[2]) != 3) {
+      fprintf(stderr, "%s: bad size line\n", path);
+      fclose(fp);
+      return -1;
+   }
+   info[3] = ftell(fp);
+   fseek(fp, 0, SEEK_END);
+   info[4] = ftell(fp);
+   fclose(fp);
+   return 0;
+}  /* mtx_read_header */
+
+/*------------------------------------------------------------------
+ * Function:     mtx_read_entries
+ * Purpose:      Read this process' share of the data lines: every line
+ *               that starts in its byte range of the file.  Symmetric
+ *               entries off the diagonal are mirrored.
+ * Output args:  entries_p, count_p:  the entries read (0-based)
+ * Return val:   0, or -1 with a message on stderr
+ */
+static int mtx_read_entries(MPI_Comm comm, const char* path, const long info[7],
+      csr_entry_t** entries_p, long* count_p) {
+   MPI_File fh;
+   int rank, nprocs, piece;
+   long lo, hi, from, to, got, pos, cap, n = 0, i, j;
+   double v;
+   char *buf, *p, *end;
+   csr_entry_t* e;
+
+   MPI_Comm_rank(comm, &rank);
+   MPI_Comm_size(comm, &nprocs);
+   lo = info[3] + CSR_BLOCK_LOW(rank, nprocs, info[4] - info[3]);
+   hi = info[3] + CSR_BLOCK_LOW(rank + 1, nprocs, info[4] - info[3]);
+
+   /* One byte before my range tells whether a line starts at lo, and
+    * the line that starts last in my range may run past hi */
+   from = (lo > info[3]) ? lo - 1 : lo;
+   to = (hi + MTX_MAX_LINE < info[4]) ? hi + MTX_MAX_LINE : info[4];
+   buf = malloc(to - from + 1);
+   if (MPI_File_open(comm, (char*) path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+      fprintf(stderr, "cannot open %s\n", path);
+      free(buf);
+      return -1;
+   }
+   for (got = 0; got < to - from; got += piece) {
+      piece = (int)((to - from - got < MTX_READ_MAX) ? to - from - got : MTX_READ_MAX);
+      MPI_File_read_at(fh, from + got, buf + got, piece, MPI_CHAR, MPI_STATUS_IGNORE);
+   }
+   MPI_File_close(&fh);
+   buf[to - from] = '\0';
+
+   pos = lo;
+   if (lo > info[3] && buf[0] != '\n') {
+      p = strchr(buf + 1, '\n');
+      pos = (p == NULL) ? to : from + (p - buf) + 1;
+   }
+
+   cap = 1024;
+   e = malloc(cap * sizeof(csr_entry_t));
+   while (pos < hi) {
+      p = buf + (pos - from);
+      end = strchr(p, '\n');
+      if (end == NULL && to < info[4]) {
+         fprintf(stderr, "%s: line at byte %ld longer than %d characters\n", path, pos, MTX_MAX_LINE);
+         free(buf);
+         free(e);
+         return -1;
+      }
+      pos = (end == NULL) ? to : from + (end - buf) + 1;
+
+      while (*p == ' ' || *p == '\t') p++;
+      if (*p == '%' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+      i = strtol(p, &p, 10) - 1;
+      j = strtol(p, &p, 10) - 1;
+      v = info[5] ? 1.0 : strtod(p, NULL);
+      if (i < 0 || i >= info[0] || j < 0 || j >= info[1]) {
+         fprintf(stderr, "%s: entry (%ld, %ld) out of range\n", path, i + 1, j + 1);
+         free(buf);
+         free(e);
+         return -1;
+      }
+
+      if (n + 2 > cap) {
+         cap *= 2;
+         e = realloc(e, cap * sizeof(csr_entry_t));
+      }
+      e[n].i = i; e[n].j = j; e[n].v = v; n++;
+      if (info[6] != 0 && i != j) {
+         e[n].i = j; e[n].j = i; e[n].v = info[6] * v; n++;
+      }
+   }
+   free(buf);
+   *entries_p = e;
+   *count_p = n;
+   return 0;
+}  /* mtx_read_entries */
+
+/*------------------------------------------------------------------
+ * Function:     csr_partition_rows
+ * Purpose:      Split the rows so every process gets about the same
+ *               nnz + rows: the work of a row is its entries plus the
+ *               write of y, and this keeps empty rows from piling up
+ * Input args:   row_nnz:  entries in each of my rows first ..
+ *                         first+nlocal-1 (every process holds a
+ *                         contiguous range of whole rows)
+ * Output args:  row_start:  [nprocs+1] first row of each process, the
+ *                           same on all processes
+ * Note:         Only the per-process totals are exchanged: row i goes
+ *               to the process whose share its middle falls in, so
+ *               row_start[q] is the first row whose middle is past
+ *               share q's start.  Each process proposes the first such
+ *               row of its range and the smallest proposal wins.
+ */
+static void csr_partition_rows(MPI_Comm comm, const long* row_nnz, long first, long nlocal,
+      long nrows, long* row_start) {
+   long mine = 0, below = 0, total, sum, i;
+   int nprocs, rank, q;
+
+   MPI_Comm_size(comm, &nprocs);
+   MPI_Comm_rank(comm, &rank);
+   for (i = 0; i < nlocal; i++) mine += row_nnz[i] + 1;
+   MPI_Exscan(&mine, &below, 1, MPI_LONG, MPI_SUM, comm);
+   if (rank == 0) below = 0;
+   MPI_Allreduce(&mine, &total, 1, MPI_LONG, MPI_SUM, comm);
+
+   for (q = 0; q <= nprocs; q++) row_start[q] = nrows;
+   row_start[0] = 0;
+   sum = below;
+   q = 1;
+   for (i = 0; i < nlocal && q < nprocs; i++) {
+      while (q < nprocs && 2 * sum + row_nnz[i] + 1 > 2 * CSR_BLOCK_LOW(q, nprocs, total))
+         row_start[q++] = first + i;
+      sum += row_nnz[i] + 1;
+   }
+   MPI_Allreduce(MPI_IN_PLACE, row_start, nprocs + 1, MPI_LONG, MPI_MIN, comm);
+}  /* csr_partition_rows */
+
+/*------------------------------------------------------------------
+ * Function:     csr_redistribute
+ * Purpose:      Send every entry to the process that owns its row in
+ *               row_start[]
+ * In/out args:  entries_p, count_p:  my entries (the old array is freed)
+ */
+static void csr_redistribute(MPI_Comm comm, const long* row_start,
+      csr_entry_t** entries_p, long* count_p) {
+   int nprocs, q;
+   int *scount, *sdispl, *rcount, *rdispl;
+   long n, t, count = *count_p;
+   csr_entry_t *entries = *entries_p, *sorted, *mine;
+   MPI_Datatype entry_t;
+
+   MPI_Comm_size(comm, &nprocs);
+   scount = calloc(nprocs, sizeof(int));
+   sdispl = malloc(nprocs * sizeof(int));
+   rcount = malloc(nprocs * sizeof(int));
+   rdispl = malloc(nprocs * sizeof(int));
+   for (t = 0; t < count; t++) scount[csr_owner(row_start, nprocs, entries[t].i)]++;
+   for (q = 0; q < nprocs; q++) sdispl[q] = (q == 0) ? 0 : sdispl[q-1] + scount[q-1];
+   sorted = malloc((count + 1) * sizeof(csr_entry_t));
+   for (t = 0; t < count; t++) {
+      q = csr_owner(row_start, nprocs, entries[t].i);
+      sorted[sdispl[q]++] = entries[t];
+   }
+   free(entries);
+   for (q = 0; q < nprocs; q++) sdispl[q] -= scount[q];
+
+   MPI_Alltoall(scount, 1, MPI_INT, rcount, 1, MPI_INT, comm);
+   for (q = 0; q < nprocs; q++) rdispl[q] = (q == 0) ? 0 : rdispl[q-1] + rcount[q-1];
+   n = rdispl[nprocs-1] + rcount[nprocs-1];
+   mine = malloc((n + 1) * sizeof(csr_entry_t));
+   csr_entry_type(&entry_t);
+   MPI_Alltoallv(sorted, scount, sdispl, entry_t, mine, rcount, rdispl, entry_t, comm);
+   MPI_Type_free(&entry_t);
+   free(sorted);
+   free(scount);
+   free(sdispl);
+   free(rcount);
+   free(rdispl);
+   *entries_p = mine;
+   *count_p = n;
+}  /* csr_redistribute */
+
+/*------------------------------------------------------------------
+ * Function:     csr_setup
+ * Purpose:      Build a distributed matrix from entries held anywhere:
+ *               partition the rows, send every entry to the owner of
+ *               its row, split the local rows into diag and offd and
+ *               work out the halo exchange
+ * Input args:   comm, nrows, ncols:  communicator and global size
+ *               entries, count:      this process' entries (freed)
+ * Output args:  A
+ * Note:         The entries go to equal blocks of rows first, so each
+ *               process can count the nnz of its rows; nothing of size
+ *               nrows is kept on any process.
+ */
+static void csr_setup(MPI_Comm comm, long nrows, long ncols,
+      csr_entry_t* entries, long count, dist_csr_t* A) {
+   int nprocs, q, k, r, s;
+   int *scount, *sdispl, *rcount, *rdispl;
+   long n, t, lastcol, first, nlocal, *row_nnz, *want;
+   csr_entry_t *mine;
+
+   MPI_Comm_size(comm, &nprocs);
+   MPI_Comm_rank(comm, &r);
+   memset(A, 0, sizeof(*A));
+   A->comm = comm;
+   A->nrows_global = nrows;
+   A->ncols_global = ncols;
+   A->row_start = malloc((nprocs + 1) * sizeof(long));
+   A->col_start = malloc((nprocs + 1) * sizeof(long));
+
+   /* nnz of the rows of an equal block of rows */
+   for (q = 0; q <= nprocs; q++) A->row_start[q] = CSR_BLOCK_LOW(q, nprocs, nrows);
+   csr_redistribute(comm, A->row_start, &entries, &count);
+   first = A->row_start[r];
+   nlocal = A->row_start[r+1] - first;
+   row_nnz = calloc(nlocal + 1, sizeof(long));
+   for (t = 0; t < count; t++) row_nnz[entries[t].i - first]++;
+
+   csr_partition_rows(comm, row_nnz, first, nlocal, nrows, A->row_start);
+   for (q = 0; q <= nprocs; q++)
+      A->col_start[q] = (nrows == ncols) ? A->row_start[q] : CSR_BLOCK_LOW(q, nprocs, ncols);
+   free(row_nnz);
+
+   /* Send every entry to the owner of its row */
+   csr_redistribute(comm, A->row_start, &entries, &count);
+   mine = entries;
+   n = count;
+   qsort(mine, n, sizeof(csr_entry_t), csr_entry_cmp);
+
+   A->first_row = A->row_start[r];
+   A->first_col = A->col_start[r];
+   A->nrows = (int)(A->row_start[r+1] - A->row_start[r]);
+   A->ncols_local = (int)(A->col_start[r+1] - A->col_start[r]);
+   A->nnz = (int) n;
+   t = n;
+   MPI_Allreduce(&t, &A->nnz_global, 1, MPI_LONG, MPI_SUM, comm);
+
+   /* Ghost columns: the columns I use that are not in my part of x,
+    * sorted, so the ones owned by each process are contiguous */
+   A->ghost_col = malloc((n + 1) * sizeof(long));
+   for (t = 0; t < n; t++) {
+      if (mine[t].j < A->first_col || mine[t].j >= A->first_col + A->ncols_local)
+         A->ghost_col[A->nghost++] = mine[t].j;
+   }
+   qsort(A->ghost_col, A->nghost, sizeof(long), csr_long_cmp);
+   for (t = 0, k = 0, lastcol = -1; t < A->nghost; t++) {
+      if (A->ghost_col[t] != lastcol) lastcol = A->ghost_col[k++] = A->ghost_col[t];
+   }
+   A->nghost = k;
+
+   /* diag and offd parts of my rows */
+   A->diag.ptr = calloc(A->nrows + 1, sizeof(int));
+   A->offd.ptr = calloc(A->nrows + 1, sizeof(int));
+   for (t = 0; t < n; t++) {
+      if (mine[t].j >= A->first_col && mine[t].j < A->first_col + A->ncols_local)
+         A->diag.ptr[mine[t].i - A->first_row + 1]++;
+      else
+         A->offd.ptr[mine[t].i - A->first_row + 1]++;
+   }
+   for (k = 0; k < A->nrows; k++) {
+      A->diag.ptr[k+1] += A->diag.ptr[k];
+      A->offd.ptr[k+1] += A->offd.ptr[k];
+   }
+   A->diag.col = malloc((A->diag.ptr[A->nrows] + 1) * sizeof(int));
+   A->diag.val = malloc((A->diag.ptr[A->nrows] + 1) * sizeof(double));
+   A->offd.col = malloc((A->offd.ptr[A->nrows] + 1) * sizeof(int));
+   A->offd.val = malloc((A->offd.ptr[A->nrows] + 1) * sizeof(double));
+   for (t = 0, k = 0, s = 0; t < n; t++) {
+      if (mine[t].j >= A->first_col && mine[t].j < A->first_col + A->ncols_local) {
+         A->diag.col[k] = (int)(mine[t].j - A->first_col);
+         A->diag.val[k++] = mine[t].v;
+      } else {
+         A->offd.col[s] = (int)((long*) bsearch(&mine[t].j, A->ghost_col, A->nghost,
+               sizeof(long), csr_long_cmp) - A->ghost_col);
+         A->offd.val[s++] = mine[t].v;
+      }
+   }
+   free(mine);
+
+   /* Tell each owner which of its entries of x I need */
+   scount = malloc(nprocs * sizeof(int));
+   sdispl = malloc(nprocs * sizeof(int));
+   rcount = calloc(nprocs, sizeof(int));
+   rdispl = malloc(nprocs * sizeof(int));
+   for (t = 0; t < A->nghost; t++) rcount[csr_owner(A->col_start, nprocs, A->ghost_col[t])]++;
+   MPI_Alltoall(rcount, 1, MPI_INT, scount, 1, MPI_INT, comm);
+   for (q = 0; q < nprocs; q++) {
+      rdispl[q] = (q == 0) ? 0 : rdispl[q-1] + rcount[q-1];
+      sdispl[q] = (q == 0) ? 0 : sdispl[q-1] + scount[q-1];
+   }
+   n = sdispl[nprocs-1] + scount[nprocs-1];
+   want = malloc((n + 1) * sizeof(long));
+   MPI_Alltoallv(A->ghost_col, rcount, rdispl, MPI_LONG, want, scount, sdispl, MPI_LONG, comm);
+
+   /* Keep only the processes I actually talk to */
+   A->recv_proc = malloc(nprocs * sizeof(int));
+   A->recv_ptr = malloc((nprocs + 1) * sizeof(int));
+   A->send_proc = malloc(nprocs * sizeof(int));
+   A->send_ptr = malloc((nprocs + 1) * sizeof(int));
+   A->send_idx = malloc((n + 1) * sizeof(int));
+   A->recv_ptr[0] = A->send_ptr[0] = 0;
+   for (q = 0; q < nprocs; q++) {
+      if (rcount[q] > 0) {
+         A->recv_proc[A->nrecv] = q;
+         A->recv_ptr[A->nrecv + 1] = rdispl[q] + rcount[q];
+         A->nrecv++;
+      }
+      if (scount[q] > 0) {
+         A->send_proc[A->nsend] = q;
+         A->send_ptr[A->nsend + 1] = sdispl[q] + scount[q];
+         A->nsend++;
+      }
+   }
+   for (t = 0; t < n; t++) A->send_idx[t] = (int)(want[t] - A->first_col);
+   free(want);
+
+   A->ghost = malloc((A->nghost + 1) * sizeof(double));
+   A->send_buf = malloc((n + 1) * sizeof(double));
+   A->req = malloc((A->nrecv + A->nsend + 1) * sizeof(MPI_Request));
+
+   /* The exchange is the same every product: set it up once as
+    * persistent requests */
+   for (r = 0; r < A->nrecv; r++)
+      MPI_Recv_init(A->ghost + A->recv_ptr[r], A->recv_ptr[r+1] - A->recv_ptr[r], MPI_DOUBLE,
+            A->recv_proc[r], TAG_HALO, comm, &A->req[r]);
+   for (s = 0; s < A->nsend; s++)
+      MPI_Send_init(A->send_buf + A->send_ptr[s], A->send_ptr[s+1] - A->send_ptr[s], MPI_DOUBLE,
+            A->send_proc[s], TAG_HALO, comm, &A->req[A->nrecv + s]);
+   free(scount);
+   free(sdispl);
+   free(rcount);
+   free(rdispl);
+}  /* csr_setup */
+
+/*------------------------------------------------------------------
+ * Function:     csr_read_mtx
+ * Purpose:      Read a Matrix Market file in parallel: every process
+ *               reads and parses its own byte range of the file with
+ *               MPI-IO, then the entries go to their owners
+ * Return val:   0, or -1 on every process if the file is unusable
+ */
+static int csr_read_mtx(MPI_Comm comm, const char* path, dist_csr_t* A) {
+   long info[7];
+   int rank, ok, all_ok;
+   long count = 0;
+   csr_entry_t* entries = NULL;
+
+   MPI_Comm_rank(comm, &rank);
+   if (rank == 0 && mtx_read_header(path, info) != 0) info[0] = -1;
+   MPI_Bcast(info, 7, MPI_LONG, 0, comm);
+   if (info[0] < 0) return -1;
+
+   ok = (mtx_read_entries(comm, path, info, &entries, &count) == 0);
+   MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+   if (!all_ok) {
+      free(entries);
+      return -1;
+   }
+   csr_setup(comm, info[0], info[1], entries, count, A);
+   return 0;
+}  /* csr_read_mtx */
+
+/*------------------------------------------------------------------
+ * Function:     csr_halo_start
+ * Purpose:      Pack the entries of x the other processes need and
+ *               start the persistent receives and sends
+ */
+static void csr_halo_start(dist_csr_t* A, const double* x) {
+   int t;
+
+   for (t = 0; t < A->send_ptr[A->nsend]; t++)
+      A->send_buf[t] = x[A->send_idx[t]];
+   MPI_Startall(A->nrecv + A->nsend, A->req);
+}  /* csr_halo_start */
+
+/*------------------------------------------------------------------
+ * Function:     csr_spmv
+ * Purpose:      y = A*x, overlapping the halo exchange with the diag
+ *               part of the product
+ * Input args:   x:  my part of x
+ * Output args:  y:  my rows of A*x
+ */
+static void csr_spmv(dist_csr_t* A, const double* x, double* y) {
+   int i, k;
+   double sum;
+
+   csr_halo_start(A, x);
+   for (i = 0; i < A->nrows; i++) {
+      sum = 0.0;
+      for (k = A->diag.ptr[i]; k < A->diag.ptr[i+1]; k++)
+         sum += A->diag.val[k] * x[A->diag.col[k]];
+      y[i] = sum;
+   }
+   MPI_Waitall(A->nrecv + A->nsend, A->req, MPI_STATUSES_IGNORE);
+   for (i = 0; i < A->nrows; i++) {
+      sum = y[i];
+      for (k = A->offd.ptr[i]; k < A->offd.ptr[i+1]; k++)
+         sum += A->offd.val[k] * A->ghost[A->offd.col[k]];
+      y[i] = sum;
+   }
+}  /* csr_spmv */
+
+/*------------------------------------------------------------------
+ * Function:     csr_free
+ */
+static void csr_free(dist_csr_t* A) {
+   int r;
+
+   for (r = 0; r < A->nrecv + A->nsend; r++) MPI_Request_free(&A->req[r]);
+   free(A->row_start); free(A->col_start);
+   free(A->diag.ptr); free(A->diag.col); free(A->diag.val);
+   free(A->offd.ptr); free(A->offd.col); free(A->offd.val);
+   free(A->ghost_col); free(A->recv_proc); free(A->recv_ptr);
+   free(A->send_proc); free(A->send_ptr); free(A->send_idx);
+   free(A->ghost); free(A->send_buf); free(A->req);
+   memset(A, 0, sizeof(*A));
+}  /* csr_free */
+
+#endif /* CSR_H */
@@ -0,0 +1,338 @@
+/* File:     gemm.h
+ * Purpose:  Local double-precision matrix multiply C += A * B for the
+ *           matrix multiply workers, row-major with arbitrary strides.
+ *
+ * Usage:    gemm(m, n, k, a, lda, b, ldb, c, ldc);
+ *
+ * Algorithm (the usual GotoBLAS/BLIS loop nest):
+ *    1.  For each NC-wide block of columns of B and C (sized for L3)
+ *    2.    For each KC-deep slice of k: pack the KC x NC block of B
+ *          into NR-wide column panels (sized so one panel stays in L1)
+ *    3.      For each MC-tall block of rows of A (sized for L2), in
+ *            parallel over OpenMP threads: pack it into MR-tall row
+ *            panels, then
+ *    4.        for every MR x NR tile of C, run the micro-kernel, which
+ *              keeps the tile in registers for the whole KC loop and
+ *              does one broadcast-FMA per element of the A panel.
+ *
+ * Note:     The micro-kernel and blocking parameters are chosen once at
+ *           run time: AVX-512 (12 x 16), AVX2+FMA (6 x 8) or portable C
+ *           (4 x 8).  Setting GEMM_ISA to generic or avx2 caps the
+ *           choice; any other value but avx512 gets the generic kernel
+ *           and a warning.  Compile with -O3, and with -fopenmp for threads;
+ *           without it the pragmas are ignored and the kernel runs
+ *           serially.
+ */
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#define GEMM_OMP(directive) _Pragma(#directive)
+#else
+#define GEMM_OMP(directive)
+#endif
+/* The kernel choice is published once, by whichever thread gets there
+ * first */
+#ifdef __GNUC__
+#define GEMM_LOAD(p)        __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define GEMM_CAS(p, e, v)   __atomic_compare_exchange_n(&(p), &(e), (v), 0, \
+                                 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#else
+#define GEMM_LOAD(p)        (p)
+#define GEMM_CAS(p, e, v)   ((p) = (v), 1)   /* call once before any threads */
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GEMM_HAVE_X86_KERNELS
+#endif
+
+/* Micro-kernel: C[0:m, 0:n] += Ap * Bp over kc, for m <= MR, n <= NR,
+ * where Ap holds MR values per k and Bp holds NR values per k */
+typedef void (*gemm_ukernel_fn)(int kc, const double* ap, const double* bp,
+      double* c, long ldc, int m, int n);
+
+typedef struct {
+   const char*     name;
+   int             mr, nr;       /* register tile */
+   int             mc, kc, nc;   /* cache blocks */
+   gemm_ukernel_fn ukernel;
+} gemm_kernel_t;
+
+/*------------------------------------------------------------------
+ * Function:     gemm_store_tile
+ * Purpose:      Add an MR x NR tile computed in a scratch buffer to
+ *               the m x n corner of C that actually exists
+ */
+static inline void gemm_store_tile(const double* tile, int nr, double* c,
+      long ldc, int m, int n) {
+   int i, j;
+
+   for (i = 0; i < m; i++)
+      for (j = 0; j < n; j++)
+         c[i*ldc + j] += tile[i*nr + j];
+}  /* gemm_store_tile */
+
+/*------------------------------------------------------------------
+ * Function:     gemm_ukernel_generic
+ * Purpose:      Portable 4 x 8 micro-kernel; the fixed-size loops are
+ *               left to the compiler to vectorize
+ */
+static void gemm_ukernel_generic(int kc, const double* ap, const double* bp,
+      double* c, long ldc, int m, int n) {
+   double tile[4*8] = {0};
+   int p, i, j;
+
+   for (p = 0; p < kc; p++)
+      for (i = 0; i < 4; i++)
+         for (j = 0; j < 8; j++)
+            tile[i*8 + j] += ap[p*4 + i] * bp[p*8 + j];
+   gemm_store_tile(tile, 8, c, ldc, m, n);
+}  /* gemm_ukernel_generic */
+
+#ifdef GEMM_HAVE_X86_KERNELS
+/*------------------------------------------------------------------
+ * Function:     gemm_ukernel_avx2
+ * Purpose:      6 x 8 micro-kernel: 12 ymm accumulators, two loads of
+ *               B and six broadcasts of A per k
+ */
+__attribute__((target("avx2,fma")))
+static void gemm_ukernel_avx2(int kc, const double* ap, const double* bp,
+      double* c, long ldc, int m, int n) {
+   __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+   __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+   __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+   __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+   __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+   __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+   __m256d b0, b1, a;
+   double tile[6*8];
+   double* t;
+   long ld;
+   int p;
+
+   for (p = 0; p < kc; p++) {
+      b0 = _mm256_loadu_pd(bp);
+      b1 = _mm256_loadu_pd(bp + 4);
+      a = _mm256_broadcast_sd(ap);
+      c00 = _mm256_fmadd_pd(a, b0, c00); c01 = _mm256_fmadd_pd(a, b1, c01);
+      a = _mm256_broadcast_sd(ap + 1);
+      c10 = _mm256_fmadd_pd(a, b0, c10); c11 = _mm256_fmadd_pd(a, b1, c11);
+      a = _mm256_broadcast_sd(ap + 2);
+      c20 = _mm256_fmadd_pd(a, b0, c20); c21 = _mm256_fmadd_pd(a, b1, c21);
+      a = _mm256_broadcast_sd(ap + 3);
+      c30 = _mm256_fmadd_pd(a, b0, c30); c31 = _mm256_fmadd_pd(a, b1, c31);
+      a = _mm256_broadcast_sd(ap + 4);
+      c40 = _mm256_fmadd_pd(a, b0, c40); c41 = _mm256_fmadd_pd(a, b1, c41);
+      a = _mm256_broadcast_sd(ap + 5);
+      c50 = _mm256_fmadd_pd(a, b0, c50); c51 = _mm256_fmadd_pd(a, b1, c51);
+      ap += 6;
+      bp += 8;
+   }
+
+   /* Full tiles go straight to C; edge tiles through a scratch tile */
+   if (m == 6 && n == 8) {
+      t = c;
+      ld = ldc;
+      c00 = _mm256_add_pd(c00, _mm256_loadu_pd(t));          c01 = _mm256_add_pd(c01, _mm256_loadu_pd(t + 4));
+      c10 = _mm256_add_pd(c10, _mm256_loadu_pd(t + ld));     c11 = _mm256_add_pd(c11, _mm256_loadu_pd(t + ld + 4));
+      c20 = _mm256_add_pd(c20, _mm256_loadu_pd(t + 2*ld));   c21 = _mm256_add_pd(c21, _mm256_loadu_pd(t + 2*ld + 4));
+      c30 = _mm256_add_pd(c30, _mm256_loadu_pd(t + 3*ld));   c31 = _mm256_add_pd(c31, _mm256_loadu_pd(t + 3*ld + 4));
+      c40 = _mm256_add_pd(c40, _mm256_loadu_pd(t + 4*ld));   c41 = _mm256_add_pd(c41, _mm256_loadu_pd(t + 4*ld + 4));
+      c50 = _mm256_add_pd(c50, _mm256_loadu_pd(t + 5*ld));   c51 = _mm256_add_pd(c51, _mm256_loadu_pd(t + 5*ld + 4));
+   } else {
+      t = tile;
+      ld = 8;
+   }
+   _mm256_storeu_pd(t, c00);          _mm256_storeu_pd(t + 4, c01);
+   _mm256_storeu_pd(t + ld, c10);     _mm256_storeu_pd(t + ld + 4, c11);
+   _mm256_storeu_pd(t + 2*ld, c20);   _mm256_storeu_pd(t + 2*ld + 4, c21);
+   _mm256_storeu_pd(t + 3*ld, c30);   _mm256_storeu_pd(t + 3*ld + 4, c31);
+   _mm256_storeu_pd(t + 4*ld, c40);   _mm256_storeu_pd(t + 4*ld + 4, c41);
+   _mm256_storeu_pd(t + 5*ld, c50);   _mm256_storeu_pd(t + 5*ld + 4, c51);
+   if (t == tile) gemm_store_tile(tile, 8, c, ldc, m, n);
+}  /* gemm_ukernel_avx2 */
+
+/*------------------------------------------------------------------
+ * Function:     gemm_ukernel_avx512
+ * Purpose:      12 x 16 micro-kernel: 24 zmm accumulators, two loads
+ *               of B and twelve broadcasts of A per k
+ */
+__attribute__((target("avx512f")))
+static void gemm_ukernel_avx512(int kc, const double* ap, const double* bp,
+      double* c, long ldc, int m, int n) {
+   __m512d acc[12][2];
+   __m512d b0, b1, a;
+   double tile[12*16];
+   int p, i;
+
+   for (i = 0; i < 12; i++) {
+      acc[i][0] = _mm512_setzero_pd();
+      acc[i][1] = _mm512_setzero_pd();
+   }
+   for (p = 0; p < kc; p++) {
+      b0 = _mm512_loadu_pd(bp);
+      b1 = _mm512_loadu_pd(bp + 8);
+      /* Fully unrolled by the compiler, so acc stays in registers */
+      for (i = 0; i < 12; i++) {
+         a = _mm512_set1_pd(ap[i]);
+         acc[i][0] = _mm512_fmadd_pd(a, b0, acc[i][0]);
+         acc[i][1] = _mm512_fmadd_pd(a, b1, acc[i][1]);
+      }
+      ap += 12;
+      bp += 16;
+   }
+
+   if (m == 12 && n == 16) {
+      for (i = 0; i < 12; i++) {
+         _mm512_storeu_pd(c + i*ldc, _mm512_add_pd(acc[i][0], _mm512_loadu_pd(c + i*ldc)));
+         _mm512_storeu_pd(c + i*ldc + 8, _mm512_add_pd(acc[i][1], _mm512_loadu_pd(c + i*ldc + 8)));
+      }
+   } else {
+      for (i = 0; i < 12; i++) {
+         _mm512_storeu_pd(tile + i*16, acc[i][0]);
+         _mm512_storeu_pd(tile + i*16 + 8, acc[i][1]);
+      }
+      gemm_store_tile(tile, 16, c, ldc, m, n);
+   }
+}  /* gemm_ukernel_avx512 */
+#endif
+
+/*------------------------------------------------------------------
+ * Function:     gemm_select
+ * Purpose:      Pick the micro-kernel and block sizes for this CPU
+ *               (once; later calls return the same choice)
+ * Return val:   the kernel description
+ * Note:         Safe to call from several threads: each works out the
+ *               same choice and the first to publish it wins, so an
+ *               unknown GEMM_ISA is reported once.  Unknown values
+ *               select the generic kernel.
+ */
+static const gemm_kernel_t* gemm_select(void) {
+   static const gemm_kernel_t generic = {"generic", 4, 8, 64, 256, 4096, gemm_ukernel_generic};
+#ifdef GEMM_HAVE_X86_KERNELS
+   static const gemm_kernel_t avx2 = {"avx2", 6, 8, 72, 256, 4096, gemm_ukernel_avx2};
+   static const gemm_kernel_t avx512 = {"avx512", 12, 16, 96, 384, 4096, gemm_ukernel_avx512};
+#endif
+   static const gemm_kernel_t* chosen = NULL;
+   const gemm_kernel_t *pick, *expected = NULL;
+   const char* cap;
+   int unknown;
+
+   if ((pick = GEMM_LOAD(chosen)) != NULL) return pick;
+   cap = getenv("GEMM_ISA");
+   if (cap != NULL && cap[0] == '\0') cap = NULL;
+   unknown = (cap != NULL && strcmp(cap, "generic") != 0 && strcmp(cap, "avx2") != 0
+         && strcmp(cap, "avx512") != 0);
+   pick = &generic;
+#ifdef GEMM_HAVE_X86_KERNELS
+   /* A typo must not pick a kernel the CPU may lack */
+   __builtin_cpu_init();
+   if (!unknown && (cap == NULL || strcmp(cap, "avx512") == 0)
+         && __builtin_cpu_supports("avx512f")) {
+      pick = &avx512;
+   } else if (!unknown && (cap == NULL || strcmp(cap, "generic") != 0)
+         && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      pick = &avx2;
+   }
+#endif
+   if (!GEMM_CAS(chosen, expected, pick)) return expected;
+   if (unknown)
+      fprintf(stderr, "GEMM_ISA=%s: not generic, avx2 or avx512; using the generic kernel\n", cap);
+   return pick;
+}  /* gemm_select */
+
+/*------------------------------------------------------------------
+ * Function:     gemm_pack_a
+ * Purpose:      Copy an mc x kc block of A into MR-tall row panels,
+ *               each stored k-major, zero-padding the last panel
+ */
+static void gemm_pack_a(int mc, int kc, const double* a, long lda,
+      double* ap, int mr) {
+   int ir, i, p, rows;
+
+   for (ir = 0; ir < mc; ir += mr) {
+      rows = (mc - ir < mr) ? mc - ir : mr;
+      for (p = 0; p < kc; p++) {
+         for (i = 0; i < rows; i++) ap[i] = a[(ir + i)*lda + p];
+         for (; i < mr; i++) ap[i] = 0.0;
+         ap += mr;
+      }
+   }
+}  /* gemm_pack_a */
+
+/*------------------------------------------------------------------
+ * Function:     gemm_pack_b_panel
+ * Purpose:      Copy NR-wide column panel jr of a kc x nc block of B,
+ *               stored k-major, zero-padding the last panel
+ */
+static void gemm_pack_b_panel(int kc, int nc, int jr, const double* b,
+      long ldb, double* bp, int nr) {
+   int j, p, cols = (nc - jr < nr) ? nc - jr : nr;
+
+   for (p = 0; p < kc; p++) {
+      for (j = 0; j < cols; j++) bp[j] = b[p*ldb + jr + j];
+      for (; j < nr; j++) bp[j] = 0.0;
+      bp += nr;
+   }
+}  /* gemm_pack_b_panel */
+
+/*------------------------------------------------------------------
+ * Function:     gemm
+ * Purpose:      C += A * B
+ * Input args:   m, n, k:  C is m x n, A is m x k, B is k x n
+ *               a, lda:   A and its row stride
+ *               b, ldb:   B and its row stride
+ * In/out args:  c, ldc:   C and its row stride
+ */
+static void gemm(int m, int n, int k, const double* a, int lda,
+      const double* b, int ldb, double* c, int ldc) {
+   const gemm_kernel_t* kern = gemm_select();
+   int mr = kern->mr, nr = kern->nr;
+   int jc, pc, nc, kc, npanels;
+   double* bp;
+
+   if (m <= 0 || n <= 0 || k <= 0) return;
+   bp = malloc((size_t) kern->kc * (kern->nc + nr) * sizeof(double));
+
+   for (jc = 0; jc < n; jc += kern->nc) {
+      nc = (n - jc < kern->nc) ? n - jc : kern->nc;
+      npanels = (nc + nr - 1) / nr;
+      for (pc = 0; pc < k; pc += kern->kc) {
+         kc = (k - pc < kern->kc) ? k - pc : kern->kc;
+
+         GEMM_OMP(omp parallel)
+         {
+            int ic, jr, ir, mc, p;
+            double* ap = malloc((size_t) kern->mc * kc * sizeof(double));
+
+            /* All threads pack the shared block of B, then share it */
+            GEMM_OMP(omp for schedule(static))
+            for (p = 0; p < npanels; p++)
+               gemm_pack_b_panel(kc, nc, p*nr, &b[(long)pc*ldb + jc], ldb, &bp[(long)p*nr*kc], nr);
+
+            /* Macro-tiles of rows of C are independent */
+            GEMM_OMP(omp for schedule(dynamic))
+            for (ic = 0; ic < m; ic += kern->mc) {
+               mc = (m - ic < kern->mc) ? m - ic : kern->mc;
+               gemm_pack_a(mc, kc, &a[(long)ic*lda + pc], lda, ap, mr);
+               for (jr = 0; jr < nc; jr += nr) {
+                  for (ir = 0; ir < mc; ir += mr) {
+                     kern->ukernel(kc, &ap[(long)ir*kc], &bp[(long)jr*kc],
+                           &c[(long)(ic + ir)*ldc + jc + jr], ldc,
+                           (mc - ir < mr) ? mc - ir : mr,
+                           (nc - jr < nr) ? nc - jr : nr);
+                  }
+               }
+            }
+            free(ap);
+         }
+      }
+   }
+   free(bp);
+}  /* gemm */
+
+#endif /* GEMM_H */
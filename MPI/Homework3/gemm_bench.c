@@ -0,0 +1,98 @@
+/* File:     gemm_bench.c
+ * Purpose:  Compare the blocked local GEMM kernel in gemm.h with the
+ *           naive k-i-j loop the matrix multiply workers used to run.
+ *
+ * Input:    Largest size to run and largest size for the naive loop
+ *           (it takes hours at n = 8192)
+ * Output:   For n = 64, 128, ... : GFLOP/s of each, speedup and the
+ *           largest difference between the two results
+ *
+ * Compile:  gcc -O3 -fopenmp -o gemm_bench gemm_bench.c
+ * Run:      OMP_NUM_THREADS=<threads> ./gemm_bench [max_n] [max_naive_n]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include "gemm.h"
+
+/*------------------------------------------------------------------
+ * Function:     naive_gemm
+ * Purpose:      C = A * B in the loop order of the original worker:
+ *               k over columns of C outermost, C updated in memory on
+ *               every j
+ */
+void naive_gemm(int n, const double* a, const double* b, double* c) {
+   int i, j, k;
+
+   for (k = 0; k < n; k++) {
+      for (i = 0; i < n; i++) {
+         c[(long)i*n + k] = 0.0;
+         for (j = 0; j < n; j++)
+            c[(long)i*n + k] = c[(long)i*n + k] + a[(long)i*n + j] * b[(long)j*n + k];
+      }
+   }
+}  /* naive_gemm */
+
+/*------------------------------------------------------------------
+ * Function:     best_time
+ * Purpose:      Fastest of reps runs of one multiply
+ */
+double best_time(int blocked, int n, int reps, const double* a,
+      const double* b, double* c) {
+   double t, best = 1e30;
+   int r;
+
+   for (r = 0; r < reps; r++) {
+      t = omp_get_wtime();
+      if (blocked) {
+         memset(c, 0, (size_t) n * n * sizeof(double));
+         gemm(n, n, n, a, n, b, n, c, n);
+      } else {
+         naive_gemm(n, a, b, c);
+      }
+      t = omp_get_wtime() - t;
+      if (t < best) best = t;
+   }
+   return best;
+}  /* best_time */
+
+int main(int argc, char* argv[]) {
+   int max_n = (argc > 1) ? atoi(argv[1]) : 8192;
+   int max_naive = (argc > 2) ? atoi(argv[2]) : 2048;
+   int n, reps;
+   long i, nn;
+   double *a, *b, *c_naive, *c_blocked;
+   double flops, t_naive, t_blocked, diff;
+
+   printf("kernel %s, %d threads\n", gemm_select()->name, omp_get_max_threads());
+   printf("%6s %14s %14s %9s %12s\n", "n", "naive GFLOP/s", "gemm GFLOP/s", "speedup", "max diff");
+   for (n = 64; n <= max_n; n *= 2) {
+      nn = (long) n * n;
+      a = malloc(nn * sizeof(double));
+      b = malloc(nn * sizeof(double));
+      c_naive = malloc(nn * sizeof(double));
+      c_blocked = malloc(nn * sizeof(double));
+      for (i = 0; i < nn; i++) {
+         a[i] = (double)(i % 7) - 3.0;
+         b[i] = (double)(i % 5) - 2.0;
+      }
+      flops = 2.0 * n * n * n;
+      reps = (n <= 512) ? 5 : 1;
+
+      t_blocked = best_time(1, n, reps, a, b, c_blocked);
+      if (n <= max_naive) {
+         t_naive = best_time(0, n, reps, a, b, c_naive);
+         diff = 0.0;
+         for (i = 0; i < nn; i++)
+            if (fabs(c_naive[i] - c_blocked[i]) > diff) diff = fabs(c_naive[i] - c_blocked[i]);
+         printf("%6d %14.3f %14.3f %9.1f %12g\n", n, flops / t_naive * 1e-9,
+                flops / t_blocked * 1e-9, t_naive / t_blocked, diff);
+      } else {
+         printf("%6d %14s %14.3f %9s %12s\n", n, "-", flops / t_blocked * 1e-9, "-", "-");
+      }
+      fflush(stdout);
+      free(a); free(b); free(c_naive); free(c_blocked);
+   }
+   return 0;
+}  /* main */
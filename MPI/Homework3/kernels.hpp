@@ -0,0 +1,243 @@
+/* File:     kernels.hpp
+ * Purpose:  Header-only C++ kernels for the matrix programs, templated
+ *           on the element type (int, float or double), so one driver
+ *           can run the same pipeline in float for speed or double for
+ *           accuracy.
+ *
+ * Usage:    kern::dot(n, a, b)
+ *           kern::matvec(rows, cols, a, lda, x, y)          y = A*x
+ *           kern::gemm(m, n, k, a, lda, b, ldb, c, ldc)     C += A*B
+ *           kern::mpi_type<T>::get()                        MPI_INT, ...
+ *           kern::mpi_type<T>::name()                       "int", ...
+ *
+ * Note:     kern::simd<T> is chosen at compile time: int, float and
+ *           double are specialized to GCC vector types as wide as the
+ *           target allows (64 bytes with -mavx512f, 32 with -mavx, 16
+ *           otherwise), so a float vector holds twice as many elements
+ *           as a double one; any other type falls back to scalars.  With
+ *           -mfma the multiply-adds are fused.  gemm uses the loop nest
+ *           of gemm.h (pack a KC x NC block of B into NR-wide panels,
+ *           keep an MR x NR tile of C in registers) with MR = 4 and NR =
+ *           two vectors.  Compile with -O3 -march=native, and -fopenmp
+ *           for threads in gemm.
+ */
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+#include <cstring>
+#include <vector>
+#include "mpi.h"
+#ifdef _OPENMP
+#define KERN_OMP(directive) _Pragma(#directive)
+#else
+#define KERN_OMP(directive)
+#endif
+
+#if defined(__AVX512F__)
+#define KERN_VECTOR_BYTES 64
+#elif defined(__AVX__)
+#define KERN_VECTOR_BYTES 32
+#else
+#define KERN_VECTOR_BYTES 16
+#endif
+
+namespace kern {
+
+/*------------------------------------------------------------------
+ * MPI datatype of each element type
+ */
+template <typename T> struct mpi_type;
+template <> struct mpi_type<int> {
+   static MPI_Datatype get() { return MPI_INT; }
+   static const char* name() { return "int"; }
+};
+template <> struct mpi_type<float> {
+   static MPI_Datatype get() { return MPI_FLOAT; }
+   static const char* name() { return "float"; }
+};
+template <> struct mpi_type<double> {
+   static MPI_Datatype get() { return MPI_DOUBLE; }
+   static const char* name() { return "double"; }
+};
+
+/*------------------------------------------------------------------
+ * SIMD operations: scalar by default ...
+ */
+template <typename T> struct simd {
+   typedef T vec;
+   static const int lanes = 1;
+   static vec load(const T* p) { return *p; }
+   static void store(T* p, vec v) { *p = v; }
+   static vec splat(T x) { return x; }
+   static T sum(vec v) { return v; }
+};
+
+/* ... and a full vector register for the types the hardware has */
+template <typename T> struct simd_vector {
+   typedef T vec __attribute__((vector_size(KERN_VECTOR_BYTES)));
+   static const int lanes = KERN_VECTOR_BYTES / sizeof(T);
+   static vec load(const T* p) { vec v; std::memcpy(&v, p, sizeof(v)); return v; }
+   static void store(T* p, vec v) { std::memcpy(p, &v, sizeof(v)); }
+   static vec splat(T x) { return vec{} + x; }
+   static T sum(vec v) {
+      T s = 0;
+      for (int i = 0; i < lanes; i++) s += v[i];
+      return s;
+   }
+};
+template <> struct simd<int> : simd_vector<int> {};
+template <> struct simd<float> : simd_vector<float> {};
+template <> struct simd<double> : simd_vector<double> {};
+
+/*------------------------------------------------------------------
+ * Function:     dot
+ * Purpose:      a . b over n elements, with four vector accumulators
+ */
+template <typename T>
+T dot(long n, const T* a, const T* b) {
+   typedef simd<T> S;
+   typename S::vec s0 = S::splat(0), s1 = s0, s2 = s0, s3 = s0;
+   long i = 0;
+
+   for (; i + 4 * S::lanes <= n; i += 4 * S::lanes) {
+      s0 += S::load(a + i) * S::load(b + i);
+      s1 += S::load(a + i + S::lanes) * S::load(b + i + S::lanes);
+      s2 += S::load(a + i + 2 * S::lanes) * S::load(b + i + 2 * S::lanes);
+      s3 += S::load(a + i + 3 * S::lanes) * S::load(b + i + 3 * S::lanes);
+   }
+   for (; i + S::lanes <= n; i += S::lanes)
+      s0 += S::load(a + i) * S::load(b + i);
+   T sum = S::sum((s0 + s1) + (s2 + s3));
+   for (; i < n; i++) sum += a[i] * b[i];
+   return sum;
+}  /* dot */
+
+/*------------------------------------------------------------------
+ * Function:     matvec
+ * Purpose:      y = A*x for a rows x cols A with row stride lda; four
+ *               rows at a time so every load of x is used four times
+ */
+template <typename T>
+void matvec(long rows, long cols, const T* a, long lda, const T* x, T* y) {
+   typedef simd<T> S;
+   long i = 0, j;
+
+   for (; i + 4 <= rows; i += 4) {
+      const T *a0 = a + i*lda, *a1 = a0 + lda, *a2 = a1 + lda, *a3 = a2 + lda;
+      typename S::vec s0 = S::splat(0), s1 = s0, s2 = s0, s3 = s0, xv;
+      for (j = 0; j + S::lanes <= cols; j += S::lanes) {
+         xv = S::load(x + j);
+         s0 += S::load(a0 + j) * xv;
+         s1 += S::load(a1 + j) * xv;
+         s2 += S::load(a2 + j) * xv;
+         s3 += S::load(a3 + j) * xv;
+      }
+      T y0 = S::sum(s0), y1 = S::sum(s1), y2 = S::sum(s2), y3 = S::sum(s3);
+      for (; j < cols; j++) {
+         y0 += a0[j] * x[j];
+         y1 += a1[j] * x[j];
+         y2 += a2[j] * x[j];
+         y3 += a3[j] * x[j];
+      }
+      y[i] = y0; y[i+1] = y1; y[i+2] = y2; y[i+3] = y3;
+   }
+   for (; i < rows; i++) y[i] = dot(cols, a + i*lda, x);
+}  /* matvec */
+
+/* Blocking of gemm, per element type: KC x NR panels of B stay in L1 */
+template <typename T> struct gemm_blocking {
+   static const int mr = 4;
+   static const int nr = 2 * simd<T>::lanes;
+   static const int kc = 256;
+   static const int nc = 4096;
+};
+
+/*------------------------------------------------------------------
+ * Function:     gemm_ukernel
+ * Purpose:      C[0:m, 0:n] += A[0:m, 0:kc] * Bp for m <= MR, n <= NR,
+ *               with the MR x NR tile in registers.  Bp holds NR values
+ *               per k; rows of A past m repeat row m-1 and are dropped.
+ */
+template <typename T>
+void gemm_ukernel(int kc, const T* a, long lda, const T* bp, T* c, long ldc,
+      int m, int n) {
+   typedef simd<T> S;
+   const int MR = gemm_blocking<T>::mr, NR = gemm_blocking<T>::nr;
+   const T* ar[MR];
+   typename S::vec acc[MR][2], b0, b1, av;
+   T tile[MR * NR];
+   int r, p, j;
+
+   for (r = 0; r < MR; r++) {
+      ar[r] = a + (long)((r < m) ? r : m - 1) * lda;
+      acc[r][0] = acc[r][1] = S::splat(0);
+   }
+   for (p = 0; p < kc; p++) {
+      b0 = S::load(bp + (long) p * NR);
+      b1 = S::load(bp + (long) p * NR + S::lanes);
+      for (r = 0; r < MR; r++) {
+         av = S::splat(ar[r][p]);
+         acc[r][0] += av * b0;
+         acc[r][1] += av * b1;
+      }
+   }
+
+   if (m == MR && n == NR) {
+      for (r = 0; r < MR; r++) {
+         S::store(c + r*ldc, S::load(c + r*ldc) + acc[r][0]);
+         S::store(c + r*ldc + S::lanes, S::load(c + r*ldc + S::lanes) + acc[r][1]);
+      }
+   } else {
+      for (r = 0; r < MR; r++) {
+         S::store(tile + r*NR, acc[r][0]);
+         S::store(tile + r*NR + S::lanes, acc[r][1]);
+      }
+      for (r = 0; r < m; r++)
+         for (j = 0; j < n; j++) c[r*ldc + j] += tile[r*NR + j];
+   }
+}  /* gemm_ukernel */
+
+/*------------------------------------------------------------------
+ * Function:     gemm
+ * Purpose:      C += A*B; C is m x n, A is m x k, B is k x n, all
+ *               row-major with row strides lda, ldb, ldc
+ */
+template <typename T>
+void gemm(int m, int n, int k, const T* a, long lda, const T* b, long ldb,
+      T* c, long ldc) {
+   typedef gemm_blocking<T> G;
+
+   if (m <= 0 || n <= 0 || k <= 0) return;
+   std::vector<T> bp((size_t)((k < G::kc) ? k : G::kc) * (((n < G::nc) ? n : G::nc) + G::nr));
+   for (int jc = 0; jc < n; jc += G::nc) {
+      int nc = (n - jc < G::nc) ? n - jc : G::nc;
+      int npanels = (nc + G::nr - 1) / G::nr;
+      for (int pc = 0; pc < k; pc += G::kc) {
+         int kc = (k - pc < G::kc) ? k - pc : G::kc;
+
+         /* Pack the KC x NC block of B into zero-padded NR-wide panels */
+         KERN_OMP(omp parallel for schedule(static))
+         for (int q = 0; q < npanels; q++) {
+            int jr = q * G::nr, w = (nc - jr < G::nr) ? nc - jr : G::nr;
+            T* panel = &bp[(size_t) q * G::nr * kc];
+            for (int p = 0; p < kc; p++) {
+               const T* row = b + (long)(pc + p) * ldb + jc + jr;
+               for (int j = 0; j < G::nr; j++) panel[p * G::nr + j] = (j < w) ? row[j] : T(0);
+            }
+         }
+
+         KERN_OMP(omp parallel for schedule(dynamic))
+         for (int ir = 0; ir < m; ir += G::mr) {
+            for (int jr = 0; jr < nc; jr += G::nr) {
+               gemm_ukernel<T>(kc, a + (long) ir * lda + pc, lda, &bp[(size_t) jr * kc],
+                     c + (long) ir * ldc + jc + jr, ldc,
+                     (m - ir < G::mr) ? m - ir : G::mr, (nc - jr < G::nr) ? nc - jr : G::nr);
+            }
+         }
+      }
+   }
+}  /* gemm */
+
+}  /* namespace kern */
+
+#endif /* KERNELS_HPP */
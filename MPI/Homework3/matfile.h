@@ -0,0 +1,331 @@
+/* File:     matfile.h
+ * Purpose:  Binary tiled matrix files read and written by all processes
+ *           at once, so no matrix has to pass through rank 0.
+ *
+ * Format:   a 64-byte header (matfile_header_t, native byte order)
+ *           followed by the tiles in row-major tile order, each tile
+ *           tile_rows x tile_cols elements stored row-major.  Tiles on
+ *           the bottom and right edges are padded to full size, so
+ *           tile (I, J) always starts at
+ *              64 + (I * tiles_across + J) * tile_rows * tile_cols * esize
+ *
+ * Usage:    matfile_t f;
+ *           matfile_create(comm, "C.mat", MATFILE_DOUBLE, m, n, 64, 64, &f);
+ *           matfile_open(comm, "A.mat", MPI_MODE_RDONLY, &f);
+ *           matfile_read(&f, r0, nr, c0, nc, buf);     (collective)
+ *           matfile_write(&f, r0, nr, c0, nc, buf);    (collective)
+ *           matfile_close(&f);
+ *
+ *           buf holds the nr x nc block with top left corner (r0, c0),
+ *           row-major.  Reads and writes set a file view made of one
+ *           subarray per tile the block touches and use the collective
+ *           MPI_File_read_at_all / MPI_File_write_at_all, so MPI-IO can
+ *           merge the requests of all processes into large accesses.
+ *
+ *           When every process is on the same node the file is instead
+ *           memory-mapped and blocks are copied tile row by tile row;
+ *           set MATFILE_MMAP=0 to always use MPI-IO.
+ */
+#ifndef MATFILE_H
+#define MATFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "mpi.h"
+
+#define MATFILE_DOUBLE 1
+#define MATFILE_INT    2      /* 32-bit int */
+#define MATFILE_MAGIC  "PCMATRIX"
+
+typedef struct {
+   char     magic[8];
+   uint32_t version;
+   uint32_t type;             /* MATFILE_DOUBLE or MATFILE_INT */
+   uint64_t rows, cols;
+   uint64_t tile_rows, tile_cols;
+   uint64_t reserved[2];
+} matfile_header_t;
+
+typedef struct {
+   MPI_Comm     comm;
+   MPI_File     fh;
+   int          type;
+   int          esize;        /* bytes per element */
+   MPI_Datatype etype;
+   long         rows, cols, tile_rows, tile_cols, tiles_across;
+   char*        map;          /* the whole file, when memory-mapped */
+   size_t       map_len;
+} matfile_t;
+
+/*------------------------------------------------------------------
+ * Function:     matfile_setup
+ * Purpose:      Fill in f from a header and decide whether to mmap
+ */
+static inline void matfile_setup(matfile_t* f, const matfile_header_t* h) {
+   f->type = (int) h->type;
+   f->esize = (h->type == MATFILE_DOUBLE) ? sizeof(double) : sizeof(int);
+   f->etype = (h->type == MATFILE_DOUBLE) ? MPI_DOUBLE : MPI_INT;
+   f->rows = (long) h->rows;
+   f->cols = (long) h->cols;
+   f->tile_rows = (long) h->tile_rows;
+   f->tile_cols = (long) h->tile_cols;
+   f->tiles_across = (f->cols + f->tile_cols - 1) / f->tile_cols;
+   f->map = NULL;
+   f->map_len = 0;
+}  /* matfile_setup */
+
+/*------------------------------------------------------------------
+ * Function:     matfile_size
+ * Purpose:      Bytes in the file, padding included
+ */
+static inline long matfile_size(const matfile_t* f) {
+   long tiles_down = (f->rows + f->tile_rows - 1) / f->tile_rows;
+
+   return (long) sizeof(matfile_header_t)
+        + tiles_down * f->tiles_across * f->tile_rows * f->tile_cols * f->esize;
+}  /* matfile_size */
+
+/*------------------------------------------------------------------
+ * Function:     matfile_try_mmap
+ * Purpose:      Map the file if all processes share one node
+ */
+static inline void matfile_try_mmap(matfile_t* f, const char* path, int writable) {
+   MPI_Comm node;
+   int nprocs, node_size, fd, ok, all_ok;
+   const char* env = getenv("MATFILE_MMAP");
+
+   MPI_Comm_size(f->comm, &nprocs);
+   MPI_Comm_split_type(f->comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+   MPI_Comm_size(node, &node_size);
+   MPI_Comm_free(&node);
+   if (node_size != nprocs || (env != NULL && strcmp(env, "0") == 0)) return;
+
+   ok = 0;
+   fd = open(path, writable ? O_RDWR : O_RDONLY);
+   if (fd >= 0) {
+      f->map_len = (size_t) matfile_size(f);
+      f->map = mmap(NULL, f->map_len, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+            MAP_SHARED, fd, 0);
+      ok = (f->map != MAP_FAILED);
+      close(fd);
+   }
+   /* Everybody maps or nobody does: the MPI-IO path is collective */
+   MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, f->comm);
+   if (ok && !all_ok) munmap(f->map, f->map_len);
+   if (!all_ok) {
+      f->map = NULL;
+      f->map_len = 0;
+   }
+}  /* matfile_try_mmap */
+
+/*------------------------------------------------------------------
+ * Function:     matfile_create
+ * Purpose:      Create a file for a rows x cols matrix (collective)
+ * Return val:   0, or -1 on every process
+ */
+static inline int matfile_create(MPI_Comm comm, const char* path, int type, long rows,
+      long cols, long tile_rows, long tile_cols, matfile_t* f) {
+   matfile_header_t h;
+   int rank;
+
+   MPI_Comm_rank(comm, &rank);
+   memset(&h, 0, sizeof(h));
+   memcpy(h.magic, MATFILE_MAGIC, 8);
+   h.version = 1;
+   h.type = (uint32_t) type;
+   h.rows = (uint64_t) rows;
+   h.cols = (uint64_t) cols;
+   h.tile_rows = (uint64_t)(tile_rows < rows ? tile_rows : rows);
+   h.tile_cols = (uint64_t)(tile_cols < cols ? tile_cols : cols);
+
+   f->comm = comm;
+   if (MPI_File_open(comm, (char*) path, MPI_MODE_CREATE | MPI_MODE_RDWR,
+         MPI_INFO_NULL, &f->fh) != MPI_SUCCESS) {
+      if (rank == 0) fprintf(stderr, "cannot create %s\n", path);
+      return -1;
+   }
+   matfile_setup(f, &h);
+   MPI_File_set_size(f->fh, matfile_size(f));
+   if (rank == 0)
+      MPI_File_write_at(f->fh, 0, &h, sizeof(h), MPI_BYTE, MPI_STATUS_IGNORE);
+   MPI_File_sync(f->fh);
+   MPI_Barrier(comm);
+   MPI_File_sync(f->fh);
+   matfile_try_mmap(f, path, 1);
+   return 0;
+}  /* matfile_create */
+
+/*------------------------------------------------------------------
+ * Function:     matfile_open
+ * Purpose:      Open an existing matrix file (collective); rank 0
+ *               reads the header, checks the file is as long as the
+ *               header says, and broadcasts it
+ * Input args:   amode:  MPI_MODE_RDONLY or MPI_MODE_RDWR
+ * Return val:   0, or -1 on every process
+ */
+static inline int matfile_open(MPI_Comm comm, const char* path, int amode, matfile_t* f) {
+   matfile_header_t h;
+   MPI_Offset bytes = 0;
+   int rank, ok = 1;
+
+   MPI_Comm_rank(comm, &rank);
+   f->comm = comm;
+   if (MPI_File_open(comm, (char*) path, amode, MPI_INFO_NULL, &f->fh) != MPI_SUCCESS) {
+      if (rank == 0) fprintf(stderr, "cannot open %s\n", path);
+      return -1;
+   }
+   if (rank == 0) {
+      memset(&h, 0, sizeof(h));
+      MPI_File_read_at(f->fh, 0, &h, sizeof(h), MPI_BYTE, MPI_STATUS_IGNORE);
+      ok = memcmp(h.magic, MATFILE_MAGIC, 8) == 0 && h.version == 1
+         && (h.type == MATFILE_DOUBLE || h.type == MATFILE_INT)
+         && h.rows > 0 && h.cols > 0 && h.tile_rows > 0 && h.tile_cols > 0;
+      if (!ok) fprintf(stderr, "%s: not a matrix file\n", path);
+      /* A short file would fault in the mapping or read garbage */
+      if (ok) {
+         matfile_setup(f, &h);
+         MPI_File_get_size(f->fh, &bytes);
+         ok = bytes >= matfile_size(f);
+         if (!ok)
+            fprintf(stderr, "%s: %lld bytes, a %ld x %ld matrix needs %ld\n", path,
+                  (long long) bytes, f->rows, f->cols, matfile_size(f));
+      }
+   }
+   MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+   if (!ok) {
+      MPI_File_close(&f->fh);
+      return -1;
+   }
+   MPI_Bcast(&h, sizeof(h), MPI_BYTE, 0, comm);
+   matfile_setup(f, &h);
+   matfile_try_mmap(f, path, amode & MPI_MODE_RDWR);
+   return 0;
+}  /* matfile_open */
+
+/*------------------------------------------------------------------
+ * Function:     matfile_types
+ * Purpose:      Build the file and memory datatypes of a block: one
+ *               subarray of each tile the block touches, in file order
+ */
+static inline void matfile_types(const matfile_t* f, long r0, long nr, long c0, long nc,
+      MPI_Datatype* file_t, MPI_Datatype* mem_t) {
+   long I, J, I0 = r0 / f->tile_rows, I1 = (r0 + nr - 1) / f->tile_rows;
+   long J0 = c0 / f->tile_cols, J1 = (c0 + nc - 1) / f->tile_cols;
+   long rs, re, cs, ce;
+   int ntiles = (int)((I1 - I0 + 1) * (J1 - J0 + 1)), t = 0;
+   int tile[2] = {(int) f->tile_rows, (int) f->tile_cols}, block[2] = {(int) nr, (int) nc};
+   int sub[2], fstart[2], mstart[2];
+   int* ones = malloc(ntiles * sizeof(int));
+   MPI_Aint* fdisp = malloc(ntiles * sizeof(MPI_Aint));
+   MPI_Aint* mdisp = malloc(ntiles * sizeof(MPI_Aint));
+   MPI_Datatype* ftypes = malloc(ntiles * sizeof(MPI_Datatype));
+   MPI_Datatype* mtypes = malloc(ntiles * sizeof(MPI_Datatype));
+
+   for (I = I0; I <= I1; I++) {
+      rs = (r0 > I * f->tile_rows) ? r0 : I * f->tile_rows;
+      re = (r0 + nr < (I + 1) * f->tile_rows) ? r0 + nr : (I + 1) * f->tile_rows;
+      for (J = J0; J <= J1; J++, t++) {
+         cs = (c0 > J * f->tile_cols) ? c0 : J * f->tile_cols;
+         ce = (c0 + nc < (J + 1) * f->tile_cols) ? c0 + nc : (J + 1) * f->tile_cols;
+         sub[0] = (int)(re - rs);
+         sub[1] = (int)(ce - cs);
+         fstart[0] = (int)(rs - I * f->tile_rows);
+         fstart[1] = (int)(cs - J * f->tile_cols);
+         mstart[0] = (int)(rs - r0);
+         mstart[1] = (int)(cs - c0);
+         MPI_Type_create_subarray(2, tile, sub, fstart, MPI_ORDER_C, f->etype, &ftypes[t]);
+         MPI_Type_create_subarray(2, block, sub, mstart, MPI_ORDER_C, f->etype, &mtypes[t]);
+         ones[t] = 1;
+         fdisp[t] = (MPI_Aint) sizeof(matfile_header_t)
+                  + (MPI_Aint)(I * f->tiles_across + J) * f->tile_rows * f->tile_cols * f->esize;
+         mdisp[t] = 0;
+      }
+   }
+   MPI_Type_create_struct(ntiles, ones, fdisp, ftypes, file_t);
+   MPI_Type_create_struct(ntiles, ones, mdisp, mtypes, mem_t);
+   MPI_Type_commit(file_t);
+   MPI_Type_commit(mem_t);
+   for (t = 0; t < ntiles; t++) {
+      MPI_Type_free(&ftypes[t]);
+      MPI_Type_free(&mtypes[t]);
+   }
+   free(ones); free(fdisp); free(mdisp); free(ftypes); free(mtypes);
+}  /* matfile_types */
+
+/*------------------------------------------------------------------
+ * Function:     matfile_copy
+ * Purpose:      Copy a block between the mapped file and buf
+ */
+static inline void matfile_copy(matfile_t* f, long r0, long nr, long c0, long nc,
+      char* buf, int to_file) {
+   long r, c, len, tile_bytes = f->tile_rows * f->tile_cols * f->esize;
+   char *tile_row, *mem;
+
+   for (r = r0; r < r0 + nr; r++) {
+      for (c = c0; c < c0 + nc; c += len) {
+         len = (c / f->tile_cols + 1) * f->tile_cols - c;
+         if (len > c0 + nc - c) len = c0 + nc - c;
+         tile_row = f->map + sizeof(matfile_header_t)
+                  + ((r / f->tile_rows) * f->tiles_across + c / f->tile_cols) * tile_bytes
+                  + ((r % f->tile_rows) * f->tile_cols + c % f->tile_cols) * f->esize;
+         mem = buf + ((r - r0) * nc + (c - c0)) * f->esize;
+         if (to_file) memcpy(tile_row, mem, len * f->esize);
+         else memcpy(mem, tile_row, len * f->esize);
+      }
+   }
+}  /* matfile_copy */
+
+/*------------------------------------------------------------------
+ * Function:     matfile_access
+ * Purpose:      Read or write a block; collective, every process must
+ *               call it, with nr or nc 0 if it has nothing to move
+ */
+static inline void matfile_access(matfile_t* f, long r0, long nr, long c0, long nc,
+      void* buf, int to_file) {
+   MPI_Datatype file_t, mem_t;
+
+   if (f->map != NULL) {
+      if (nr > 0 && nc > 0) matfile_copy(f, r0, nr, c0, nc, buf, to_file);
+      return;
+   }
+   if (nr > 0 && nc > 0) {
+      matfile_types(f, r0, nr, c0, nc, &file_t, &mem_t);
+      MPI_File_set_view(f->fh, 0, f->etype, file_t, "native", MPI_INFO_NULL);
+      if (to_file) MPI_File_write_at_all(f->fh, 0, buf, 1, mem_t, MPI_STATUS_IGNORE);
+      else MPI_File_read_at_all(f->fh, 0, buf, 1, mem_t, MPI_STATUS_IGNORE);
+      MPI_Type_free(&file_t);
+      MPI_Type_free(&mem_t);
+   } else {
+      MPI_File_set_view(f->fh, 0, f->etype, f->etype, "native", MPI_INFO_NULL);
+      if (to_file) MPI_File_write_at_all(f->fh, 0, buf, 0, f->etype, MPI_STATUS_IGNORE);
+      else MPI_File_read_at_all(f->fh, 0, buf, 0, f->etype, MPI_STATUS_IGNORE);
+   }
+}  /* matfile_access */
+
+static inline void matfile_read(matfile_t* f, long r0, long nr, long c0, long nc, void* buf) {
+   matfile_access(f, r0, nr, c0, nc, buf, 0);
+}  /* matfile_read */
+
+static inline void matfile_write(matfile_t* f, long r0, long nr, long c0, long nc, const void* buf) {
+   matfile_access(f, r0, nr, c0, nc, (void*) buf, 1);
+}  /* matfile_write */
+
+/*------------------------------------------------------------------
+ * Function:     matfile_close
+ * Purpose:      Flush and close (collective)
+ */
+static inline void matfile_close(matfile_t* f) {
+   if (f->map != NULL) {
+      msync(f->map, f->map_len, MS_SYNC);
+      munmap(f->map, f->map_len);
+      f->map = NULL;
+   }
+   MPI_File_close(&f->fh);
+}  /* matfile_close */
+
+#endif /* MATFILE_H */
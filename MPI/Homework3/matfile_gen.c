@@ -0,0 +1,78 @@
+/* File:     matfile_gen.c
+ * Purpose:  Write a test matrix file (see matfile.h) in parallel: every
+ *           process fills and writes its own block of rows.
+ *
+ * Usage:    mpirun -np <p> ./matfile_gen <file> <rows> <cols>
+ *               [tile_rows tile_cols] [double|int]
+ *
+ * Entry (i, j) is ((7*i + 3*j) % 11) - 5, so products of these matrices
+ * are exact in either type.
+ */
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matfile.h"
+
+#define BLOCK_LOW(id,p,n)   ((long)(id)*(n)/(p))
+#define TILE 256          /* default tile size */
+#define ENTRY(i,j)  (((7*(i) + 3*(j)) % 11) - 5)
+
+int main(int argc, char *argv[]) {
+    int nprocs, rank, type = MATFILE_DOUBLE, mapped;
+    long rows, cols, tile_rows = TILE, tile_cols = TILE, first, my_rows, i, j;
+    void* buf;
+    double start, elapsed;
+    matfile_t f;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if ((argc != 4 && argc != 6 && argc != 7)
+          || (rows = atol(argv[2])) < 1 || (cols = atol(argv[3])) < 1) {
+        if (rank == 0)
+            printf("usage: mpirun -np <p> %s <file> <rows> <cols> [tile_rows tile_cols] [double|int]\n", argv[0]);
+        MPI_Finalize();
+        exit(-1);
+    }
+    if (argc > 5) {
+        tile_rows = atol(argv[4]);
+        tile_cols = atol(argv[5]);
+    }
+    if (argc > 6 && strcmp(argv[6], "int") == 0) type = MATFILE_INT;
+    if (tile_rows < 1 || tile_cols < 1) {
+        if (rank == 0) printf("tile sizes must be positive\n");
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    first = BLOCK_LOW(rank, nprocs, rows);
+    my_rows = BLOCK_LOW(rank + 1, nprocs, rows) - first;
+    buf = malloc((my_rows * cols + 1) * (type == MATFILE_DOUBLE ? sizeof(double) : sizeof(int)));
+    for (i = 0; i < my_rows; i++) {
+        for (j = 0; j < cols; j++) {
+            if (type == MATFILE_DOUBLE) ((double*) buf)[i*cols + j] = ENTRY(first + i, j);
+            else ((int*) buf)[i*cols + j] = ENTRY(first + i, j);
+        }
+    }
+
+    start = MPI_Wtime();
+    if (matfile_create(MPI_COMM_WORLD, argv[1], type, rows, cols, tile_rows, tile_cols, &f) != 0) {
+        MPI_Finalize();
+        exit(-1);
+    }
+    mapped = (f.map != NULL);
+    matfile_write(&f, first, my_rows, 0, cols, buf);
+    matfile_close(&f);
+    elapsed = MPI_Wtime() - start;
+
+    if (rank == 0) {
+        printf("wrote %ld x %ld %s matrix in %ld x %ld tiles to %s: %.3f seconds%s\n",
+               rows, cols, type == MATFILE_DOUBLE ? "double" : "int", f.tile_rows, f.tile_cols,
+               argv[1], elapsed, mapped ? " (mmap)" : "");
+    }
+    free(buf);
+    MPI_Finalize();
+    return 0;
+}
@@ -13,6 +13,8 @@
 #include "mpi.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "gemm.h"
 
 #define ROWA 10                 /* number of rows in matrix A */
 #define COLA 10                 /* number of columns in matrix A */
@@ -31,7 +33,7 @@ int main (int argc, char *argv[]) {
         mtype,                 /* message type */
         rows,                  /* rows of matrix A sent to each worker */
 	averow, extra, offset, /* used to determine rows sent to each worker */
-        i, j, k,               /* misc */
+        i, j,                  /* misc */
         errorCode = 1;         /* error code initialized for MPI_Abort */
 
     double      a[ROWA][COLA],           /* matrix A to be multiplied */
@@ -137,14 +139,10 @@ int main (int argc, char *argv[]) {
         MPI_Recv(&a, rows*COLA, MPI_DOUBLE, MASTER, mtype, MPI_COMM_WORLD, &status);
         MPI_Recv(&b, COLA*COLB, MPI_DOUBLE, MASTER, mtype, MPI_COMM_WORLD, &status);
 
-        /* Each worker works on their matrix multiplication */
-        for (k = 0; k < COLB; k++){
-           for (i = 0; i < rows; i++) {
-               c[i][k] = 0.0;
-               for (j = 0; j < COLA; j++)
-                   c[i][k] = c[i][k] + a[i][j] * b[j][k];
-           }
-        }
+        /* Each worker works on their matrix multiplication with the
+         * blocked kernel from gemm.h */
+        memset(c, 0, sizeof(c));
+        gemm(rows, COLB, COLA, &a[0][0], COLA, &b[0][0], COLB, &c[0][0], COLB);
 
         /* Each worker sends the output back to master */
         mtype = FROM_WORKER;
@@ -0,0 +1,256 @@
+/******************************************************************************
+* FILE: matrix_multiplication_2d.c
+* DESCRIPTION:
+*   MPI Matrix Multiply on a 2D process grid - C Version
+*   C = A * B with A (M x K), B (K x N) and C (M x N) block-distributed
+*   over a pr x pc grid built with MPI_Cart_create.  Every rank creates
+*   its own blocks, so no rank ever holds a whole matrix: memory per rank
+*   is O(n^2/p) plus one panel of A and one of B.
+*
+*   summa:  for each panel of columns of A (and rows of B), the owners
+*           broadcast it along their process row (column), and every
+*           rank adds the panel product to its block of C.
+*   cannon: on a square grid, skew A and B once, then do q steps of
+*           multiply and shift A left and B up by one process.
+*
+* COMPILE: mpicc -O3 -fopenmp -o matrix_multiplication_2d matrix_multiplication_2d.c
+* RUN:     mpirun -np <p> ./matrix_multiplication_2d <M> <K> <N> [summa|cannon] [panel_width]
+******************************************************************************/
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gemm.h"
+
+#define MASTER 0                /* taskid of first task */
+#define PANEL 64                /* default SUMMA panel width */
+#define CHECKS 16               /* entries of C checked per rank */
+#define BLOCK_LOW(id,p,n)   ((long)(id)*(n)/(p))
+#define BLOCK_HIGH(id,p,n)  (BLOCK_LOW((id)+1,p,n)-1)
+#define BLOCK_SIZE(id,p,n)  (BLOCK_HIGH(id,p,n)-BLOCK_LOW(id,p,n)+1)
+#define BLOCK_OWNER(j,p,n)  ((int)(((long)(p)*((j)+1)-1)/(n)))
+
+/* Entries of the test matrices, small integers so the products are exact */
+#define A_ENTRY(i,j) ((double)(((i) + 2*(j)) % 7 - 3))
+#define B_ENTRY(i,j) ((double)(((3*(i)) + (j)) % 5 - 2))
+
+/*------------------------------------------------------------------
+ * Function:     summa
+ * Purpose:      C += A * B with the SUMMA algorithm
+ * Input args:   grid coordinates, row and column communicators, sizes,
+ *               local blocks a (my_m x my_k) and b (my_kb x my_n),
+ *               panel width
+ * In/out args:  c:  local block of C (my_m x my_n)
+ * Note:         The K dimension is split over pc for A and over pr for
+ *               B, so a panel never crosses a block boundary of either.
+ */
+void summa(int pr, int pc, int row, int col, MPI_Comm row_comm, MPI_Comm col_comm,
+           int M, int K, int N, const double* a, const double* b, double* c, int panel) {
+    int my_m = BLOCK_SIZE(row, pr, M), my_n = BLOCK_SIZE(col, pc, N);
+    int my_k = BLOCK_SIZE(col, pc, K);
+    int k0, w, a_owner, b_owner, i;
+    long end;
+    double* a_panel = malloc((size_t) my_m * panel * sizeof(double));
+    double* b_panel = malloc((size_t) panel * my_n * sizeof(double));
+
+    for (k0 = 0; k0 < K; k0 += w) {
+        a_owner = BLOCK_OWNER(k0, pc, K);
+        b_owner = BLOCK_OWNER(k0, pr, K);
+        end = k0 + panel;
+        if (BLOCK_HIGH(a_owner, pc, K) + 1 < end) end = BLOCK_HIGH(a_owner, pc, K) + 1;
+        if (BLOCK_HIGH(b_owner, pr, K) + 1 < end) end = BLOCK_HIGH(b_owner, pr, K) + 1;
+        w = (int)(end - k0);
+
+        /* Owner of these columns of A packs them; broadcast along my row */
+        if (col == a_owner) {
+            for (i = 0; i < my_m; i++)
+                memcpy(&a_panel[(long)i*w], &a[(long)i*my_k + (k0 - BLOCK_LOW(col, pc, K))], w * sizeof(double));
+        }
+        MPI_Bcast(a_panel, my_m * w, MPI_DOUBLE, a_owner, row_comm);
+
+        /* Owner of these rows of B sends them down my column; they are
+         * already contiguous */
+        if (row == b_owner) {
+            memcpy(b_panel, &b[(long)(k0 - BLOCK_LOW(row, pr, K)) * my_n], (size_t) w * my_n * sizeof(double));
+        }
+        MPI_Bcast(b_panel, w * my_n, MPI_DOUBLE, b_owner, col_comm);
+
+        gemm(my_m, my_n, w, a_panel, w, b_panel, my_n, c, my_n);
+    }
+    free(a_panel);
+    free(b_panel);
+}  /* summa */
+
+/*------------------------------------------------------------------
+ * Function:     cannon
+ * Purpose:      C += A * B with Cannon's algorithm on a q x q grid
+ * Input args:   grid communicator and coordinates, sizes, local blocks
+ *               a (my_m x my_k) and b (my_kb x my_n)
+ * In/out args:  c:  local block of C
+ * Note:         K blocks differ in size by at most one, so blocks are
+ *               shifted through buffers sized for the largest one.
+ */
+void cannon(int q, int row, int col, MPI_Comm grid_comm,
+            int M, int K, int N, const double* a, const double* b, double* c) {
+    int my_m = BLOCK_SIZE(row, q, M), my_n = BLOCK_SIZE(col, q, N);
+    int max_k = BLOCK_SIZE(0, q, K) > BLOCK_SIZE(q-1, q, K) ? BLOCK_SIZE(0, q, K) : BLOCK_SIZE(q-1, q, K);
+    int step, kb, src, dest, next_kb, left, right, up, down;
+    double* a_cur = malloc((size_t) my_m * max_k * sizeof(double));
+    double* a_tmp = malloc((size_t) my_m * max_k * sizeof(double));
+    double* b_cur = malloc((size_t) max_k * my_n * sizeof(double));
+    double* b_tmp = malloc((size_t) max_k * my_n * sizeof(double));
+    double* swap;
+
+    /* Initial skew: row r of A moves r places left, column c of B moves
+     * c places up, so I hold A(row, kb) and B(kb, col) with kb = row+col */
+    kb = (row + col) % q;
+    MPI_Cart_shift(grid_comm, 1, -row, &src, &dest);
+    MPI_Sendrecv(a, my_m * BLOCK_SIZE(col, q, K), MPI_DOUBLE, dest, 0,
+                 a_cur, my_m * BLOCK_SIZE(kb, q, K), MPI_DOUBLE, src, 0, grid_comm, MPI_STATUS_IGNORE);
+    MPI_Cart_shift(grid_comm, 0, -col, &src, &dest);
+    MPI_Sendrecv(b, BLOCK_SIZE(row, q, K) * my_n, MPI_DOUBLE, dest, 1,
+                 b_cur, BLOCK_SIZE(kb, q, K) * my_n, MPI_DOUBLE, src, 1, grid_comm, MPI_STATUS_IGNORE);
+
+    MPI_Cart_shift(grid_comm, 1, -1, &right, &left);
+    MPI_Cart_shift(grid_comm, 0, -1, &down, &up);
+    for (step = 0; step < q; step++) {
+        gemm(my_m, my_n, BLOCK_SIZE(kb, q, K), a_cur, BLOCK_SIZE(kb, q, K),
+                   b_cur, my_n, c, my_n);
+        if (step == q - 1) break;
+
+        /* Shift A one left and B one up; the new blocks are kb+1 */
+        next_kb = (kb + 1) % q;
+        MPI_Sendrecv(a_cur, my_m * BLOCK_SIZE(kb, q, K), MPI_DOUBLE, left, 2,
+                     a_tmp, my_m * BLOCK_SIZE(next_kb, q, K), MPI_DOUBLE, right, 2, grid_comm, MPI_STATUS_IGNORE);
+        MPI_Sendrecv(b_cur, BLOCK_SIZE(kb, q, K) * my_n, MPI_DOUBLE, up, 3,
+                     b_tmp, BLOCK_SIZE(next_kb, q, K) * my_n, MPI_DOUBLE, down, 3, grid_comm, MPI_STATUS_IGNORE);
+        swap = a_cur; a_cur = a_tmp; a_tmp = swap;
+        swap = b_cur; b_cur = b_tmp; b_tmp = swap;
+        kb = next_kb;
+    }
+    free(a_cur); free(a_tmp);
+    free(b_cur); free(b_tmp);
+}  /* cannon */
+
+int main (int argc, char *argv[]) {
+
+    int numtasks,              /* number of tasks in partition */
+        taskid,                /* a task identifier */
+        dims[2] = {0, 0},      /* process grid pr x pc */
+        periods[2] = {1, 1},   /* wrap around, for Cannon's shifts */
+        coords[2],             /* my row and column in the grid */
+        keep[2],               /* dimensions kept by MPI_Cart_sub */
+        M, K, N,               /* matrix sizes */
+        panel = PANEL,         /* SUMMA panel width */
+        use_cannon = 0,
+        my_m, my_n, my_k, my_kb,
+        i, j, t,
+        errorCode = 1;         /* error code initialized for MPI_Abort */
+    long gi, gj, p;
+    double *a, *b, *c;         /* local blocks of A, B and C */
+    double start_time, elapsed, max_time, expected, my_err = 0.0, max_err;
+    MPI_Comm grid_comm, row_comm, col_comm;
+
+    /* Initializing MPI execution environment */
+    MPI_Init(&argc,&argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &taskid);
+    MPI_Comm_size(MPI_COMM_WORLD, &numtasks);
+
+    if (argc < 4 || argc > 6) {
+        if (taskid == MASTER)
+            printf("usage: mpirun -np <p> ./matrix_multiplication_2d <M> <K> <N> [summa|cannon] [panel_width]\n");
+        MPI_Finalize();
+        exit(1);
+    }
+    M = atoi(argv[1]);
+    K = atoi(argv[2]);
+    N = atoi(argv[3]);
+    if (argc > 4) use_cannon = (strcmp(argv[4], "cannon") == 0);
+    if (argc > 5) panel = atoi(argv[5]);
+    if (M < 1 || K < 1 || N < 1 || panel < 1) {
+        if (taskid == MASTER) printf("Sizes and panel width must be positive. Quitting...\n");
+        MPI_Finalize();
+        exit(1);
+    }
+
+    /* Build the process grid and its row and column communicators */
+    MPI_Dims_create(numtasks, 2, dims);
+    if (use_cannon && dims[0] != dims[1]) {
+        if (taskid == MASTER)
+            printf("Cannon's algorithm needs a square number of processes (got %d). Quitting...\n", numtasks);
+        MPI_Abort(MPI_COMM_WORLD, errorCode);
+    }
+    if (dims[0] > M || dims[0] > K || dims[1] > N || dims[1] > K) {
+        if (taskid == MASTER)
+            printf("Matrices too small for a %d x %d grid. Quitting...\n", dims[0], dims[1]);
+        MPI_Abort(MPI_COMM_WORLD, errorCode);
+    }
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 1, &grid_comm);
+    MPI_Comm_rank(grid_comm, &taskid);
+    MPI_Cart_coords(grid_comm, taskid, 2, coords);
+    keep[0] = 0; keep[1] = 1;
+    MPI_Cart_sub(grid_comm, keep, &row_comm);
+    keep[0] = 1; keep[1] = 0;
+    MPI_Cart_sub(grid_comm, keep, &col_comm);
+
+    /* Each rank creates its own blocks: A(rows of my row, K cols of my
+     * column), B(K rows of my row, cols of my column) */
+    my_m = BLOCK_SIZE(coords[0], dims[0], M);
+    my_n = BLOCK_SIZE(coords[1], dims[1], N);
+    my_k = BLOCK_SIZE(coords[1], dims[1], K);
+    my_kb = BLOCK_SIZE(coords[0], dims[0], K);
+    a = malloc((size_t) my_m * my_k * sizeof(double));
+    b = malloc((size_t) my_kb * my_n * sizeof(double));
+    c = calloc((size_t) my_m * my_n, sizeof(double));
+    if (a == NULL || b == NULL || c == NULL) {
+        printf("Task %d: out of memory. Quitting...\n", taskid);
+        MPI_Abort(MPI_COMM_WORLD, errorCode);
+    }
+    for (i = 0; i < my_m; i++)
+        for (j = 0; j < my_k; j++)
+            a[(long)i*my_k + j] = A_ENTRY(BLOCK_LOW(coords[0], dims[0], M) + i, BLOCK_LOW(coords[1], dims[1], K) + j);
+    for (i = 0; i < my_kb; i++)
+        for (j = 0; j < my_n; j++)
+            b[(long)i*my_n + j] = B_ENTRY(BLOCK_LOW(coords[0], dims[0], K) + i, BLOCK_LOW(coords[1], dims[1], N) + j);
+
+    MPI_Barrier(grid_comm);
+    start_time = MPI_Wtime();
+    if (use_cannon)
+        cannon(dims[0], coords[0], coords[1], grid_comm, M, K, N, a, b, c);
+    else
+        summa(dims[0], dims[1], coords[0], coords[1], row_comm, col_comm, M, K, N, a, b, c, panel);
+    elapsed = MPI_Wtime() - start_time;
+    MPI_Reduce(&elapsed, &max_time, 1, MPI_DOUBLE, MPI_MAX, MASTER, grid_comm);
+
+    /* Check a few entries of my block against the definition */
+    for (t = 0; t < CHECKS && my_m > 0 && my_n > 0; t++) {
+        i = (t * 7919) % my_m;
+        j = (t * 104729) % my_n;
+        gi = BLOCK_LOW(coords[0], dims[0], M) + i;
+        gj = BLOCK_LOW(coords[1], dims[1], N) + j;
+        expected = 0.0;
+        for (p = 0; p < K; p++)
+            expected += A_ENTRY(gi, p) * B_ENTRY(p, gj);
+        if (fabs(c[(long)i*my_n + j] - expected) > my_err)
+            my_err = fabs(c[(long)i*my_n + j] - expected);
+    }
+    MPI_Reduce(&my_err, &max_err, 1, MPI_DOUBLE, MPI_MAX, MASTER, grid_comm);
+
+    if (taskid == MASTER) {
+        printf("%s: %d x %d times %d x %d on a %d x %d grid\n", use_cannon ? "Cannon" : "SUMMA",
+               M, K, K, N, dims[0], dims[1]);
+        printf("Time %.6f s, %.3f GFLOP/s, max error in checked entries %g\n",
+               max_time, 2.0 * M * N * K / max_time * 1e-9, max_err);
+    }
+
+    free(a); free(b); free(c);
+    MPI_Comm_free(&row_comm);
+    MPI_Comm_free(&col_comm);
+    MPI_Comm_free(&grid_comm);
+
+    /* Terminate MPI environment */
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,145 @@
+/******************************************************************************
+* FILE: matrix_multiplication_dynamic.c
+* DESCRIPTION:
+*   MPI Matrix Multiply with self-scheduling.  Like matrix_multiplication.c
+*   the master owns A and C, but instead of one slab of rows per worker
+*   the workers keep asking for small blocks of rows of A until none are
+*   left (see self_schedule.h), so slower or busier nodes do less of the
+*   work.  B is broadcast once.
+*
+*   usage: mpirun -np <p> ./matrix_multiplication_dynamic <ROWA> <COLA> <COLB>
+*              [chunk] [dynamic|guided] [master_computes 0|1]
+*
+*   chunk is the number of rows per block (the smallest block for guided
+*   scheduling, whose blocks start at half the remaining rows per worker
+*   and shrink).  With master_computes the master also multiplies blocks
+*   while no worker is waiting for one.
+******************************************************************************/
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gemm.h"
+#include "self_schedule.h"
+
+#define MASTER 0                /* taskid of first task */
+#define CHUNK 16                /* default rows per block */
+
+/* Test matrices: small integers, so C is exact and easy to check */
+#define A_ENTRY(i,j)  ((double)(((i) + 2*(j)) % 7 - 3))
+#define B_ENTRY(i,j)  ((double)((3*(i) + (j)) % 5 - 2))
+
+typedef struct {
+    int cola, colb;
+    const double* b;
+} mm_ctx_t;
+
+/*------------------------------------------------------------------
+ * Function:     mm_block
+ * Purpose:      Multiply a block of rows of A by B
+ */
+void mm_block(void* ctx, int rows, const void* in, void* out) {
+    mm_ctx_t* mm = ctx;
+
+    memset(out, 0, (size_t) rows * mm->colb * sizeof(double));
+    gemm(rows, mm->colb, mm->cola, in, mm->cola, mm->b, mm->colb, out, mm->colb);
+}  /* mm_block */
+
+int main (int argc, char *argv[]) {
+
+    int numtasks,              /* number of tasks in partition */
+        taskid,                /* a task identifier */
+        rowa, cola, colb,      /* matrix sizes */
+        i, j, k;               /* misc */
+    long* rows_done = NULL;    /* rows multiplied by each task */
+    double *a = NULL, *b, *c = NULL;
+    double start, elapsed, expect, max_err = 0.0;
+    sched_opts_t opts = {CHUNK, 0, 0};
+    sched_rows_t in, out;
+    mm_ctx_t mm;
+
+    /* Initializing MPI execution environment */
+    MPI_Init(&argc,&argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &taskid);
+    MPI_Comm_size(MPI_COMM_WORLD, &numtasks);
+
+    if (argc < 4 || argc > 7) {
+        if (taskid == MASTER)
+            printf("usage: mpirun -np <p> %s <ROWA> <COLA> <COLB> [chunk] [dynamic|guided] [master_computes 0|1]\n", argv[0]);
+        MPI_Finalize();
+        exit(-1);
+    }
+    rowa = atoi(argv[1]);
+    cola = atoi(argv[2]);
+    colb = atoi(argv[3]);
+    if (argc > 4) opts.chunk = atoi(argv[4]);
+    if (argc > 5) opts.guided = (strcmp(argv[5], "guided") == 0);
+    if (argc > 6) opts.master_computes = atoi(argv[6]);
+    if (rowa < 1 || cola < 1 || colb < 1 || opts.chunk < 1) {
+        if (taskid == MASTER) printf("matrix sizes and chunk must be positive\n");
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    mm.cola = cola;
+    mm.colb = colb;
+    in.type = MPI_DOUBLE;  in.size = sizeof(double);  in.width = cola;
+    out.type = MPI_DOUBLE; out.size = sizeof(double); out.width = colb;
+
+    /* Every task needs all of B */
+    b = malloc((size_t) cola * colb * sizeof(double));
+    if (taskid == MASTER) {
+        a = malloc((size_t) rowa * cola * sizeof(double));
+        c = malloc((size_t) rowa * colb * sizeof(double));
+        rows_done = malloc(numtasks * sizeof(long));
+        for (i = 0; i < rowa; i++)
+            for (j = 0; j < cola; j++)
+                a[(size_t) i*cola + j] = A_ENTRY(i, j);
+        for (i = 0; i < cola; i++)
+            for (j = 0; j < colb; j++)
+                b[(size_t) i*colb + j] = B_ENTRY(i, j);
+    }
+    mm.b = b;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    MPI_Bcast(b, cola * colb, MPI_DOUBLE, MASTER, MPI_COMM_WORLD);
+
+    /**************************** master task ************************************/
+    if (taskid == MASTER) {
+        sched_master(MPI_COMM_WORLD, rowa, &opts, &in, a, &out, c, mm_block, &mm, rows_done);
+        elapsed = MPI_Wtime() - start;
+
+        /* Check a row and a column at each end against the formula */
+        for (i = 0; i < rowa; i++) {
+            for (j = 0; j < colb; j++) {
+                if (i != 0 && i != rowa - 1 && j != 0 && j != colb - 1) continue;
+                expect = 0.0;
+                for (k = 0; k < cola; k++) expect += A_ENTRY(i, k) * B_ENTRY(k, j);
+                if (fabs(c[(size_t) i*colb + j] - expect) > max_err)
+                    max_err = fabs(c[(size_t) i*colb + j] - expect);
+            }
+        }
+
+        printf("%s scheduling, chunk %d, master %s\n", opts.guided ? "guided" : "dynamic",
+               opts.chunk, opts.master_computes ? "computes" : "only schedules");
+        for (i = 0; i < numtasks; i++)
+            printf("task %d multiplied %ld rows\n", i, rows_done[i]);
+        printf("C = A*B with A %dx%d, B %dx%d: %.6f seconds, %.2f GFLOP/s, max error %g\n",
+               rowa, cola, cola, colb, elapsed, 2.0 * rowa * cola * colb / elapsed * 1e-9, max_err);
+        free(a);
+        free(c);
+        free(rows_done);
+    }
+
+    /**************************** worker task ************************************/
+    if (taskid > MASTER)
+        sched_worker(MPI_COMM_WORLD, &in, &out, mm_block, &mm);
+
+    free(b);
+    /* Terminate MPI environment */
+    MPI_Finalize();
+    return 0;
+}
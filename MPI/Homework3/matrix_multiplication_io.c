@@ -0,0 +1,112 @@
+/******************************************************************************
+* FILE: matrix_multiplication_io.c
+* DESCRIPTION:
+*   MPI Matrix Multiply C = A*B with the matrices in files (see matfile.h).
+*   In matrix_multiplication.c the master builds A and B, sends every row
+*   out and gathers all of C back; here every task reads its own block of
+*   rows of A and all of B straight from the files with collective MPI-IO
+*   (or mmap on a single node), multiplies with gemm, and writes its rows
+*   of C to the output file, so nothing goes through one task.
+*
+*   usage: mpirun -np <p> ./matrix_multiplication_io <A.mat> <B.mat> <C.mat>
+*              [tile_rows tile_cols]
+*
+*   C gets the tile size of A unless one is given.  Make inputs with
+*   matfile_gen.
+******************************************************************************/
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gemm.h"
+#include "matfile.h"
+
+#define MASTER 0
+#define BLOCK_LOW(id,p,n)   ((long)(id)*(n)/(p))
+
+int main (int argc, char *argv[]) {
+
+    int numtasks, taskid, mapped;
+    long rowa, cola, colb, first, rows, tile_rows, tile_cols;
+    double *a, *b, *c;
+    double t0, t1, t2, t3, times[3], max_times[3];
+    matfile_t fa, fb, fc;
+
+    MPI_Init(&argc,&argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &taskid);
+    MPI_Comm_size(MPI_COMM_WORLD, &numtasks);
+
+    if (argc != 4 && argc != 6) {
+        if (taskid == MASTER)
+            printf("usage: mpirun -np <p> %s <A.mat> <B.mat> <C.mat> [tile_rows tile_cols]\n", argv[0]);
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    t0 = MPI_Wtime();
+    if (matfile_open(MPI_COMM_WORLD, argv[1], MPI_MODE_RDONLY, &fa) != 0) {
+        MPI_Finalize();
+        exit(-1);
+    }
+    if (matfile_open(MPI_COMM_WORLD, argv[2], MPI_MODE_RDONLY, &fb) != 0) {
+        matfile_close(&fa);
+        MPI_Finalize();
+        exit(-1);
+    }
+    if (fa.type != MATFILE_DOUBLE || fb.type != MATFILE_DOUBLE || fa.cols != fb.rows) {
+        if (taskid == MASTER)
+            printf("A and B must be double matrices with A's columns equal to B's rows\n");
+        matfile_close(&fa);
+        matfile_close(&fb);
+        MPI_Finalize();
+        exit(-1);
+    }
+    rowa = fa.rows;
+    cola = fa.cols;
+    colb = fb.cols;
+    tile_rows = (argc == 6) ? atol(argv[4]) : fa.tile_rows;
+    tile_cols = (argc == 6) ? atol(argv[5]) : fa.tile_cols;
+
+    /* My rows of A and C; every task needs all of B */
+    first = BLOCK_LOW(taskid, numtasks, rowa);
+    rows = BLOCK_LOW(taskid + 1, numtasks, rowa) - first;
+    a = malloc((rows * cola + 1) * sizeof(double));
+    b = malloc(cola * colb * sizeof(double));
+    c = calloc(rows * colb + 1, sizeof(double));
+    mapped = (fa.map != NULL);
+    matfile_read(&fa, first, rows, 0, cola, a);
+    matfile_read(&fb, 0, cola, 0, colb, b);
+    matfile_close(&fa);
+    matfile_close(&fb);
+    t1 = MPI_Wtime();
+
+    gemm((int) rows, (int) colb, (int) cola, a, (int) cola, b, (int) colb, c, (int) colb);
+    t2 = MPI_Wtime();
+
+    if (matfile_create(MPI_COMM_WORLD, argv[3], MATFILE_DOUBLE, rowa, colb, tile_rows, tile_cols, &fc) != 0) {
+        MPI_Finalize();
+        exit(-1);
+    }
+    matfile_write(&fc, first, rows, 0, colb, c);
+    matfile_close(&fc);
+    t3 = MPI_Wtime();
+
+    times[0] = t1 - t0;
+    times[1] = t2 - t1;
+    times[2] = t3 - t2;
+    MPI_Reduce(times, max_times, 3, MPI_DOUBLE, MPI_MAX, MASTER, MPI_COMM_WORLD);
+    if (taskid == MASTER) {
+        printf("C = A*B with A %ldx%ld, B %ldx%ld on %d tasks%s\n", rowa, cola, cola, colb,
+               numtasks, mapped ? " (mmap)" : " (MPI-IO)");
+        printf("read %.6f s (%.2f GB/s), multiply %.6f s (%.2f GFLOP/s), write %.6f s\n",
+               max_times[0], (rowa * cola + (double) numtasks * cola * colb) * sizeof(double) / max_times[0] * 1e-9,
+               max_times[1], 2.0 * rowa * cola * colb / max_times[1] * 1e-9, max_times[2]);
+    }
+
+    free(a);
+    free(b);
+    free(c);
+    MPI_Finalize();
+    return 0;
+}
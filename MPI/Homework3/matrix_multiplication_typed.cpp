@@ -0,0 +1,124 @@
+/******************************************************************************
+* FILE: matrix_multiplication_typed.cpp
+* DESCRIPTION:
+*   MPI Matrix Multiply C = A*B for any element type with the kernels of
+*   kernels.hpp.  Rows of A are scattered with MPI_Scatterv, B is
+*   broadcast, every task runs kern::gemm on its rows and C is gathered
+*   with MPI_Gatherv; unlike matrix_multiplication.c the sizes come from
+*   the command line and the master also works.
+*
+*   usage: mpirun -np <p> ./matrix_multiplication_typed <int|float|double>
+*              <ROWA> <COLA> <COLB>
+*
+*   Entries are small integers (|A*B term| <= 6), so every partial sum
+*   is an integer of magnitude at most 6*COLA and C is exact, whatever
+*   the order of the sums, while that fits the type: COLA up to about
+*   2.8 million (2^24/6) for float, 350 million for int and any size
+*   for double.  Larger float runs report wrong entries from rounding.
+******************************************************************************/
+
+#include "mpi.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "kernels.hpp"
+
+#define MASTER 0
+#define CHECKS 16                 /* entries of C checked per task */
+#define BLOCK_LOW(id,p,n)   ((long)(id)*(n)/(p))
+#define A_ENTRY(i,j)  (((i) + 2*(j)) % 7 - 3)
+#define B_ENTRY(i,j)  ((3*(i) + (j)) % 5 - 2)
+
+template <typename T>
+void run(long rowa, long cola, long colb) {
+    int numtasks, taskid, q, errors = 0;
+    double start, t_comm, t_comp, times[2], max_times[2];
+    MPI_Datatype type = kern::mpi_type<T>::get();
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &taskid);
+    MPI_Comm_size(MPI_COMM_WORLD, &numtasks);
+
+    std::vector<int> acounts(numtasks), adispls(numtasks), ccounts(numtasks), cdispls(numtasks);
+    for (q = 0; q < numtasks; q++) {
+        long first = BLOCK_LOW(q, numtasks, rowa), rows = BLOCK_LOW(q + 1, numtasks, rowa) - first;
+        acounts[q] = (int)(rows * cola);
+        adispls[q] = (int)(first * cola);
+        ccounts[q] = (int)(rows * colb);
+        cdispls[q] = (int)(first * colb);
+    }
+    long rows = acounts[taskid] / cola;
+
+    std::vector<T> a, c, b(cola * colb), local_a(rows * cola + 1), local_c(rows * colb + 1, T(0));
+    if (taskid == MASTER) {
+        a.resize(rowa * cola);
+        c.resize(rowa * colb);
+        for (long i = 0; i < rowa; i++)
+            for (long j = 0; j < cola; j++) a[i*cola + j] = T(A_ENTRY(i, j));
+        for (long i = 0; i < cola; i++)
+            for (long j = 0; j < colb; j++) b[i*colb + j] = T(B_ENTRY(i, j));
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    MPI_Bcast(b.data(), (int)(cola * colb), type, MASTER, MPI_COMM_WORLD);
+    MPI_Scatterv(a.data(), acounts.data(), adispls.data(), type,
+                 local_a.data(), acounts[taskid], type, MASTER, MPI_COMM_WORLD);
+    t_comm = MPI_Wtime() - start;
+
+    start = MPI_Wtime();
+    kern::gemm((int) rows, (int) colb, (int) cola, local_a.data(), cola, b.data(), colb,
+               local_c.data(), colb);
+    t_comp = MPI_Wtime() - start;
+
+    start = MPI_Wtime();
+    MPI_Gatherv(local_c.data(), ccounts[taskid], type, c.data(), ccounts.data(), cdispls.data(),
+                type, MASTER, MPI_COMM_WORLD);
+    t_comm += MPI_Wtime() - start;
+
+    times[0] = t_comm;
+    times[1] = t_comp;
+    MPI_Reduce(times, max_times, 2, MPI_DOUBLE, MPI_MAX, MASTER, MPI_COMM_WORLD);
+
+    if (taskid == MASTER) {
+        /* Check a spread of entries in every task's rows */
+        for (q = 0; q < numtasks; q++) {
+            long first = cdispls[q] / colb, nrows = ccounts[q] / colb;
+            for (int s = 0; s < CHECKS && nrows > 0; s++) {
+                long i = first + (s * 7919L) % nrows, j = (s * 104729L) % colb, expect = 0;
+                for (long k = 0; k < cola; k++) expect += (long) A_ENTRY(i, k) * B_ENTRY(k, j);
+                if (c[i*colb + j] != T(expect)) errors++;
+            }
+        }
+        printf("%s: C = A*B with A %ldx%ld, B %ldx%ld on %d tasks, %d wrong entries\n",
+               kern::mpi_type<T>::name(), rowa, cola, cola, colb, numtasks, errors);
+        printf("communication %.6f s for %.1f MiB, gemm %.6f s, %.2f GFLOP/s\n", max_times[0],
+               (rowa * cola + numtasks * cola * colb + rowa * colb) * sizeof(T) / 1048576.0,
+               max_times[1], 2.0 * rowa * cola * colb / max_times[1] * 1e-9);
+    }
+}  /* run */
+
+int main (int argc, char *argv[]) {
+    int taskid;
+    long rowa, cola, colb;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &taskid);
+
+    if (argc != 5 || (rowa = atol(argv[2])) < 1 || (cola = atol(argv[3])) < 1
+          || (colb = atol(argv[4])) < 1
+          || (strcmp(argv[1], "int") != 0 && strcmp(argv[1], "float") != 0
+              && strcmp(argv[1], "double") != 0)) {
+        if (taskid == MASTER)
+            printf("usage: mpirun -np <p> %s <int|float|double> <ROWA> <COLA> <COLB>\n", argv[0]);
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    if (strcmp(argv[1], "int") == 0) run<int>(rowa, cola, colb);
+    else if (strcmp(argv[1], "float") == 0) run<float>(rowa, cola, colb);
+    else if (strcmp(argv[1], "double") == 0) run<double>(rowa, cola, colb);
+
+    MPI_Finalize();
+    return 0;
+}
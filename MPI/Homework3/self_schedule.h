@@ -0,0 +1,188 @@
+/* File:     self_schedule.h
+ * Purpose:  Master/worker self-scheduling of row blocks.  Instead of
+ *           one slab of averow/extra rows per worker handed out up
+ *           front, workers ask for a small block of rows whenever they
+ *           finish one, and the master answers requests in the order
+ *           they complete, so a slow node simply ends up doing fewer
+ *           blocks.
+ *
+ * Usage:    rank 0:  sched_master(comm, total_rows, &opts, &in, in_base,
+ *                          &out, out_base, compute, ctx, rows_done);
+ *           others:  sched_worker(comm, &in, &out, compute, ctx);
+ *
+ * Protocol: A worker sends {offset, rows} of the block it just finished
+ *           (rows = 0 on its first request) followed by the result rows,
+ *           and gets back {offset, rows} of its next block followed by
+ *           the input rows; rows = 0 means stop.  The master keeps one
+ *           MPI_Irecv posted per worker and serves them as they
+ *           complete (MPI_Waitsome, or MPI_Testsome when it also
+ *           computes blocks itself between requests).
+ *
+ *           Data that every block needs (B, the vector) is not part of
+ *           the protocol: broadcast it before starting.
+ */
+#ifndef SELF_SCHEDULE_H
+#define SELF_SCHEDULE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "mpi.h"
+
+#define SCHED_MASTER  0
+#define TAG_REQUEST   11   /* worker -> master: finished block header */
+#define TAG_RESULT    12   /* worker -> master: result rows */
+#define TAG_ASSIGN    13   /* master -> worker: next block header */
+#define TAG_DATA      14   /* master -> worker: input rows */
+
+/* Compute the result rows of a block from its input rows */
+typedef void (*sched_compute_fn)(void* ctx, int rows, const void* in, void* out);
+
+typedef struct {
+   int chunk;             /* rows per block; smallest block when guided */
+   int guided;            /* start with big blocks and shrink them */
+   int master_computes;   /* master does blocks while nobody is asking */
+} sched_opts_t;
+
+typedef struct {
+   MPI_Datatype type;     /* element type */
+   int          size;     /* bytes per element */
+   int          width;    /* elements per row */
+} sched_rows_t;
+
+/*------------------------------------------------------------------
+ * Function:     sched_block_size
+ * Purpose:      Size of the next block: chunk, or for guided
+ *               scheduling half the remaining rows per worker, but
+ *               never less than chunk
+ */
+static long sched_block_size(const sched_opts_t* opts, long remaining,
+      int nworkers) {
+   long rows = opts->chunk;
+
+   if (opts->guided && remaining / (2L * nworkers) > rows)
+      rows = remaining / (2L * nworkers);
+   return (rows < remaining) ? rows : remaining;
+}  /* sched_block_size */
+
+/*------------------------------------------------------------------
+ * Function:     sched_master
+ * Purpose:      Hand out all total_rows rows and collect the results
+ * Input args:   comm:        communicator, master is rank 0
+ *               total_rows:  rows to process
+ *               opts:        scheduling options
+ *               in, in_base: description and storage of input rows
+ *               out:         description of result rows
+ *               compute, ctx:  used when the master computes blocks
+ * Output args:  out_base:    storage for all result rows
+ *               rows_done:   rows processed by each rank (may be NULL)
+ */
+static void sched_master(MPI_Comm comm, long total_rows,
+      const sched_opts_t* opts, const sched_rows_t* in, const void* in_base,
+      const sched_rows_t* out, void* out_base, sched_compute_fn compute,
+      void* ctx, long* rows_done) {
+   const char* in_bytes = in_base;
+   char* out_bytes = out_base;
+   long in_row = (long) in->size * in->width;
+   long out_row = (long) out->size * out->width;
+   long next = 0, block[2], (*hdr)[2];
+   int nprocs, nworkers, active, ndone, d, idx, w, rows;
+   int* done;
+   MPI_Request* req;
+
+   MPI_Comm_size(comm, &nprocs);
+   nworkers = nprocs - 1;
+   if (rows_done != NULL) memset(rows_done, 0, nprocs * sizeof(long));
+
+   /* Alone: do everything */
+   if (nworkers == 0) {
+      compute(ctx, (int) total_rows, in_bytes, out_bytes);
+      if (rows_done != NULL) rows_done[SCHED_MASTER] = total_rows;
+      return;
+   }
+
+   hdr = malloc(nworkers * sizeof(*hdr));
+   req = malloc(nworkers * sizeof(MPI_Request));
+   done = malloc(nworkers * sizeof(int));
+   for (w = 0; w < nworkers; w++)
+      MPI_Irecv(hdr[w], 2, MPI_LONG, w + 1, TAG_REQUEST, comm, &req[w]);
+
+   active = nworkers;
+   while (active > 0) {
+      if (opts->master_computes && next < total_rows) {
+         MPI_Testsome(nworkers, req, &ndone, done, MPI_STATUSES_IGNORE);
+         if (ndone == 0) {
+            /* Nobody is waiting: take the smallest block myself */
+            rows = (int)((opts->chunk < total_rows - next) ? opts->chunk : total_rows - next);
+            compute(ctx, rows, in_bytes + next * in_row, out_bytes + next * out_row);
+            if (rows_done != NULL) rows_done[SCHED_MASTER] += rows;
+            next += rows;
+            continue;
+         }
+      } else {
+         MPI_Waitsome(nworkers, req, &ndone, done, MPI_STATUSES_IGNORE);
+      }
+
+      /* Serve every request that has arrived: answering only the first
+       * one, as MPI_Waitany does, lets a fast low rank starve the rest */
+      for (d = 0; d < ndone; d++) {
+         idx = done[d];
+         w = idx + 1;
+
+         /* Collect the block this worker just finished */
+         if (hdr[idx][1] > 0) {
+            MPI_Recv(out_bytes + hdr[idx][0] * out_row, (int)(hdr[idx][1] * out->width), out->type,
+                  w, TAG_RESULT, comm, MPI_STATUS_IGNORE);
+            if (rows_done != NULL) rows_done[w] += hdr[idx][1];
+         }
+
+         /* Give it the next one, or tell it to stop */
+         block[0] = next;
+         block[1] = sched_block_size(opts, total_rows - next, nworkers);
+         MPI_Send(block, 2, MPI_LONG, w, TAG_ASSIGN, comm);
+         if (block[1] > 0) {
+            MPI_Send(in_bytes + next * in_row, (int)(block[1] * in->width), in->type,
+                  w, TAG_DATA, comm);
+            next += block[1];
+            MPI_Irecv(hdr[idx], 2, MPI_LONG, w, TAG_REQUEST, comm, &req[idx]);
+         } else {
+            active--;
+         }
+      }
+   }
+   free(hdr);
+   free(req);
+   free(done);
+}  /* sched_master */
+
+/*------------------------------------------------------------------
+ * Function:     sched_worker
+ * Purpose:      Request, compute and return blocks until told to stop
+ * Input args:   comm, in, out, compute, ctx:  as for sched_master
+ */
+static void sched_worker(MPI_Comm comm, const sched_rows_t* in,
+      const sched_rows_t* out, sched_compute_fn compute, void* ctx) {
+   long block[2] = {0, 0}, capacity = 0;
+   void *in_buf = NULL, *out_buf = NULL;
+
+   for (;;) {
+      MPI_Send(block, 2, MPI_LONG, SCHED_MASTER, TAG_REQUEST, comm);
+      if (block[1] > 0)
+         MPI_Send(out_buf, (int)(block[1] * out->width), out->type, SCHED_MASTER, TAG_RESULT, comm);
+
+      MPI_Recv(block, 2, MPI_LONG, SCHED_MASTER, TAG_ASSIGN, comm, MPI_STATUS_IGNORE);
+      if (block[1] == 0) break;
+      if (block[1] > capacity) {
+         capacity = block[1];
+         free(in_buf);
+         free(out_buf);
+         in_buf = malloc(capacity * in->width * in->size);
+         out_buf = malloc(capacity * out->width * out->size);
+      }
+      MPI_Recv(in_buf, (int)(block[1] * in->width), in->type, SCHED_MASTER, TAG_DATA, comm, MPI_STATUS_IGNORE);
+      compute(ctx, (int) block[1], in_buf, out_buf);
+   }
+   free(in_buf);
+   free(out_buf);
+}  /* sched_worker */
+
+#endif /* SELF_SCHEDULE_H */
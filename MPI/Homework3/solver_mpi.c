@@ -0,0 +1,245 @@
+/* File:     solver_mpi.c
+ * Purpose:  Run the iterative solvers of solvers.h on a matrix that is
+ *           built or read once and stays distributed by rows, instead of
+ *           relaunching vector_matrix_mpi.c with a master handing the
+ *           matrix out for every product.
+ *
+ *           Dense test matrix (n given): a_ii = 4, a_ij = 1/(1+|i-j|)^2,
+ *           symmetric and diagonally dominant.  Each product gathers x
+ *           with MPI_Iallgatherv, or with persistent point-to-point
+ *           requests (MPI_Send_init/MPI_Recv_init, MPI_Startall) set up
+ *           once, and multiplies the diagonal block while x arrives.
+ *
+ *           Sparse matrix (a .mtx file): stored by csr.h, whose products
+ *           exchange only the ghost entries, also with persistent requests.
+ *
+ *           The right-hand side is b = A*1, so the solution is all ones.
+ *
+ * Usage:    mpirun -np <p> ./solver_mpi <power|jacobi|cg|pipecg> <n|matrix.mtx>
+ *               [tolerance] [max_iterations] [iallgather|persistent]
+ */
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "csr.h"
+#include "solvers.h"
+
+#define MASTER 0
+#define TOL 1e-8
+#define MAX_ITER 1000
+#define TAG_GATHER 31
+#define BLOCK_LOW(id,p,n)   ((long)(id)*(n)/(p))
+
+typedef struct {
+    MPI_Comm comm;
+    long n, first;
+    int nlocal, nprocs, rank;
+    int *counts, *displs;
+    double *a;                /* my rows, nlocal x n */
+    double *xfull;            /* all of x */
+    int persistent, nreq;
+    MPI_Request* req;
+} dense_op_t;
+
+/*------------------------------------------------------------------
+ * Function:     dense_setup
+ * Purpose:      Build my rows of the test matrix and the gather of x
+ */
+void dense_setup(MPI_Comm comm, long n, int persistent, dense_op_t* D) {
+    long i, j;
+    int q;
+
+    D->comm = comm;
+    D->n = n;
+    MPI_Comm_size(comm, &D->nprocs);
+    MPI_Comm_rank(comm, &D->rank);
+    D->counts = malloc(D->nprocs * sizeof(int));
+    D->displs = malloc(D->nprocs * sizeof(int));
+    for (q = 0; q < D->nprocs; q++) {
+        D->displs[q] = (int) BLOCK_LOW(q, D->nprocs, n);
+        D->counts[q] = (int)(BLOCK_LOW(q + 1, D->nprocs, n) - D->displs[q]);
+    }
+    D->first = D->displs[D->rank];
+    D->nlocal = D->counts[D->rank];
+
+    D->a = malloc(((long) D->nlocal * n + 1) * sizeof(double));
+    D->xfull = malloc(n * sizeof(double));
+    for (i = 0; i < D->nlocal; i++) {
+        for (j = 0; j < n; j++) {
+            long d = labs(D->first + i - j);
+            D->a[i*n + j] = (d == 0) ? 4.0 : 1.0 / ((1.0 + d) * (1.0 + d));
+        }
+    }
+
+    D->persistent = persistent;
+    D->req = malloc(2 * D->nprocs * sizeof(MPI_Request));
+    D->nreq = 0;
+    if (persistent) {
+        for (q = 0; q < D->nprocs; q++) {
+            if (q == D->rank) continue;
+            MPI_Recv_init(D->xfull + D->displs[q], D->counts[q], MPI_DOUBLE, q, TAG_GATHER,
+                          comm, &D->req[D->nreq++]);
+            MPI_Send_init(D->xfull + D->first, D->nlocal, MPI_DOUBLE, q, TAG_GATHER,
+                          comm, &D->req[D->nreq++]);
+        }
+    }
+}  /* dense_setup */
+
+/*------------------------------------------------------------------
+ * Function:     dense_matvec
+ * Purpose:      My rows of y = A*x: start gathering x, multiply the
+ *               diagonal block with my own part meanwhile, then the rest
+ */
+void dense_matvec(void* ctx, const double* x, double* y) {
+    dense_op_t* D = ctx;
+    long i, j, n = D->n, lo = D->first, hi = D->first + D->nlocal;
+    double sum;
+
+    memcpy(D->xfull + lo, x, D->nlocal * sizeof(double));
+    if (D->persistent) {
+        MPI_Startall(D->nreq, D->req);
+    } else {
+        MPI_Iallgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, D->xfull, D->counts, D->displs,
+                        MPI_DOUBLE, D->comm, &D->req[0]);
+    }
+    for (i = 0; i < D->nlocal; i++) {
+        sum = 0.0;
+        for (j = lo; j < hi; j++) sum += D->a[i*n + j] * x[j - lo];
+        y[i] = sum;
+    }
+    MPI_Waitall(D->persistent ? D->nreq : 1, D->req, MPI_STATUSES_IGNORE);
+    for (i = 0; i < D->nlocal; i++) {
+        sum = y[i];
+        for (j = 0; j < lo; j++) sum += D->a[i*n + j] * D->xfull[j];
+        for (j = hi; j < n; j++) sum += D->a[i*n + j] * D->xfull[j];
+        y[i] = sum;
+    }
+}  /* dense_matvec */
+
+void dense_diag(void* ctx, double* d) {
+    dense_op_t* D = ctx;
+    int i;
+
+    for (i = 0; i < D->nlocal; i++) d[i] = D->a[i*D->n + D->first + i];
+}  /* dense_diag */
+
+void dense_free(dense_op_t* D) {
+    int r;
+
+    if (D->persistent)
+        for (r = 0; r < D->nreq; r++) MPI_Request_free(&D->req[r]);
+    free(D->counts); free(D->displs); free(D->a); free(D->xfull); free(D->req);
+}  /* dense_free */
+
+void sparse_matvec(void* ctx, const double* x, double* y) {
+    csr_spmv(ctx, x, y);
+}  /* sparse_matvec */
+
+void sparse_diag(void* ctx, double* d) {
+    dist_csr_t* A = ctx;
+    int i, k;
+
+    for (i = 0; i < A->nrows; i++) {
+        d[i] = 0.0;
+        for (k = A->diag.ptr[i]; k < A->diag.ptr[i+1]; k++)
+            if (A->diag.col[k] == i) d[i] += A->diag.val[k];
+    }
+}  /* sparse_diag */
+
+int main(int argc, char *argv[]) {
+    int nprocs, rank, i, persistent = 0, sparse;
+    double *b, *x, local, err;
+    const char* method;
+    dense_op_t D;
+    dist_csr_t S;
+    dist_op_t A;
+    solver_opts_t opts = {MAX_ITER, TOL, 1};
+    solver_result_t res = {0, 0, 0.0, 0.0, 0.0};
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc < 3 || argc > 6
+            || (strcmp(argv[1], "power") != 0 && strcmp(argv[1], "jacobi") != 0
+                && strcmp(argv[1], "cg") != 0 && strcmp(argv[1], "pipecg") != 0)
+            || (strstr(argv[2], ".mtx") == NULL && atol(argv[2]) < 1)) {
+        if (rank == MASTER)
+            printf("usage: mpirun -np <p> %s <power|jacobi|cg|pipecg> <n|matrix.mtx> "
+                   "[tolerance] [max_iterations] [iallgather|persistent]\n", argv[0]);
+        MPI_Finalize();
+        exit(-1);
+    }
+    method = argv[1];
+    if (argc > 3) opts.tol = atof(argv[3]);
+    if (argc > 4) opts.max_iter = atoi(argv[4]);
+    if (argc > 5) persistent = (strcmp(argv[5], "persistent") == 0);
+
+    /* Build or read the matrix once */
+    A.comm = MPI_COMM_WORLD;
+    sparse = (strstr(argv[2], ".mtx") != NULL);
+    if (sparse) {
+        if (csr_read_mtx(MPI_COMM_WORLD, argv[2], &S) != 0) {
+            if (rank == MASTER) printf("%s: cannot read the matrix\n", argv[2]);
+            MPI_Finalize();
+            exit(-1);
+        }
+        if (S.nrows_global != S.ncols_global) {
+            if (rank == MASTER)
+                printf("%s: need a square matrix, not %ld x %ld\n", argv[2], S.nrows_global,
+                       S.ncols_global);
+            csr_free(&S);
+            MPI_Finalize();
+            exit(-1);
+        }
+        A.n = S.nrows_global;
+        A.nlocal = S.nrows;
+        A.matvec = sparse_matvec;
+        A.diag = sparse_diag;
+        A.ctx = &S;
+    } else {
+        dense_setup(MPI_COMM_WORLD, atol(argv[2]), persistent, &D);
+        A.n = D.n;
+        A.nlocal = D.nlocal;
+        A.matvec = dense_matvec;
+        A.diag = dense_diag;
+        A.ctx = &D;
+    }
+
+    /* b = A*1 */
+    b = malloc((A.nlocal + 1) * sizeof(double));
+    x = malloc((A.nlocal + 1) * sizeof(double));
+    for (i = 0; i < A.nlocal; i++) x[i] = 1.0;
+    A.matvec(A.ctx, x, b);
+    for (i = 0; i < A.nlocal; i++) x[i] = (strcmp(method, "power") == 0) ? 1.0 : 0.0;
+
+    if (rank == MASTER)
+        printf("%s on a %s %ld x %ld matrix, %d processes%s\n", method, sparse ? "sparse" : "dense",
+               A.n, A.n, nprocs, sparse ? "" : (persistent ? ", persistent gather" : ", Iallgatherv"));
+
+    if (strcmp(method, "power") == 0) solve_power(&A, x, &opts, &res);
+    else if (strcmp(method, "jacobi") == 0) solve_jacobi(&A, b, x, &opts, &res);
+    else if (strcmp(method, "cg") == 0) solve_cg(&A, b, x, &opts, &res);
+    else if (strcmp(method, "pipecg") == 0) solve_pipecg(&A, b, x, &opts, &res);
+
+    /* Largest error against the known solution */
+    local = 0.0;
+    for (i = 0; i < A.nlocal; i++) local = fmax(local, fabs(x[i] - 1.0));
+    MPI_Reduce(&local, &err, 1, MPI_DOUBLE, MPI_MAX, MASTER, MPI_COMM_WORLD);
+    if (rank == MASTER) {
+        printf("%s after %d iterations, residual %.6e, %.6f s (%.6f s per iteration)\n",
+               res.converged ? "converged" : "NOT converged", res.iterations, res.residual,
+               res.seconds, res.seconds / (res.iterations > 0 ? res.iterations : 1));
+        if (strcmp(method, "power") == 0) printf("dominant eigenvalue %.12f\n", res.value);
+        else printf("max error %.3e\n", err);
+    }
+
+    free(b);
+    free(x);
+    if (sparse) csr_free(&S);
+    else dense_free(&D);
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,303 @@
+/* File:     solvers.h
+ * Purpose:  Iterative methods on a matrix that stays distributed across
+ *           the processes: power iteration, Jacobi, conjugate gradient
+ *           and pipelined conjugate gradient.
+ *
+ * Usage:    dist_op_t A = {comm, n, nlocal, matvec, diag, ctx};
+ *           solver_opts_t opts = {max_iter, tol, verbose};
+ *           solver_result_t res;
+ *           solve_cg(&A, b, x, &opts, &res);
+ *
+ *           Vectors are distributed like the rows: every process passes
+ *           its nlocal entries.  matvec(ctx, x, y) must compute its rows
+ *           of y = A*x from its part of x (and fetch whatever else of x
+ *           it needs); diag(ctx, d) returns its part of the diagonal and
+ *           is only used by Jacobi.
+ *
+ * Notes:    The dot products are the only other communication.  Those
+ *           that are needed together share one reduction, and where an
+ *           update does not depend on the result the reduction is
+ *           started with MPI_Iallreduce and the update done while it is
+ *           in flight.  Pipelined CG (Ghysels and Vanroose) rearranges
+ *           CG so the single reduction of each iteration overlaps the
+ *           matrix-vector product; it needs a few more vector updates
+ *           and is a little less stable, so plain CG is kept as well.
+ *
+ *           With verbose set, process 0 prints the residual and the time
+ *           of every iteration.
+ */
+#ifndef SOLVERS_H
+#define SOLVERS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "mpi.h"
+
+typedef struct {
+   MPI_Comm comm;
+   long     n;          /* global size */
+   int      nlocal;     /* my rows */
+   void   (*matvec)(void* ctx, const double* x, double* y);
+   void   (*diag)(void* ctx, double* d);
+   void*    ctx;
+} dist_op_t;
+
+typedef struct {
+   int    max_iter;
+   double tol;          /* relative: ||r|| <= tol*||b||, for power
+                           iteration ||Ax - lambda x|| <= tol*|lambda| */
+   int    verbose;
+} solver_opts_t;
+
+typedef struct {
+   int    iterations;
+   int    converged;
+   double residual;     /* last residual norm */
+   double seconds;
+   double value;        /* eigenvalue, for power iteration */
+} solver_result_t;
+
+/*------------------------------------------------------------------
+ * Function:     solver_report
+ * Purpose:      Print one iteration on process 0
+ */
+static inline void solver_report(const dist_op_t* A, const solver_opts_t* opts,
+      const char* name, int iter, double residual, double* t_p) {
+   int rank;
+   double now = MPI_Wtime();
+
+   MPI_Comm_rank(A->comm, &rank);
+   if (opts->verbose && rank == 0)
+      printf("%s iter %5d  residual %.6e  %.6f s\n", name, iter, residual, now - *t_p);
+   *t_p = now;
+}  /* solver_report */
+
+static inline void solver_finish(solver_result_t* res, int iter, int converged,
+      double residual, double start) {
+   res->iterations = iter;
+   res->converged = converged;
+   res->residual = residual;
+   res->seconds = MPI_Wtime() - start;
+}  /* solver_finish */
+
+/*------------------------------------------------------------------
+ * Function:     solve_power
+ * Purpose:      Dominant eigenvalue and eigenvector by power iteration
+ * In/out args:  x:  start vector (not zero), on return the eigenvector
+ *                   with norm 1
+ * Output args:  res->value:  the eigenvalue estimate
+ * Note:         One reduction per iteration, of x.y and y.y, which
+ *               overlaps the next product: A*y is computed before y is
+ *               normalized and scaled afterwards.
+ */
+static inline void solve_power(const dist_op_t* A, double* x, const solver_opts_t* opts,
+      solver_result_t* res) {
+   int i, k, nl = A->nlocal, converged = 0;
+   double *y = malloc((nl + 1) * sizeof(double)), *z = malloc((nl + 1) * sizeof(double)), *t;
+   double local[2], dots[2], lambda = 0.0, norm, residual = 0.0, start = MPI_Wtime(), tick = start;
+   MPI_Request req;
+
+   /* Normalize the start vector, y = A*x */
+   local[0] = 0.0;
+   for (i = 0; i < nl; i++) local[0] += x[i] * x[i];
+   MPI_Allreduce(local, dots, 1, MPI_DOUBLE, MPI_SUM, A->comm);
+   norm = sqrt(dots[0]);
+   for (i = 0; i < nl; i++) x[i] /= norm;
+   A->matvec(A->ctx, x, y);
+
+   for (k = 1; k <= opts->max_iter; k++) {
+      local[0] = local[1] = 0.0;
+      for (i = 0; i < nl; i++) {
+         local[0] += x[i] * y[i];
+         local[1] += y[i] * y[i];
+      }
+      MPI_Iallreduce(local, dots, 2, MPI_DOUBLE, MPI_SUM, A->comm, &req);
+      A->matvec(A->ctx, y, z);
+      MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+      /* lambda = x.Ax and ||Ax - lambda x||^2 = y.y - lambda^2 */
+      lambda = dots[0];
+      residual = sqrt(fmax(dots[1] - lambda * lambda, 0.0));
+      solver_report(A, opts, "power", k, residual, &tick);
+      if (residual <= opts->tol * fabs(lambda)) converged = 1;
+
+      norm = sqrt(dots[1]);
+      for (i = 0; i < nl; i++) {
+         x[i] = y[i] / norm;
+         z[i] /= norm;
+      }
+      t = y; y = z; z = t;
+      if (converged) break;
+   }
+   res->value = lambda;
+   solver_finish(res, k > opts->max_iter ? opts->max_iter : k, converged, residual, start);
+   free(y);
+   free(z);
+}  /* solve_power */
+
+/*------------------------------------------------------------------
+ * Function:     solve_jacobi
+ * Purpose:      Solve A x = b by Jacobi iteration, x += D^-1 (b - A x)
+ * In/out args:  x:  initial guess, on return the solution
+ * Note:         The reduction of r.r overlaps the update of x
+ */
+static inline void solve_jacobi(const dist_op_t* A, const double* b, double* x,
+      const solver_opts_t* opts, solver_result_t* res) {
+   int i, k, nl = A->nlocal, converged = 0;
+   double *r = malloc((nl + 1) * sizeof(double)), *d = malloc((nl + 1) * sizeof(double));
+   double local, rr, bb, residual = 0.0, start = MPI_Wtime(), tick = start;
+   MPI_Request req;
+
+   A->diag(A->ctx, d);
+   local = 0.0;
+   for (i = 0; i < nl; i++) local += b[i] * b[i];
+   MPI_Allreduce(&local, &bb, 1, MPI_DOUBLE, MPI_SUM, A->comm);
+
+   for (k = 1; k <= opts->max_iter; k++) {
+      A->matvec(A->ctx, x, r);
+      local = 0.0;
+      for (i = 0; i < nl; i++) {
+         r[i] = b[i] - r[i];
+         local += r[i] * r[i];
+      }
+      MPI_Iallreduce(&local, &rr, 1, MPI_DOUBLE, MPI_SUM, A->comm, &req);
+      for (i = 0; i < nl; i++) x[i] += r[i] / d[i];
+      MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+      /* rr is the residual of x before this update */
+      residual = sqrt(rr);
+      solver_report(A, opts, "jacobi", k, residual, &tick);
+      if (residual <= opts->tol * sqrt(bb)) {
+         converged = 1;
+         break;
+      }
+   }
+   solver_finish(res, k > opts->max_iter ? opts->max_iter : k, converged, residual, start);
+   free(r);
+   free(d);
+}  /* solve_jacobi */
+
+/*------------------------------------------------------------------
+ * Function:     solve_cg
+ * Purpose:      Solve A x = b, A symmetric positive definite, by the
+ *               conjugate gradient method
+ * In/out args:  x:  initial guess, on return the solution
+ * Note:         The reduction of the new r.r overlaps the update of x
+ */
+static inline void solve_cg(const dist_op_t* A, const double* b, double* x,
+      const solver_opts_t* opts, solver_result_t* res) {
+   int i, k, nl = A->nlocal, converged = 0;
+   double *r = malloc((nl + 1) * sizeof(double)), *p = malloc((nl + 1) * sizeof(double));
+   double *q = malloc((nl + 1) * sizeof(double));
+   double local[2], dots[2], rr, rr_new, pq, alpha, beta, bnorm;
+   double residual, start = MPI_Wtime(), tick = start;
+   MPI_Request req;
+
+   A->matvec(A->ctx, x, q);
+   local[0] = local[1] = 0.0;
+   for (i = 0; i < nl; i++) {
+      r[i] = p[i] = b[i] - q[i];
+      local[0] += r[i] * r[i];
+      local[1] += b[i] * b[i];
+   }
+   MPI_Allreduce(local, dots, 2, MPI_DOUBLE, MPI_SUM, A->comm);
+   rr = dots[0];
+   bnorm = sqrt(dots[1]);
+   residual = sqrt(rr);
+
+   for (k = 1; k <= opts->max_iter && residual > opts->tol * bnorm; k++) {
+      A->matvec(A->ctx, p, q);
+      local[0] = 0.0;
+      for (i = 0; i < nl; i++) local[0] += p[i] * q[i];
+      MPI_Allreduce(local, &pq, 1, MPI_DOUBLE, MPI_SUM, A->comm);
+      alpha = rr / pq;
+
+      local[0] = 0.0;
+      for (i = 0; i < nl; i++) {
+         r[i] -= alpha * q[i];
+         local[0] += r[i] * r[i];
+      }
+      MPI_Iallreduce(local, &rr_new, 1, MPI_DOUBLE, MPI_SUM, A->comm, &req);
+      for (i = 0; i < nl; i++) x[i] += alpha * p[i];
+      MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+      beta = rr_new / rr;
+      rr = rr_new;
+      for (i = 0; i < nl; i++) p[i] = r[i] + beta * p[i];
+      residual = sqrt(rr);
+      solver_report(A, opts, "cg", k, residual, &tick);
+   }
+   converged = (residual <= opts->tol * bnorm);
+   solver_finish(res, k - 1, converged, residual, start);
+   free(r);
+   free(p);
+   free(q);
+}  /* solve_cg */
+
+/*------------------------------------------------------------------
+ * Function:     solve_pipecg
+ * Purpose:      Solve A x = b, A symmetric positive definite, by
+ *               pipelined conjugate gradients: the reduction of r.r and
+ *               w.r (w = A r) runs while n = A w is computed
+ * In/out args:  x:  initial guess, on return the solution
+ */
+static inline void solve_pipecg(const dist_op_t* A, const double* b, double* x,
+      const solver_opts_t* opts, solver_result_t* res) {
+   int i, k, nl = A->nlocal, converged = 0;
+   size_t bytes = (nl + 1) * sizeof(double);
+   double *r = malloc(bytes), *w = malloc(bytes), *n = malloc(bytes), *p = calloc(nl + 1, sizeof(double));
+   double *s = calloc(nl + 1, sizeof(double)), *z = calloc(nl + 1, sizeof(double));
+   double local[3], dots[3], gamma, gamma_old = 1.0, delta, alpha = 1.0, beta, bnorm = 0.0;
+   double residual = 0.0, start = MPI_Wtime(), tick = start;
+   MPI_Request req;
+
+   A->matvec(A->ctx, x, w);
+   for (i = 0; i < nl; i++) r[i] = b[i] - w[i];
+   A->matvec(A->ctx, r, w);
+
+   for (k = 1; k <= opts->max_iter; k++) {
+      local[0] = local[1] = local[2] = 0.0;
+      for (i = 0; i < nl; i++) {
+         local[0] += r[i] * r[i];
+         local[1] += w[i] * r[i];
+         local[2] += b[i] * b[i];
+      }
+      MPI_Iallreduce(local, dots, (k == 1) ? 3 : 2, MPI_DOUBLE, MPI_SUM, A->comm, &req);
+      A->matvec(A->ctx, w, n);
+      MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+      gamma = dots[0];
+      delta = dots[1];
+      if (k == 1) bnorm = sqrt(dots[2]);
+      residual = sqrt(gamma);
+      solver_report(A, opts, "pipecg", k, residual, &tick);
+      if (residual <= opts->tol * bnorm) {
+         converged = 1;
+         break;
+      }
+
+      if (k == 1) {
+         beta = 0.0;
+         alpha = gamma / delta;
+      } else {
+         beta = gamma / gamma_old;
+         alpha = gamma / (delta - beta * gamma / alpha);
+      }
+      gamma_old = gamma;
+      for (i = 0; i < nl; i++) {
+         z[i] = n[i] + beta * z[i];
+         s[i] = w[i] + beta * s[i];
+         p[i] = r[i] + beta * p[i];
+         x[i] += alpha * p[i];
+         r[i] -= alpha * s[i];
+         w[i] -= alpha * z[i];
+      }
+   }
+   /* The residual reported for iteration k is that of the x after k-1
+    * updates */
+   solver_finish(res, converged ? k - 1 : opts->max_iter, converged, residual, start);
+   free(r); free(w); free(n); free(p); free(s); free(z);
+}  /* solve_pipecg */
+
+#endif /* SOLVERS_H */
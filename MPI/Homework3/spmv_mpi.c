@@ -0,0 +1,106 @@
+/* File:     spmv_mpi.c
+ * Purpose:  Sparse matrix-vector product y = A*x with A read from a
+ *           Matrix Market file.  Like vector_matrix_mpi.c each process
+ *           works on a block of rows, but the rows are balanced by
+ *           nonzeros, stored in CSR form (see csr.h), and instead of
+ *           the whole vector each process only receives the entries of
+ *           x its rows reference.
+ *
+ * Usage:    mpirun -np <p> ./spmv_mpi <matrix.mtx> [repetitions]
+ */
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "csr.h"
+
+#define MASTER 0
+#define REPS 10           /* default number of products to time */
+
+/* x_j: distinct small values, so a ghost entry from the wrong place shows */
+#define X_ENTRY(j)  ((double)((j) % 13 + 1))
+
+int main(int argc, char *argv[]) {
+    int nprocs, rank, reps = REPS, rep, i, k;
+    long local[4], minv[4], maxv[4], sumv[4], bad = 0, all_bad;
+    double *x, *y, start, elapsed, check = 0.0, expect = 0.0, sums[2], totals[2];
+    dist_csr_t A;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc < 2 || argc > 3) {
+        if (rank == MASTER)
+            printf("usage: mpirun -np <p> %s <matrix.mtx> [repetitions]\n", argv[0]);
+        MPI_Finalize();
+        exit(-1);
+    }
+    if (argc > 2) reps = atoi(argv[2]);
+
+    start = MPI_Wtime();
+    if (csr_read_mtx(MPI_COMM_WORLD, argv[1], &A) != 0) {
+        MPI_Finalize();
+        exit(-1);
+    }
+    elapsed = MPI_Wtime() - start;
+
+    x = malloc((A.ncols_local + 1) * sizeof(double));
+    y = malloc((A.nrows + 1) * sizeof(double));
+    for (i = 0; i < A.ncols_local; i++) x[i] = X_ENTRY(A.first_col + i);
+
+    /* Check: every ghost holds the right entry of x, and the sum of y
+     * matches the sum of a_ij x_j over my entries */
+    csr_spmv(&A, x, y);
+    for (k = 0; k < A.nghost; k++) {
+        if (A.ghost[k] != X_ENTRY(A.ghost_col[k])) bad++;
+    }
+    for (i = 0; i < A.nrows; i++) {
+        check += y[i];
+        for (k = A.diag.ptr[i]; k < A.diag.ptr[i+1]; k++)
+            expect += A.diag.val[k] * X_ENTRY(A.first_col + A.diag.col[k]);
+        for (k = A.offd.ptr[i]; k < A.offd.ptr[i+1]; k++)
+            expect += A.offd.val[k] * X_ENTRY(A.ghost_col[A.offd.col[k]]);
+    }
+    sums[0] = check;
+    sums[1] = expect;
+    MPI_Reduce(sums, totals, 2, MPI_DOUBLE, MPI_SUM, MASTER, MPI_COMM_WORLD);
+    MPI_Reduce(&bad, &all_bad, 1, MPI_LONG, MPI_SUM, MASTER, MPI_COMM_WORLD);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    for (rep = 0; rep < reps; rep++) {
+        csr_spmv(&A, x, y);
+    }
+    start = MPI_Wtime() - start;
+    MPI_Reduce(&start, &check, 1, MPI_DOUBLE, MPI_MAX, MASTER, MPI_COMM_WORLD);
+
+    /* Balance and halo size */
+    local[0] = A.nrows;
+    local[1] = A.nnz;
+    local[2] = A.nghost;
+    local[3] = A.nrecv;
+    MPI_Reduce(local, minv, 4, MPI_LONG, MPI_MIN, MASTER, MPI_COMM_WORLD);
+    MPI_Reduce(local, maxv, 4, MPI_LONG, MPI_MAX, MASTER, MPI_COMM_WORLD);
+    MPI_Reduce(local, sumv, 4, MPI_LONG, MPI_SUM, MASTER, MPI_COMM_WORLD);
+
+    if (rank == MASTER) {
+        printf("%ld x %ld matrix, %ld nonzeros, read in %.3f seconds\n",
+               A.nrows_global, A.ncols_global, A.nnz_global, elapsed);
+        printf("rows per process %ld..%ld, nonzeros per process %ld..%ld (max/avg %.3f)\n",
+               minv[0], maxv[0], minv[1], maxv[1], maxv[1] * (double) nprocs / A.nnz_global);
+        printf("ghost entries per process %ld..%ld from up to %ld neighbours: %.1f KiB per product"
+               " (broadcasting x: %.1f KiB)\n", minv[2], maxv[2], maxv[3],
+               sumv[2] * sizeof(double) / 1024.0, (nprocs - 1.0) * A.ncols_global * sizeof(double) / 1024.0);
+        printf("%d products: %.6f seconds each, %.2f GFLOP/s\n", reps, check / reps,
+               2.0 * A.nnz_global * reps / check * 1e-9);
+        printf("check: %ld wrong ghost entries, relative error of sum(y) %.3g\n", all_bad,
+               fabs(totals[0] - totals[1]) / (fabs(totals[1]) > 0 ? fabs(totals[1]) : 1.0));
+    }
+
+    free(x);
+    free(y);
+    csr_free(&A);
+    MPI_Finalize();
+    return 0;
+}
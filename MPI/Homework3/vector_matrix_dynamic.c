@@ -0,0 +1,133 @@
+/* File:     vector_matrix_dynamic.c
+ * Purpose:  Matrix-vector multiplication with self-scheduling: the
+ *           workers keep asking the master for small blocks of rows
+ *           until none are left (see self_schedule.h), instead of each
+ *           getting one fixed slab as in vector_matrix_mpi.c.  The
+ *           vector is broadcast once.
+ *
+ * Usage:    mpirun -np <p> ./vector_matrix_dynamic <rows> <width>
+ *               [chunk] [dynamic|guided] [master_computes 0|1]
+ */
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "self_schedule.h"
+
+#define MASTER 0          /* master has rank of 0 */
+#define CHUNK 64          /* default rows per block */
+
+/* Test data: result[i] is known without doing the product */
+#define MATRIX_ENTRY(i,j)  (((i) + (j)) % 3)
+#define VECTOR_ENTRY(j)    1
+
+typedef struct {
+    int width;
+    const int* vector;
+} mv_ctx_t;
+
+/*------------------------------------------------------------------
+ * Function:     mv_block
+ * Purpose:      Multiply a block of rows of the matrix by the vector
+ */
+void mv_block(void* ctx, int rows, const void* in, void* out) {
+    mv_ctx_t* mv = ctx;
+    const int* matrix = in;
+    int* result = out;
+    int i, j;
+
+    for (i = 0; i < rows; i++) {
+        result[i] = 0;
+        for (j = 0; j < mv->width; j++) {
+            result[i] += matrix[(size_t) i*mv->width + j] * mv->vector[j];
+        }
+    }
+}  /* mv_block */
+
+int main(int argc, char *argv[] ) {
+    int nprocs,         /* number of processes in MPI_COMM_WORLD */
+        rank,           /* the rank of each process */
+        rows, width,    /* matrix size */
+        errors = 0,
+        i, j, expect;
+    int *matrix = NULL, *vector, *result = NULL;
+    long* rows_done = NULL;
+    double start, elapsed;
+    sched_opts_t opts = {CHUNK, 0, 0};
+    sched_rows_t in, out;
+    mv_ctx_t mv;
+
+    /* Initialize MPI execution environment */
+    MPI_Init( &argc,&argv);
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank);
+    MPI_Comm_size( MPI_COMM_WORLD, &nprocs);
+
+    if (argc < 3 || argc > 6) {
+        if (rank == MASTER)
+            printf("usage: mpirun -np <p> %s <rows> <width> [chunk] [dynamic|guided] [master_computes 0|1]\n", argv[0]);
+        MPI_Finalize();
+        exit(-1);
+    }
+    rows = atoi(argv[1]);
+    width = atoi(argv[2]);
+    if (argc > 3) opts.chunk = atoi(argv[3]);
+    if (argc > 4) opts.guided = (strcmp(argv[4], "guided") == 0);
+    if (argc > 5) opts.master_computes = atoi(argv[5]);
+    if (rows < 1 || width < 1 || opts.chunk < 1) {
+        if (rank == MASTER) printf("rows, width and chunk must be positive\n");
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    in.type = MPI_INT;  in.size = sizeof(int);  in.width = width;
+    out.type = MPI_INT; out.size = sizeof(int); out.width = 1;
+
+    /* Every process needs the whole vector */
+    vector = malloc((size_t) width * sizeof(int));
+    if (rank == MASTER) {
+        matrix = malloc((size_t) rows * width * sizeof(int));
+        result = malloc((size_t) rows * sizeof(int));
+        rows_done = malloc(nprocs * sizeof(long));
+        for (j = 0; j < width; j++) vector[j] = VECTOR_ENTRY(j);
+        for (i = 0; i < rows; i++)
+            for (j = 0; j < width; j++)
+                matrix[(size_t) i*width + j] = MATRIX_ENTRY(i, j);
+    }
+    mv.width = width;
+    mv.vector = vector;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    MPI_Bcast(vector, width, MPI_INT, MASTER, MPI_COMM_WORLD);
+
+    /************************* Master ************************/
+    if (rank == MASTER) {
+        sched_master(MPI_COMM_WORLD, rows, &opts, &in, matrix, &out, result, mv_block, &mv, rows_done);
+        elapsed = MPI_Wtime() - start;
+
+        /* Row i holds width/3 full cycles of 0+1+2 plus the leftover */
+        for (i = 0; i < rows; i++) {
+            expect = (width / 3) * 3;
+            for (j = width - width % 3; j < width; j++) expect += MATRIX_ENTRY(i, j);
+            if (result[i] != expect) errors++;
+        }
+
+        printf("%s scheduling, chunk %d, master %s\n", opts.guided ? "guided" : "dynamic",
+               opts.chunk, opts.master_computes ? "computes" : "only schedules");
+        for (i = 0; i < nprocs; i++)
+            printf("process %d did %ld rows\n", i, rows_done[i]);
+        printf("%d x %d times vector: %.6f seconds, %d wrong rows\n", rows, width, elapsed, errors);
+        free(matrix);
+        free(result);
+        free(rows_done);
+    }
+
+    /* the workers keep asking for rows until there are none left */
+    if (rank > MASTER)
+        sched_worker(MPI_COMM_WORLD, &in, &out, mv_block, &mv);
+
+    free(vector);
+    /* Terminate the MPI execution environment */
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,104 @@
+/* File:     vector_matrix_io.c
+ * Purpose:  Matrix-vector product y = A*x with A, x and y in matrix files
+ *           (see matfile.h; x and y are single columns).  Instead of the
+ *           master building the matrix and sending rows out as in
+ *           vector_matrix_mpi.c, every process reads its own rows of A
+ *           and all of x with collective MPI-IO (or mmap on a single
+ *           node) and writes its part of y back the same way.
+ *
+ * Usage:    mpirun -np <p> ./vector_matrix_io <A.mat> <x.mat> <y.mat>
+ *
+ *           A and x must have the same type, int or double; y gets it too.
+ */
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "matfile.h"
+
+#define MASTER 0
+#define BLOCK_LOW(id,p,n)   ((long)(id)*(n)/(p))
+
+int main(int argc, char *argv[] ) {
+    int nprocs, rank, mapped;
+    long rows, width, first, my_rows, i, j;
+    void *matrix, *vector, *result;
+    double start, elapsed;
+    matfile_t fa, fx, fy;
+
+    MPI_Init( &argc,&argv);
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank);
+    MPI_Comm_size( MPI_COMM_WORLD, &nprocs);
+
+    if (argc != 4) {
+        if (rank == MASTER)
+            printf("usage: mpirun -np <p> %s <A.mat> <x.mat> <y.mat>\n", argv[0]);
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    start = MPI_Wtime();
+    if (matfile_open(MPI_COMM_WORLD, argv[1], MPI_MODE_RDONLY, &fa) != 0) {
+        MPI_Finalize();
+        exit(-1);
+    }
+    if (matfile_open(MPI_COMM_WORLD, argv[2], MPI_MODE_RDONLY, &fx) != 0) {
+        matfile_close(&fa);
+        MPI_Finalize();
+        exit(-1);
+    }
+    if (fx.type != fa.type || fx.rows != fa.cols || fx.cols != 1) {
+        if (rank == MASTER)
+            printf("x must be a %ld x 1 matrix of the same type as A\n", fa.cols);
+        matfile_close(&fa);
+        matfile_close(&fx);
+        MPI_Finalize();
+        exit(-1);
+    }
+    rows = fa.rows;
+    width = fa.cols;
+    first = BLOCK_LOW(rank, nprocs, rows);
+    my_rows = BLOCK_LOW(rank + 1, nprocs, rows) - first;
+
+    matrix = malloc((my_rows * width + 1) * fa.esize);
+    vector = malloc(width * fa.esize);
+    result = malloc((my_rows + 1) * fa.esize);
+    mapped = (fa.map != NULL);
+    matfile_read(&fa, first, my_rows, 0, width, matrix);
+    matfile_read(&fx, 0, width, 0, 1, vector);
+    matfile_close(&fa);
+    matfile_close(&fx);
+
+    /* Each process works on its rows */
+    for (i = 0; i < my_rows; i++) {
+        if (fa.type == MATFILE_DOUBLE) {
+            double sum = 0.0;
+            for (j = 0; j < width; j++)
+                sum += ((double*) matrix)[i*width + j] * ((double*) vector)[j];
+            ((double*) result)[i] = sum;
+        } else {
+            int sum = 0;
+            for (j = 0; j < width; j++)
+                sum += ((int*) matrix)[i*width + j] * ((int*) vector)[j];
+            ((int*) result)[i] = sum;
+        }
+    }
+
+    if (matfile_create(MPI_COMM_WORLD, argv[3], fa.type, rows, 1, fa.tile_rows, 1, &fy) != 0) {
+        MPI_Finalize();
+        exit(-1);
+    }
+    matfile_write(&fy, first, my_rows, 0, 1, result);
+    matfile_close(&fy);
+    elapsed = MPI_Wtime() - start;
+
+    if (rank == MASTER) {
+        printf("y = A*x with A %ld x %ld on %d processes%s: %.6f seconds\n", rows, width, nprocs,
+               mapped ? " (mmap)" : " (MPI-IO)", elapsed);
+    }
+
+    free(matrix);
+    free(vector);
+    free(result);
+    MPI_Finalize();
+    return 0;
+}
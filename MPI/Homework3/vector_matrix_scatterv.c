@@ -0,0 +1,156 @@
+/*****************************************************************************
+* Matrix-vector product y = A*x for any size of A, with MPI_Scatterv and
+* MPI_Gatherv.
+*
+* vector_matrix_buggy.c scatters WIDTH/nprocs rows to each process and
+* silently drops the remainder, and every process keeps full WIDTH x WIDTH
+* arrays on its stack.  Here the sizes come from the command line, A may
+* be non-square, the rows are block partitioned so the block sizes differ
+* by at most one row, and each process only allocates its own
+* rows of A (plus x and its part of y) on the heap.
+*
+* The root does not build all of A either: it fills and scatters the
+* matrix in stages of at most STAGE_BYTES, each stage giving every
+* process the next slice of its rows, so no process ever holds more than
+* its own rows plus one stage.
+*
+* usage: mpirun -np <p> ./vector_matrix_scatterv <rows> <cols>
+******************************************************************************/
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MASTER 0
+#define BLOCK_LOW(id,p,n)   ((long)(id)*(n)/(p))
+#define BLOCK_SIZE(id,p,n)  (BLOCK_LOW((id)+1,p,n) - BLOCK_LOW(id,p,n))
+#define STAGE_BYTES (64L << 20)     /* most of A the root builds at once */
+#define PRINT_MAX 10                /* entries of y to print */
+
+/* Test data: small integers, so y is exact and can be checked row by row */
+#define A_ENTRY(i,j)  ((double)(((i) + 3*(j)) % 11 - 5))
+#define X_ENTRY(j)    ((double)((j) % 4 + 1))
+
+int main(int argc, char *argv[]) {
+
+    int nprocs,         /* number of processes */
+        rank,           /* rank of each process */
+        stages,         /* number of pieces the root builds A in */
+        s, q, errors = 0;
+    long rows, cols,    /* size of A */
+         my_rows,       /* rows of A on this process */
+         i, j, r;
+    int *counts, *displs;
+    double *local_a, *x, *local_y, *y = NULL, *stage = NULL;
+    double start, elapsed, expect;
+
+    /* Initialize MPI execution environment */
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc != 3 || (rows = atol(argv[1])) < 1 || (cols = atol(argv[2])) < 1) {
+        if (rank == MASTER)
+            printf("usage: mpirun -np <p> %s <rows> <cols>\n", argv[0]);
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    /* Split the root's work into stages small enough for its memory and
+     * for int counts; every process gets a slice of its rows per stage */
+    stages = (int)((rows * cols * (long) sizeof(double) + STAGE_BYTES - 1) / STAGE_BYTES);
+    if (stages > rows) stages = (int) rows;
+    my_rows = BLOCK_SIZE(rank, nprocs, rows);
+
+    local_a = malloc((my_rows * cols + 1) * sizeof(double));
+    local_y = malloc((my_rows + 1) * sizeof(double));
+    x = malloc(cols * sizeof(double));
+    counts = malloc(nprocs * sizeof(int));
+    displs = malloc(nprocs * sizeof(int));
+    if (rank == MASTER) {
+        y = malloc(rows * sizeof(double));
+        stage = malloc(((rows + stages - 1) / stages + nprocs) * cols * sizeof(double));
+        for (j = 0; j < cols; j++) x[j] = X_ENTRY(j);
+    }
+    if (local_a == NULL || local_y == NULL || x == NULL
+          || (rank == MASTER && (y == NULL || stage == NULL))) {
+        fprintf(stderr, "process %d: out of memory for a %ld x %ld matrix\n", rank, rows, cols);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+
+    /* All processes need the whole input vector */
+    MPI_Bcast(x, (int) cols, MPI_DOUBLE, MASTER, MPI_COMM_WORLD);
+
+    /* Distribute A stage by stage.  In stage s process q gets rows
+     * BLOCK_LOW(s, stages, its rows) onwards of its own block. */
+    for (s = 0; s < stages; s++) {
+        for (q = 0; q < nprocs; q++) {
+            counts[q] = (int)(BLOCK_SIZE(s, stages, BLOCK_SIZE(q, nprocs, rows)) * cols);
+            displs[q] = (q == 0) ? 0 : displs[q-1] + counts[q-1];
+        }
+        if (rank == MASTER) {
+            for (q = 0; q < nprocs; q++) {
+                r = BLOCK_LOW(q, nprocs, rows) + BLOCK_LOW(s, stages, BLOCK_SIZE(q, nprocs, rows));
+                for (i = 0; i < counts[q] / cols; i++)
+                    for (j = 0; j < cols; j++)
+                        stage[displs[q] + i*cols + j] = A_ENTRY(r + i, j);
+            }
+        }
+        MPI_Scatterv(stage, counts, displs, MPI_DOUBLE,
+                     local_a + BLOCK_LOW(s, stages, my_rows) * cols, counts[rank], MPI_DOUBLE,
+                     MASTER, MPI_COMM_WORLD);
+    }
+
+    /* Each process multiplies its rows */
+    for (i = 0; i < my_rows; i++) {
+        double sum = 0.0;
+        for (j = 0; j < cols; j++) {
+            sum += local_a[i*cols + j] * x[j];
+        }
+        local_y[i] = sum;
+    }
+
+    /* Collect y on the master; the counts are the row blocks */
+    for (q = 0; q < nprocs; q++) {
+        counts[q] = (int) BLOCK_SIZE(q, nprocs, rows);
+        displs[q] = (int) BLOCK_LOW(q, nprocs, rows);
+    }
+    MPI_Gatherv(local_y, (int) my_rows, MPI_DOUBLE, y, counts, displs, MPI_DOUBLE,
+                MASTER, MPI_COMM_WORLD);
+    elapsed = MPI_Wtime() - start;
+
+    /* master checks the first and last row of every block and prints y */
+    if (rank == MASTER) {
+        for (q = 0; q < nprocs; q++) {
+            for (r = 0; r < counts[q]; r += (counts[q] > 1) ? counts[q] - 1 : 1) {
+                i = displs[q] + r;
+                expect = 0.0;
+                for (j = 0; j < cols; j++) expect += A_ENTRY(i, j) * X_ENTRY(j);
+                if (y[i] != expect) errors++;
+            }
+        }
+        for (i = 0; i < rows && i < PRINT_MAX; i++) {
+            printf("%g\n", y[i]);
+        }
+        if (rows > PRINT_MAX) printf("... (%ld rows)\n", rows);
+        printf("%ld x %ld matrix on %d processes in %d stage(s): %.6f seconds, %.2f GFLOP/s, %d wrong rows\n",
+               rows, cols, nprocs, stages, elapsed, 2.0 * rows * cols / elapsed * 1e-9, errors);
+        r = BLOCK_SIZE(nprocs - 1, nprocs, rows);
+        printf("largest block is %ld rows, %.1f MiB per process\n", r,
+               (r * (cols + 1) + cols) * sizeof(double) / 1048576.0);
+        free(y);
+        free(stage);
+    }
+
+    free(local_a);
+    free(local_y);
+    free(x);
+    free(counts);
+    free(displs);
+    /* Terminate MPI execution environment */
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,143 @@
+/* File:     vector_matrix_typed.cpp
+ * Purpose:  The Scatterv/Gatherv matrix-vector product of
+ *           vector_matrix_scatterv.c for any element type, using the
+ *           kernels of kernels.hpp: rows of A are scattered, x is
+ *           broadcast, every process runs kern::matvec on its rows and y
+ *           is gathered.  The product is repeated to time the kernel.
+ *
+ * Usage:    mpirun -np <p> ./vector_matrix_typed <int|float|double> <rows> <cols>
+ *               [repetitions]
+ *
+ * Note:     Entries are small integers (|A*x term| <= 20), so partial
+ *           sums stay integers of magnitude at most 20*cols and the
+ *           result is exact while that fits the type: cols up to about
+ *           830000 (2^24/20) for float, beyond which float reports
+ *           wrong rows from rounding.  Float moves half the bytes of
+ *           double.  As in vector_matrix_scatterv.c the root builds and
+ *           scatters A in stages of at most STAGE_BYTES, so no process
+ *           holds more than its own rows plus one stage.
+ */
+#include "mpi.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "kernels.hpp"
+
+#define MASTER 0
+#define REPS 10
+#define BLOCK_LOW(id,p,n)   ((long)(id)*(n)/(p))
+#define BLOCK_SIZE(id,p,n)  (BLOCK_LOW((id)+1,p,n) - BLOCK_LOW(id,p,n))
+#define STAGE_BYTES (64L << 20)     /* most of A the root builds at once */
+#define A_ENTRY(i,j)  (((i) + 3*(j)) % 11 - 5)
+#define X_ENTRY(j)    ((j) % 4 + 1)
+
+template <typename T>
+void run(long rows, long cols, int reps) {
+    int nprocs, rank, q, errors = 0;
+    double start, t_comm, t_comp, times[2], max_times[2];
+    MPI_Datatype type = kern::mpi_type<T>::get();
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    /* Counts and displacements of the row blocks, in rows */
+    std::vector<int> counts(nprocs), displs(nprocs), acounts(nprocs), adispls(nprocs);
+    for (q = 0; q < nprocs; q++) {
+        displs[q] = (int) BLOCK_LOW(q, nprocs, rows);
+        counts[q] = (int) BLOCK_SIZE(q, nprocs, rows);
+    }
+    long my_rows = counts[rank];
+
+    /* Stages small enough for the root's memory and for int counts */
+    int stages = (int)((rows * cols * (long) sizeof(T) + STAGE_BYTES - 1) / STAGE_BYTES);
+    if (stages > rows) stages = (int) rows;
+
+    std::vector<T> stage, y, x(cols), local_a(my_rows * cols + 1), local_y(my_rows + 1);
+    if (rank == MASTER) {
+        stage.resize(((rows + stages - 1) / stages + nprocs) * cols);
+        y.resize(rows);
+        for (long j = 0; j < cols; j++) x[j] = T(X_ENTRY(j));
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    MPI_Bcast(x.data(), (int) cols, type, MASTER, MPI_COMM_WORLD);
+
+    /* In stage s process q gets rows BLOCK_LOW(s, stages, its rows)
+     * onwards of its own block */
+    for (int s = 0; s < stages; s++) {
+        for (q = 0; q < nprocs; q++) {
+            acounts[q] = (int)(BLOCK_SIZE(s, stages, counts[q]) * cols);
+            adispls[q] = (q == 0) ? 0 : adispls[q-1] + acounts[q-1];
+        }
+        if (rank == MASTER) {
+            for (q = 0; q < nprocs; q++) {
+                long r = displs[q] + BLOCK_LOW(s, stages, counts[q]);
+                for (long i = 0; i < acounts[q] / cols; i++)
+                    for (long j = 0; j < cols; j++)
+                        stage[adispls[q] + i*cols + j] = T(A_ENTRY(r + i, j));
+            }
+        }
+        MPI_Scatterv(stage.data(), acounts.data(), adispls.data(), type,
+                     local_a.data() + BLOCK_LOW(s, stages, my_rows) * cols, acounts[rank], type,
+                     MASTER, MPI_COMM_WORLD);
+    }
+    t_comm = MPI_Wtime() - start;
+
+    start = MPI_Wtime();
+    for (int rep = 0; rep < reps; rep++)
+        kern::matvec(my_rows, cols, local_a.data(), cols, x.data(), local_y.data());
+    t_comp = MPI_Wtime() - start;
+
+    start = MPI_Wtime();
+    MPI_Gatherv(local_y.data(), (int) my_rows, type, y.data(), counts.data(), displs.data(),
+                type, MASTER, MPI_COMM_WORLD);
+    t_comm += MPI_Wtime() - start;
+
+    times[0] = t_comm;
+    times[1] = t_comp;
+    MPI_Reduce(times, max_times, 2, MPI_DOUBLE, MPI_MAX, MASTER, MPI_COMM_WORLD);
+
+    if (rank == MASTER) {
+        /* Check the first and last row of every block */
+        for (q = 0; q < nprocs; q++) {
+            for (long r = 0; r < counts[q]; r += (counts[q] > 1) ? counts[q] - 1 : 1) {
+                long i = displs[q] + r, expect = 0;
+                for (long j = 0; j < cols; j++) expect += (long) A_ENTRY(i, j) * X_ENTRY(j);
+                if (y[i] != T(expect)) errors++;
+            }
+        }
+        printf("%s: %ld x %ld matrix on %d processes in %d stage(s), %d wrong rows\n",
+               kern::mpi_type<T>::name(), rows, cols, nprocs, stages, errors);
+        printf("communication %.6f s for %.1f MiB, matvec %.6f s each, %.2f GFLOP/s per process (%d lanes)\n",
+               max_times[0], (rows * cols + nprocs * cols + rows) * sizeof(T) / 1048576.0,
+               max_times[1] / reps, 2.0 * rows * cols * reps / nprocs / max_times[1] * 1e-9,
+               kern::simd<T>::lanes);
+    }
+}  /* run */
+
+int main(int argc, char *argv[]) {
+    int rank;
+    long rows, cols;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc < 4 || argc > 5 || (rows = atol(argv[2])) < 1 || (cols = atol(argv[3])) < 1
+          || (strcmp(argv[1], "int") != 0 && strcmp(argv[1], "float") != 0
+              && strcmp(argv[1], "double") != 0)) {
+        if (rank == MASTER)
+            printf("usage: mpirun -np <p> %s <int|float|double> <rows> <cols> [repetitions]\n", argv[0]);
+        MPI_Finalize();
+        exit(-1);
+    }
+    int reps = (argc > 4) ? atoi(argv[4]) : REPS;
+
+    if (strcmp(argv[1], "int") == 0) run<int>(rows, cols, reps);
+    else if (strcmp(argv[1], "float") == 0) run<float>(rows, cols, reps);
+    else if (strcmp(argv[1], "double") == 0) run<double>(rows, cols, reps);
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,695 @@
+/* File:     pmpi_prof.c
+ * Purpose:  A profiling library for the MPI programs of this repository,
+ *           built on the MPI profiling interface (PMPI): every call of
+ *           MPI_Send, MPI_Recv, MPI_Probe, MPI_Bcast, MPI_Reduce,
+ *           MPI_Allreduce, MPI_Scatter(v), MPI_Gather(v), MPI_Allgather
+ *           and MPI_Barrier is timed on every rank, with the bytes it
+ *           moves and the time it spent waiting for other ranks.  At
+ *           MPI_Finalize rank 0 collects the calls of all ranks and
+ *           writes
+ *              <prefix>.json  a Chrome trace (chrome://tracing or
+ *                             ui.perfetto.dev): one row per rank, one
+ *                             slice per call, the waiting part nested
+ *                             in it
+ *              <prefix>.txt   time, compute, MPI time, waiting and bytes
+ *                             per rank and per call, and the load
+ *                             imbalance; also printed to stderr
+ *
+ * Compile:  mpicc -g -Wall -O2 -shared -fPIC -o libpmpi_prof.so pmpi_prof.c
+ * Run:      Without relinking (Open MPI; MPICH uses -genv):
+ *              mpiexec -n 4 -x LD_PRELOAD=$PWD/libpmpi_prof.so ./vector_matrix_mpi
+ *           or linked in:
+ *              mpicc -o matrix_multiplication matrix_multiplication.c -L. -lpmpi_prof
+ *           Environment:
+ *              PMPI_PROF_PREFIX      output file prefix (default pmpi_prof)
+ *              PMPI_PROF_MAX_EVENTS  calls kept per rank (default 1000000);
+ *                                    later calls count in the totals only
+ *
+ * Note:     Waiting is
+ *              MPI_Recv:   the time until a matching message is there,
+ *                          measured by PMPI_Mprobe before the receive
+ *              MPI_Probe:  all of it
+ *              collectives: found when the trace is merged, from when
+ *                          the ranks entered the same call: time until
+ *                          the last rank arrived (Allreduce, Allgather,
+ *                          Barrier, and the root of Reduce and Gather),
+ *                          or until the root arrived (Bcast, Scatter)
+ *              MPI_Send:   not separated (it depends on the protocol)
+ *           The clocks of the ranks are aligned with rank 0's at
+ *           MPI_Init by a ping-pong, so a trace from several nodes lines
+ *           up.  Collective calls are matched by the communicator and
+ *           how many collectives came before on it; the first collective
+ *           on a new communicator does one extra PMPI_Allreduce to give
+ *           it an id that all its members agree on.
+ *
+ *           The call records are not locked, so the program may make
+ *           MPI calls from one thread at a time (up to
+ *           MPI_THREAD_SERIALIZED); with MPI_THREAD_MULTIPLE the
+ *           library warns at MPI_Init_thread.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#define PROF_MAX_EVENTS  1000000
+#define PROF_SYNC_ROUNDS 10
+#define PROF_TAG         32767
+#define PROF_CHUNK       (1 << 24)    /* bytes per message at the merge */
+
+/* The calls, in the order of prof_call_name */
+enum {
+   PROF_SEND, PROF_RECV, PROF_PROBE, PROF_BCAST, PROF_REDUCE, PROF_ALLREDUCE,
+   PROF_SCATTER, PROF_SCATTERV, PROF_GATHER, PROF_GATHERV, PROF_ALLGATHER,
+   PROF_BARRIER, PROF_CALLS
+};
+
+static const char* prof_call_name[PROF_CALLS] = {
+   "MPI_Send", "MPI_Recv", "MPI_Probe", "MPI_Bcast", "MPI_Reduce", "MPI_Allreduce",
+   "MPI_Scatter", "MPI_Scatterv", "MPI_Gather", "MPI_Gatherv", "MPI_Allgather",
+   "MPI_Barrier"
+};
+
+/* How the waiting time of a collective is found */
+enum { PROF_WAIT_LOCAL, PROF_WAIT_LAST, PROF_WAIT_ROOT_LAST, PROF_WAIT_ROOT };
+
+static const int prof_wait_kind[PROF_CALLS] = {
+   PROF_WAIT_LOCAL, PROF_WAIT_LOCAL, PROF_WAIT_LOCAL, PROF_WAIT_ROOT, PROF_WAIT_ROOT_LAST,
+   PROF_WAIT_LAST, PROF_WAIT_ROOT, PROF_WAIT_ROOT, PROF_WAIT_ROOT_LAST, PROF_WAIT_ROOT_LAST,
+   PROF_WAIT_LAST, PROF_WAIT_LAST
+};
+
+/* One call */
+typedef struct {
+   double start, end, wait;      /* seconds; wait < 0: not yet known */
+   long long sent, received;     /* bytes */
+   long long seq;                /* collectives on this communicator before it */
+   int call, peer, tag;          /* peer: world rank of the partner or root */
+   int root;                     /* this rank is the root of the collective */
+   int leader, comm_id;
+} prof_event_t;
+
+/* What each rank sends rank 0 at MPI_Finalize */
+typedef struct {
+   double init, finish, offset, mpi_time;
+   long long count, dropped;
+   char host[64];
+} prof_rank_t;
+
+/* Cached on every communicator the program uses */
+typedef struct {
+   MPI_Group group;
+   int leader;                   /* world rank of rank 0 */
+   int id;                       /* -1 until its first collective */
+   long long seq;
+} prof_comm_t;
+
+static prof_event_t* prof_events = NULL;
+static long long prof_count = 0, prof_capacity = 0, prof_max = PROF_MAX_EVENTS, prof_dropped = 0;
+static double prof_init, prof_offset = 0.0, prof_mpi_time = 0.0;
+static int prof_rank = 0, prof_size = 1, prof_keyval = MPI_KEYVAL_INVALID, prof_next_id = 1;
+static MPI_Comm prof_comm = MPI_COMM_NULL;     /* private copy of MPI_COMM_WORLD */
+static MPI_Group prof_world_group;
+
+/*------------------------------------------------------------------
+ * Function:     prof_comm_delete
+ * Purpose:      Attribute delete callback: free a prof_comm_t
+ */
+static int prof_comm_delete(MPI_Comm comm, int keyval, void* attr, void* extra) {
+   prof_comm_t* info = attr;
+
+   (void) comm; (void) keyval; (void) extra;
+   PMPI_Group_free(&info->group);
+   free(info);
+   return MPI_SUCCESS;
+}  /* prof_comm_delete */
+
+/*------------------------------------------------------------------
+ * Function:     prof_comm_info
+ * Purpose:      The cached information of comm, created on first use;
+ *               collective != 0 (all members are in the same call)
+ *               also gives comm its id
+ */
+static prof_comm_t* prof_comm_info(MPI_Comm comm, int collective) {
+   prof_comm_t* info;
+   int found, zero = 0;
+
+   PMPI_Comm_get_attr(comm, prof_keyval, &info, &found);
+   if (!found) {
+      info = malloc(sizeof(prof_comm_t));
+      PMPI_Comm_group(comm, &info->group);
+      PMPI_Group_translate_ranks(info->group, 1, &zero, prof_world_group, &info->leader);
+      info->id = -1;
+      info->seq = 0;
+      PMPI_Comm_set_attr(comm, prof_keyval, info);
+   }
+   if (collective && info->id < 0) {
+      PMPI_Allreduce(&prof_next_id, &info->id, 1, MPI_INT, MPI_MAX, comm);
+      prof_next_id = info->id + 1;
+   }
+   return info;
+}  /* prof_comm_info */
+
+/* World rank of rank r of comm */
+static int prof_world_rank(MPI_Comm comm, int r) {
+   int world = -1;
+
+   if (r < 0) return r;          /* MPI_ANY_SOURCE, MPI_PROC_NULL */
+   PMPI_Group_translate_ranks(prof_comm_info(comm, 0)->group, 1, &r, prof_world_group, &world);
+   return world;
+}  /* prof_world_rank */
+
+static long long prof_bytes(int count, MPI_Datatype type) {
+   int size = 0;
+
+   if (type != MPI_DATATYPE_NULL) PMPI_Type_size(type, &size);
+   return (long long) count*size;
+}  /* prof_bytes */
+
+/*------------------------------------------------------------------
+ * Function:     prof_record
+ * Purpose:      Keep one call (or only count its time when the buffer
+ *               is full)
+ */
+static prof_event_t* prof_record(int call, double start, double end) {
+   prof_event_t* e;
+
+   prof_mpi_time += end - start;
+   if (prof_count >= prof_max) {
+      prof_dropped++;
+      return NULL;
+   }
+   if (prof_count == prof_capacity) {
+      prof_capacity = prof_capacity ? 2*prof_capacity : 4096;
+      if (prof_capacity > prof_max) prof_capacity = prof_max;
+      prof_events = realloc(prof_events, prof_capacity*sizeof(prof_event_t));
+   }
+   e = &prof_events[prof_count++];
+   memset(e, 0, sizeof(*e));
+   e->call = call;
+   e->start = start;
+   e->end = end;
+   e->peer = -1;
+   e->comm_id = -1;
+   return e;
+}  /* prof_record */
+
+/* Record a collective on comm with root (-1: none) */
+static void prof_collective(int call, double start, double end, MPI_Comm comm, int root,
+      long long sent, long long received) {
+   prof_comm_t* info = prof_comm_info(comm, 1);
+   prof_event_t* e = prof_record(call, start, end);
+   int rank;
+
+   if (e != NULL) {
+      PMPI_Comm_rank(comm, &rank);
+      e->wait = -1.0;
+      e->sent = sent;
+      e->received = received;
+      e->peer = prof_world_rank(comm, root);
+      e->root = rank == root;
+      e->leader = info->leader;
+      e->comm_id = info->id;
+      e->seq = info->seq;
+   }
+   info->seq++;
+}  /* prof_collective */
+
+/*------------------------------------------------------------------
+ * Function:     prof_sync_clock
+ * Purpose:      Offset of this rank's MPI_Wtime from rank 0's, from the
+ *               ping-pong with the shortest round trip
+ */
+static void prof_sync_clock(void) {
+   double t0, t1, remote, best_rtt = 1e30;
+   int r, i;
+
+   for (r = 1; r < prof_size; r++)
+      for (i = 0; i < PROF_SYNC_ROUNDS; i++) {
+         if (prof_rank == 0) {
+            PMPI_Recv(&t0, 1, MPI_DOUBLE, r, PROF_TAG, prof_comm, MPI_STATUS_IGNORE);
+            t0 = MPI_Wtime();
+            PMPI_Send(&t0, 1, MPI_DOUBLE, r, PROF_TAG, prof_comm);
+         } else if (prof_rank == r) {
+            t0 = MPI_Wtime();
+            PMPI_Send(&t0, 1, MPI_DOUBLE, 0, PROF_TAG, prof_comm);
+            PMPI_Recv(&remote, 1, MPI_DOUBLE, 0, PROF_TAG, prof_comm, MPI_STATUS_IGNORE);
+            t1 = MPI_Wtime();
+            if (t1 - t0 < best_rtt) {
+               best_rtt = t1 - t0;
+               prof_offset = remote - (t0 + t1)/2.0;
+            }
+         }
+      }
+}  /* prof_sync_clock */
+
+static void prof_start(void) {
+   const char* max = getenv("PMPI_PROF_MAX_EVENTS");
+
+   if (max != NULL) prof_max = atoll(max);
+   PMPI_Comm_dup(MPI_COMM_WORLD, &prof_comm);
+   PMPI_Comm_rank(prof_comm, &prof_rank);
+   PMPI_Comm_size(prof_comm, &prof_size);
+   PMPI_Comm_group(MPI_COMM_WORLD, &prof_world_group);
+   PMPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, prof_comm_delete, &prof_keyval, NULL);
+   prof_sync_clock();
+   PMPI_Barrier(prof_comm);
+   prof_init = MPI_Wtime();
+}  /* prof_start */
+
+/*------------------------------------------------------------------
+ * The wrappers
+ */
+int MPI_Init(int* argc, char*** argv) {
+   int err = PMPI_Init(argc, argv);
+
+   prof_start();
+   return err;
+}
+
+int MPI_Init_thread(int* argc, char*** argv, int required, int* provided) {
+   int err = PMPI_Init_thread(argc, argv, required, provided);
+
+   prof_start();
+   if (*provided == MPI_THREAD_MULTIPLE && prof_rank == 0)
+      fprintf(stderr, "pmpi_prof: MPI_THREAD_MULTIPLE is not supported; calls made by "
+            "several threads at once may be lost or mixed up\n");
+   return err;
+}
+
+int MPI_Send(const void* buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm) {
+   double start = MPI_Wtime();
+   int err = PMPI_Send(buf, count, type, dest, tag, comm);
+   prof_event_t* e = prof_record(PROF_SEND, start, MPI_Wtime());
+
+   if (e != NULL) {
+      e->sent = prof_bytes(count, type);
+      e->peer = prof_world_rank(comm, dest);
+      e->tag = tag;
+   }
+   return err;
+}
+
+int MPI_Recv(void* buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm,
+      MPI_Status* status) {
+   double start = MPI_Wtime(), arrived;
+   MPI_Status probed;
+   MPI_Message message;
+   prof_event_t* e;
+   int err, received = 0;
+
+   /* Wait for the message, then receive exactly the one probed: a
+    * matched probe takes it off the queue, so no other thread's receive
+    * can get it in between */
+   PMPI_Mprobe(source, tag, comm, &message, &probed);
+   arrived = MPI_Wtime();
+   if (source != MPI_PROC_NULL) {
+      source = probed.MPI_SOURCE;
+      tag = probed.MPI_TAG;
+   }
+   err = PMPI_Mrecv(buf, count, type, &message, status == MPI_STATUS_IGNORE ? &probed : status);
+   e = prof_record(PROF_RECV, start, MPI_Wtime());
+   if (e != NULL) {
+      PMPI_Get_count(status == MPI_STATUS_IGNORE ? &probed : status, type, &received);
+      e->received = prof_bytes(received == MPI_UNDEFINED ? 0 : received, type);
+      e->wait = arrived - start;
+      e->peer = prof_world_rank(comm, source);
+      e->tag = tag;
+   }
+   return err;
+}
+
+int MPI_Probe(int source, int tag, MPI_Comm comm, MPI_Status* status) {
+   double start = MPI_Wtime();
+   int err = PMPI_Probe(source, tag, comm, status);
+   prof_event_t* e = prof_record(PROF_PROBE, start, MPI_Wtime());
+
+   if (e != NULL) {
+      e->wait = e->end - e->start;
+      e->peer = prof_world_rank(comm, status != MPI_STATUS_IGNORE ? status->MPI_SOURCE : source);
+      e->tag = tag;
+   }
+   return err;
+}
+
+int MPI_Bcast(void* buf, int count, MPI_Datatype type, int root, MPI_Comm comm) {
+   double start = MPI_Wtime();
+   int err = PMPI_Bcast(buf, count, type, root, comm), rank;
+   long long bytes = prof_bytes(count, type);
+
+   PMPI_Comm_rank(comm, &rank);
+   prof_collective(PROF_BCAST, start, MPI_Wtime(), comm, root,
+         rank == root ? bytes : 0, rank == root ? 0 : bytes);
+   return err;
+}
+
+int MPI_Reduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype type, MPI_Op op,
+      int root, MPI_Comm comm) {
+   double start = MPI_Wtime();
+   int err = PMPI_Reduce(sendbuf, recvbuf, count, type, op, root, comm), rank;
+   long long bytes = prof_bytes(count, type);
+
+   PMPI_Comm_rank(comm, &rank);
+   prof_collective(PROF_REDUCE, start, MPI_Wtime(), comm, root, bytes, rank == root ? bytes : 0);
+   return err;
+}
+
+int MPI_Allreduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype type, MPI_Op op,
+      MPI_Comm comm) {
+   double start = MPI_Wtime();
+   int err = PMPI_Allreduce(sendbuf, recvbuf, count, type, op, comm);
+   long long bytes = prof_bytes(count, type);
+
+   prof_collective(PROF_ALLREDUCE, start, MPI_Wtime(), comm, -1, bytes, bytes);
+   return err;
+}
+
+int MPI_Scatter(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf,
+      int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm) {
+   double start = MPI_Wtime();
+   int err = PMPI_Scatter(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm);
+   int rank, size;
+
+   PMPI_Comm_rank(comm, &rank);
+   PMPI_Comm_size(comm, &size);
+   prof_collective(PROF_SCATTER, start, MPI_Wtime(), comm, root,
+         rank == root ? prof_bytes(sendcount, sendtype)*size : 0,
+         recvbuf == MPI_IN_PLACE ? 0 : prof_bytes(recvcount, recvtype));
+   return err;
+}
+
+int MPI_Scatterv(const void* sendbuf, const int sendcounts[], const int displs[],
+      MPI_Datatype sendtype, void* recvbuf, int recvcount, MPI_Datatype recvtype, int root,
+      MPI_Comm comm) {
+   double start = MPI_Wtime();
+   int err = PMPI_Scatterv(sendbuf, sendcounts, displs, sendtype, recvbuf, recvcount, recvtype,
+         root, comm);
+   int rank, size, i;
+   long long sent = 0;
+
+   PMPI_Comm_rank(comm, &rank);
+   PMPI_Comm_size(comm, &size);
+   if (rank == root)
+      for (i = 0; i < size; i++) sent += prof_bytes(sendcounts[i], sendtype);
+   prof_collective(PROF_SCATTERV, start, MPI_Wtime(), comm, root, sent,
+         recvbuf == MPI_IN_PLACE ? 0 : prof_bytes(recvcount, recvtype));
+   return err;
+}
+
+int MPI_Gather(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf,
+      int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm) {
+   double start = MPI_Wtime();
+   int err = PMPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm);
+   int rank, size;
+
+   PMPI_Comm_rank(comm, &rank);
+   PMPI_Comm_size(comm, &size);
+   prof_collective(PROF_GATHER, start, MPI_Wtime(), comm, root,
+         sendbuf == MPI_IN_PLACE ? 0 : prof_bytes(sendcount, sendtype),
+         rank == root ? prof_bytes(recvcount, recvtype)*size : 0);
+   return err;
+}
+
+int MPI_Gatherv(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf,
+      const int recvcounts[], const int displs[], MPI_Datatype recvtype, int root,
+      MPI_Comm comm) {
+   double start = MPI_Wtime();
+   int err = PMPI_Gatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype,
+         root, comm);
+   int rank, size, i;
+   long long received = 0;
+
+   PMPI_Comm_rank(comm, &rank);
+   PMPI_Comm_size(comm, &size);
+   if (rank == root)
+      for (i = 0; i < size; i++) received += prof_bytes(recvcounts[i], recvtype);
+   prof_collective(PROF_GATHERV, start, MPI_Wtime(), comm, root,
+         sendbuf == MPI_IN_PLACE ? 0 : prof_bytes(sendcount, sendtype), received);
+   return err;
+}
+
+int MPI_Allgather(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf,
+      int recvcount, MPI_Datatype recvtype, MPI_Comm comm) {
+   double start = MPI_Wtime();
+   int err = PMPI_Allgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+   int size;
+
+   PMPI_Comm_size(comm, &size);
+   prof_collective(PROF_ALLGATHER, start, MPI_Wtime(), comm, -1,
+         sendbuf == MPI_IN_PLACE ? prof_bytes(recvcount, recvtype) : prof_bytes(sendcount, sendtype),
+         prof_bytes(recvcount, recvtype)*size);
+   return err;
+}
+
+int MPI_Barrier(MPI_Comm comm) {
+   double start = MPI_Wtime();
+   int err = PMPI_Barrier(comm);
+
+   prof_collective(PROF_BARRIER, start, MPI_Wtime(), comm, -1, 0, 0);
+   return err;
+}
+
+/*------------------------------------------------------------------
+ * Function:     prof_instance_cmp
+ * Purpose:      Order collective calls by communicator and sequence
+ *               number, so the calls of one instance are adjacent
+ */
+static int prof_instance_cmp(const void* a_p, const void* b_p) {
+   const prof_event_t *a = *(prof_event_t* const*) a_p, *b = *(prof_event_t* const*) b_p;
+
+   if (a->leader != b->leader) return a->leader - b->leader;
+   if (a->comm_id != b->comm_id) return a->comm_id - b->comm_id;
+   return (a->seq > b->seq) - (a->seq < b->seq);
+}  /* prof_instance_cmp */
+
+/*------------------------------------------------------------------
+ * Function:     prof_collective_waits
+ * Purpose:      The waiting time of every collective call, from the
+ *               entry times of all the calls of its instance
+ */
+static void prof_collective_waits(prof_event_t* events, long long count) {
+   prof_event_t** coll = malloc((count + 1)*sizeof(prof_event_t*));
+   long long n = 0, i, j, k;
+   double last, root_entry, wait;
+
+   for (i = 0; i < count; i++)
+      if (events[i].wait < 0.0) coll[n++] = &events[i];
+   qsort(coll, n, sizeof(prof_event_t*), prof_instance_cmp);
+   for (i = 0; i < n; i = j) {
+      last = coll[i]->start;
+      root_entry = -1.0;
+      for (j = i; j < n && prof_instance_cmp(&coll[i], &coll[j]) == 0; j++) {
+         if (coll[j]->start > last) last = coll[j]->start;
+         if (coll[j]->root) root_entry = coll[j]->start;
+      }
+      for (k = i; k < j; k++) {
+         prof_event_t* e = coll[k];
+
+         switch (prof_wait_kind[e->call]) {
+            case PROF_WAIT_LAST:
+               wait = last - e->start;
+               break;
+            case PROF_WAIT_ROOT_LAST:
+               wait = e->root ? last - e->start : 0.0;
+               break;
+            case PROF_WAIT_ROOT:
+               wait = (root_entry >= 0.0 && !e->root) ? root_entry - e->start : 0.0;
+               break;
+            default:
+               wait = 0.0;
+         }
+         if (wait < 0.0) wait = 0.0;
+         if (wait > e->end - e->start) wait = e->end - e->start;
+         e->wait = wait;
+      }
+   }
+   free(coll);
+}  /* prof_collective_waits */
+
+/*------------------------------------------------------------------
+ * Function:     prof_write_trace
+ * Purpose:      Chrome trace event format, times in microseconds from
+ *               the earliest MPI_Init
+ */
+static void prof_write_trace(FILE* out, const prof_rank_t* ranks, const prof_event_t* events,
+      const long long* first, double origin) {
+   const prof_event_t* e;
+   long long i;
+   int r;
+
+   fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+   for (r = 0; r < prof_size; r++) {
+      fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, "
+            "\"args\": {\"name\": \"rank %d (%s)\"}},\n", r, r, ranks[r].host);
+      fprintf(out, "{\"name\": \"process_sort_index\", \"ph\": \"M\", \"pid\": %d, "
+            "\"args\": {\"sort_index\": %d}},\n", r, r);
+      fprintf(out, "{\"name\": \"MPI_Init .. MPI_Finalize\", \"cat\": \"run\", \"ph\": \"X\", "
+            "\"pid\": %d, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f},\n", r,
+            1e6*(ranks[r].init - origin), 1e6*(ranks[r].finish - ranks[r].init));
+      for (i = first[r]; i < first[r+1]; i++) {
+         e = &events[i];
+         fprintf(out, "{\"name\": \"%s\", \"cat\": \"mpi\", \"ph\": \"X\", \"pid\": %d, \"tid\": 1, "
+               "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"peer\": %d, \"tag\": %d, "
+               "\"bytes_sent\": %lld, \"bytes_received\": %lld, \"wait_us\": %.3f}},\n",
+               prof_call_name[e->call], r, 1e6*(e->start - origin), 1e6*(e->end - e->start),
+               e->peer, e->tag, e->sent, e->received, 1e6*e->wait);
+         if (e->wait > 0.0)
+            fprintf(out, "{\"name\": \"wait\", \"cat\": \"wait\", \"ph\": \"X\", \"pid\": %d, "
+                  "\"tid\": 1, \"ts\": %.3f, \"dur\": %.3f},\n", r, 1e6*(e->start - origin),
+                  1e6*e->wait);
+      }
+   }
+   fprintf(out, "{\"name\": \"trace end\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 0, \"tid\": 0, "
+         "\"ts\": 0}\n]}\n");
+}  /* prof_write_trace */
+
+/*------------------------------------------------------------------
+ * Function:     prof_write_summary
+ * Purpose:      Per rank and per call totals, and the load imbalance
+ */
+static void prof_write_summary(FILE* out, const prof_rank_t* ranks, const prof_event_t* events,
+      const long long* first) {
+   double* wait = calloc(prof_size, sizeof(double));
+   double* compute = malloc(prof_size*sizeof(double));
+   long long* sent = calloc(prof_size, sizeof(long long));
+   long long* received = calloc(prof_size, sizeof(long long));
+   double call_time[PROF_CALLS] = {0}, call_wait[PROF_CALLS] = {0}, call_max[PROF_CALLS] = {0};
+   double rank_call[PROF_CALLS], wall, sum = 0.0, max_c = -1.0, min_c = 1e30, max_w = -1.0;
+   long long call_count[PROF_CALLS] = {0}, call_bytes[PROF_CALLS] = {0}, dropped = 0, i;
+   int r, c, max_rank = 0, min_rank = 0, wait_rank = 0;
+
+   fprintf(out, "PMPI profile of %d ranks\n", prof_size);
+   fprintf(out, "%5s  %-16s %10s %10s %10s %10s %14s %14s %9s\n", "rank", "host", "wall (s)",
+         "compute", "MPI", "waiting", "bytes sent", "bytes recvd", "calls");
+   for (r = 0; r < prof_size; r++) {
+      for (c = 0; c < PROF_CALLS; c++) rank_call[c] = 0.0;
+      for (i = first[r]; i < first[r+1]; i++) {
+         const prof_event_t* e = &events[i];
+
+         wait[r] += e->wait;
+         sent[r] += e->sent;
+         received[r] += e->received;
+         call_count[e->call]++;
+         call_time[e->call] += e->end - e->start;
+         call_wait[e->call] += e->wait;
+         call_bytes[e->call] += e->sent + e->received;
+         rank_call[e->call] += e->end - e->start;
+      }
+      for (c = 0; c < PROF_CALLS; c++)
+         if (rank_call[c] > call_max[c]) call_max[c] = rank_call[c];
+      wall = ranks[r].finish - ranks[r].init;
+      compute[r] = wall - ranks[r].mpi_time;
+      dropped += ranks[r].dropped;
+      fprintf(out, "%5d  %-16.16s %10.6f %10.6f %10.6f %10.6f %14lld %14lld %9lld\n", r,
+            ranks[r].host, wall, compute[r], ranks[r].mpi_time, wait[r], sent[r], received[r],
+            ranks[r].count + ranks[r].dropped);
+      sum += compute[r];
+      if (compute[r] > max_c) { max_c = compute[r]; max_rank = r; }
+      if (compute[r] < min_c) { min_c = compute[r]; min_rank = r; }
+      if (wait[r] > max_w) { max_w = wait[r]; wait_rank = r; }
+   }
+
+   fprintf(out, "\n%-14s %10s %12s %12s %16s %14s\n", "call", "calls", "time (s)", "waiting",
+         "bytes", "max/avg rank");
+   for (c = 0; c < PROF_CALLS; c++)
+      if (call_count[c] > 0)
+         fprintf(out, "%-14s %10lld %12.6f %12.6f %16lld %14.2f\n", prof_call_name[c],
+               call_count[c], call_time[c], call_wait[c], call_bytes[c],
+               call_time[c] > 0.0 ? call_max[c]/(call_time[c]/prof_size) : 0.0);
+
+   fprintf(out, "\nload imbalance: compute max %.6f s (rank %d), mean %.6f s, min %.6f s (rank %d)\n",
+         max_c, max_rank, sum/prof_size, min_c, min_rank);
+   if (max_c > 0.0)
+      fprintf(out, "   max/mean %.2f, (max - mean)/max %.1f%%: rank %d is the straggler\n",
+            max_c/(sum/prof_size), 100.0*(max_c - sum/prof_size)/max_c, max_rank);
+   fprintf(out, "   most waiting: rank %d, %.6f s (%.1f%% of its wall time)\n", wait_rank, max_w,
+         100.0*max_w/(ranks[wait_rank].finish - ranks[wait_rank].init + 1e-30));
+   if (dropped > 0)
+      fprintf(out, "   %lld calls beyond PMPI_PROF_MAX_EVENTS count in MPI time but not in the "
+            "waiting, bytes and per call columns\n", dropped);
+   free(wait);
+   free(compute);
+   free(sent);
+   free(received);
+}  /* prof_write_summary */
+
+int MPI_Finalize(void) {
+   prof_rank_t mine, *ranks = NULL;
+   prof_event_t* all = NULL;
+   long long *first = NULL, i, bytes, offset;
+   const char* prefix = getenv("PMPI_PROF_PREFIX");
+   char name[512];
+   double origin;
+   int r, len;
+   FILE* out;
+
+   memset(&mine, 0, sizeof(mine));
+   mine.finish = MPI_Wtime() + prof_offset;
+   mine.init = prof_init + prof_offset;
+   mine.offset = prof_offset;
+   mine.mpi_time = prof_mpi_time;
+   mine.count = prof_count;
+   mine.dropped = prof_dropped;
+   PMPI_Get_processor_name(name, &len);
+   snprintf(mine.host, sizeof(mine.host), "%.63s", name);
+   for (i = 0; i < prof_count; i++) {
+      prof_events[i].start += prof_offset;
+      prof_events[i].end += prof_offset;
+   }
+
+   /* Collect everything on rank 0 */
+   if (prof_rank == 0) ranks = malloc(prof_size*sizeof(prof_rank_t));
+   PMPI_Gather(&mine, sizeof(mine), MPI_BYTE, ranks, sizeof(mine), MPI_BYTE, 0, prof_comm);
+   if (prof_rank == 0) {
+      first = malloc((prof_size + 1)*sizeof(long long));
+      first[0] = 0;
+      for (r = 0; r < prof_size; r++) first[r+1] = first[r] + ranks[r].count;
+      all = malloc((first[prof_size] + 1)*sizeof(prof_event_t));
+      if (prof_count > 0) memcpy(all, prof_events, prof_count*sizeof(prof_event_t));
+      for (r = 1; r < prof_size; r++) {
+         bytes = ranks[r].count*(long long) sizeof(prof_event_t);
+         for (offset = 0; offset < bytes; offset += PROF_CHUNK)
+            PMPI_Recv((char*)(all + first[r]) + offset,
+                  (int)(bytes - offset < PROF_CHUNK ? bytes - offset : PROF_CHUNK), MPI_BYTE,
+                  r, PROF_TAG, prof_comm, MPI_STATUS_IGNORE);
+      }
+   } else {
+      bytes = prof_count*(long long) sizeof(prof_event_t);
+      for (offset = 0; offset < bytes; offset += PROF_CHUNK)
+         PMPI_Send((char*) prof_events + offset,
+               (int)(bytes - offset < PROF_CHUNK ? bytes - offset : PROF_CHUNK), MPI_BYTE,
+               0, PROF_TAG, prof_comm);
+   }
+
+   if (prof_rank == 0) {
+      prof_collective_waits(all, first[prof_size]);
+      origin = ranks[0].init;
+      for (r = 1; r < prof_size; r++)
+         if (ranks[r].init < origin) origin = ranks[r].init;
+      if (prefix == NULL) prefix = "pmpi_prof";
+
+      snprintf(name, sizeof(name), "%s.json", prefix);
+      if ((out = fopen(name, "w")) != NULL) {
+         prof_write_trace(out, ranks, all, first, origin);
+         fclose(out);
+      } else {
+         fprintf(stderr, "pmpi_prof: can't write %s\n", name);
+      }
+      snprintf(name, sizeof(name), "%s.txt", prefix);
+      if ((out = fopen(name, "w")) != NULL) {
+         prof_write_summary(out, ranks, all, first);
+         fclose(out);
+      }
+      prof_write_summary(stderr, ranks, all, first);
+      fprintf(stderr, "pmpi_prof: trace in %s.json (chrome://tracing or ui.perfetto.dev)\n", prefix);
+      free(all);
+      free(first);
+      free(ranks);
+   }
+
+   free(prof_events);
+   PMPI_Comm_free(&prof_comm);
+   PMPI_Group_free(&prof_world_group);
+   PMPI_Comm_free_keyval(&prof_keyval);
+   return PMPI_Finalize();
+}
@@ -0,0 +1,321 @@
+/***********************************************************
+* Program:
+    Project: running sums of the arithmetic series a + d*i
+*
+* mpi.c adds up the n terms of the series; this program computes
+* every prefix (inclusive or exclusive scan) with scan.h, using MPI
+* between processes and OpenMP threads inside each one.  Besides the
+* sum it can scan with max, min, prod, or a user operation: "affine"
+* composes the maps y -> A*y + (a + d*i), which is associative but not
+* commutative, so the scan is the recurrence y_i = A*y_(i-1) + a + d*i
+* (mod 2^64).
+*
+* Each process checks its own results (every prefix against the one
+* before it, and its first prefix against the last one of the process
+* before) and writes them, if asked, to its own file <prefix>.<rank>;
+* nothing is gathered to the master.
+*
+* Compile:  mpicc -O3 -march=native -fopenmp -o mpi_scan mpi_scan.c -lm
+* Run:      OMP_NUM_THREADS=<threads> mpirun -np <ranks> ./mpi_scan
+*               <a> <d> <n> [long:sum|double:max|...|affine]
+*               [inclusive|exclusive] [stream|memory] [output prefix]
+*************************************************************/
+#include <mpi.h>
+#include <omp.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "scan.h"
+
+// Marcos
+#define MASTER 0      /* rank of the master */
+#define BLOCK_LOW(id,p,n)   ((long)(id)*(n)/(p))
+#define STREAM_BLOCK (1L << 20)   /* elements per block when streaming */
+#define AFFINE_A 6364136223846793005ull
+
+/* An affine map y -> m*y + c, mod 2^64 */
+typedef struct {
+    uint64_t m, c;
+} affine_t;
+
+/* What the fill and sink callbacks need */
+typedef struct {
+    const scan_op_t* op;
+    int kind;                 /* 0 long, 1 double, 2 affine */
+    int exact;                /* compare bit for bit */
+    int inclusive;
+    long long a, d;
+    long checked, wrong;
+    int seen;                 /* any prefix yet */
+    scan_value_t prev_out;    /* last prefix seen */
+    scan_value_t prev_x;      /* and its element */
+    scan_value_t first_out;   /* first prefix of this process */
+    FILE* out;
+} series_t;
+
+/*------------------------------------------------------------------
+ * Function:     affine_compose
+ * Purpose:      MPI_User_function: inout[i] = inout[i] after in[i],
+ *               i.e. apply in[i] first
+ */
+void affine_compose(void* in_p, void* inout_p, int* len, MPI_Datatype* type) {
+    affine_t *in = in_p, *inout = inout_p;
+    int i;
+
+    (void) type;
+    for (i = 0; i < *len; i++) {
+        inout[i].c = inout[i].m * in[i].c + inout[i].c;
+        inout[i].m = inout[i].m * in[i].m;
+    }
+}
+
+/* The last prefix of a process and its element, for the check of the
+ * next process that has elements */
+typedef struct {
+    int valid;                /* the process has elements */
+    scan_value_t out, x;
+} boundary_t;
+
+/*------------------------------------------------------------------
+ * Function:     latest_boundary
+ * Purpose:      MPI_User_function: keep inout[i] if its process has
+ *               elements, else take in[i], from the processes before;
+ *               under MPI_Exscan each process gets the boundary of the
+ *               nearest process before it that has elements
+ */
+void latest_boundary(void* in_p, void* inout_p, int* len, MPI_Datatype* type) {
+    boundary_t *in = in_p, *inout = inout_p;
+    int i;
+
+    (void) type;
+    for (i = 0; i < *len; i++)
+        if (!inout[i].valid) inout[i] = in[i];
+}
+
+/*------------------------------------------------------------------
+ * Function:     term
+ * Purpose:      Element i of the series, as the scanned type
+ */
+void term(const series_t* s, long i, void* x) {
+    long long v = s->a + s->d * (long long) i;
+
+    if (s->kind == 0) {
+        *(int64_t*) x = v;
+    } else if (s->kind == 1) {
+        *(double*) x = (double) v;
+    } else {
+        ((affine_t*) x)->m = AFFINE_A;
+        ((affine_t*) x)->c = (uint64_t) v;
+    }
+}
+
+/*------------------------------------------------------------------
+ * Function:     fill
+ * Purpose:      scan_fill_fn: elements first .. first+count-1
+ */
+void fill(void* buf, long first, long count, void* ctx) {
+    const series_t* s = ctx;
+    long i;
+
+    for (i = 0; i < count; i++)
+        term(s, first + i, (char*) buf + i * s->op->size);
+}
+
+/*------------------------------------------------------------------
+ * Function:     matches
+ * Purpose:      1 if got equals want: bit for bit for integer and
+ *               max/min scans, to a relative 1e-12 for double sums and
+ *               products, which are grouped differently
+ */
+int matches(const series_t* s, const void* got, const void* want) {
+    double g, w;
+
+    if (s->exact) return memcmp(got, want, s->op->size) == 0;
+    g = *(const double*) got;
+    w = *(const double*) want;
+    return g == w || fabs(g - w) <= 1e-12 * fabs(w);
+}
+
+/*------------------------------------------------------------------
+ * Function:     check
+ * Purpose:      Check prefix i against prefix i-1 (the first prefix of
+ *               the process is checked after the scan, with the last
+ *               prefix of the process before), and remember it
+ */
+void check(series_t* s, long i, const void* out) {
+    scan_value_t x, want;
+
+    term(s, i, x.bytes);
+    if (!s->seen) {
+        memcpy(s->first_out.bytes, out, s->op->size);
+    } else {
+        /* inclusive: out_i = out_(i-1) op x_i; exclusive: out_(i-1) op x_(i-1) */
+        memcpy(want.bytes, s->prev_out.bytes, s->op->size);
+        scan_reduce(s->op, s->inclusive ? x.bytes : s->prev_x.bytes, 1, want.bytes);
+        if (!matches(s, out, want.bytes)) s->wrong++;
+        s->checked++;
+    }
+    memcpy(s->prev_out.bytes, out, s->op->size);
+    memcpy(s->prev_x.bytes, x.bytes, s->op->size);
+    s->seen = 1;
+}
+
+/*------------------------------------------------------------------
+ * Function:     sink
+ * Purpose:      scan_sink_fn: check a block of prefixes and write it
+ *               to this process' file
+ */
+void sink(const void* buf, long first, long count, void* ctx) {
+    series_t* s = ctx;
+    long i;
+
+    for (i = 0; i < count; i++)
+        check(s, first + i, (const char*) buf + i * s->op->size);
+    if (s->out != NULL) fwrite(buf, s->op->size, count, s->out);
+}
+
+int main(int argc, char *argv[]) {
+    int rank, nprocs, provided, inclusive = 1, stream = 1;
+    long n, first, last, wrong, checked;
+    double start_time, elapsed, max_elapsed;
+    char type[16], file_name[256], last_value[64], *colon;
+    const char* op_spec;
+    affine_t identity = {1, 0};
+    scan_value_t want;
+    boundary_t boundary, before;
+    MPI_Datatype affine_mpi_t = MPI_DATATYPE_NULL, boundary_mpi_t;
+    MPI_Op boundary_op;
+    scan_op_t op;
+    series_t s;
+    void* buf;
+    long i;
+
+    /* Start up MPI; only the master thread of each rank makes MPI calls */
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    /* Get input from the command line */
+    if (argc < 4) {
+        if (rank == MASTER)
+            printf("usage: ./mpi_scan <a> <d> <n> [long:sum|long:prod|long:max|long:min|double:...|affine] "
+                   "[inclusive|exclusive] [stream|memory] [output prefix]\n");
+        MPI_Finalize();
+        exit(-1);
+    }
+    memset(&s, 0, sizeof(s));
+    s.a = strtoll(argv[1], NULL, 10);
+    s.d = strtoll(argv[2], NULL, 10);
+    n = strtol(argv[3], NULL, 10);
+    op_spec = (argc > 4) ? argv[4] : "long:sum";
+    if (argc > 5) inclusive = strcmp(argv[5], "exclusive") != 0;
+    if (argc > 6) stream = strcmp(argv[6], "memory") != 0;
+    s.inclusive = inclusive;
+
+    /* The operation */
+    if (strcmp(op_spec, "affine") == 0) {
+        MPI_Type_contiguous(2, MPI_UINT64_T, &affine_mpi_t);
+        MPI_Type_commit(&affine_mpi_t);
+        scan_op_create(affine_compose, 0, affine_mpi_t, &identity, "affine", &op);
+        s.kind = 2;
+        s.exact = 1;
+    } else {
+        colon = strchr(op_spec, ':');
+        snprintf(type, sizeof(type), "%.*s", colon ? (int)(colon - op_spec) : 0, op_spec);
+        if (colon == NULL || scan_op_builtin(type, colon + 1, &op) != 0) {
+            if (rank == MASTER) printf("unknown operation %s\n", op_spec);
+            MPI_Finalize();
+            exit(-1);
+        }
+        s.kind = (strcmp(type, "double") == 0);
+        s.exact = !s.kind || strcmp(colon + 1, "max") == 0 || strcmp(colon + 1, "min") == 0;
+    }
+    s.op = &op;
+
+    /* My block of the series */
+    first = BLOCK_LOW(rank, nprocs, n);
+    last = BLOCK_LOW(rank + 1, nprocs, n);
+    if (argc > 7) {
+        snprintf(file_name, sizeof(file_name), "%s.%d", argv[7], rank);
+        s.out = fopen(file_name, "wb");
+        if (s.out == NULL) printf("rank %d: can't open %s\n", rank, file_name);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start_time = MPI_Wtime();
+    if (stream) {
+        scan_stream(&op, first, last - first, STREAM_BLOCK, fill, sink, &s, inclusive, MPI_COMM_WORLD);
+        elapsed = MPI_Wtime() - start_time;
+    } else {
+        buf = malloc((last - first + 1) * op.size);
+        # pragma omp parallel for schedule(static)
+        for (i = 0; i < last - first; i++)
+            term(&s, first + i, (char*) buf + i * op.size);
+        MPI_Barrier(MPI_COMM_WORLD);
+        start_time = MPI_Wtime();
+        scan_array(&op, buf, buf, last - first, inclusive, MPI_COMM_WORLD);
+        elapsed = MPI_Wtime() - start_time;
+        sink(buf, first, last - first, &s);
+        free(buf);
+    }
+    if (s.out != NULL) fclose(s.out);
+
+    /* Check my first prefix against the last prefix of the nearest rank
+     * before me that has elements (with n < nprocs some have none) */
+    memset(&boundary, 0, sizeof(boundary));
+    memset(&before, 0, sizeof(before));
+    boundary.valid = (last > first);
+    if (boundary.valid) {
+        memcpy(boundary.out.bytes, s.prev_out.bytes, op.size);
+        memcpy(boundary.x.bytes, s.prev_x.bytes, op.size);
+    }
+    MPI_Type_contiguous((int) sizeof(boundary_t), MPI_BYTE, &boundary_mpi_t);
+    MPI_Type_commit(&boundary_mpi_t);
+    MPI_Op_create(latest_boundary, 0, &boundary_op);
+    MPI_Exscan(&boundary, &before, 1, boundary_mpi_t, boundary_op, MPI_COMM_WORLD);
+    MPI_Op_free(&boundary_op);
+    MPI_Type_free(&boundary_mpi_t);
+    if (rank == 0) before.valid = 0;      /* MPI_Exscan leaves it undefined */
+    if (last > first && (first == 0 || before.valid)) {
+        if (first == 0) {
+            /* inclusive: x_0; exclusive: the identity */
+            if (inclusive) term(&s, 0, want.bytes);
+            else memcpy(want.bytes, op.identity.bytes, op.size);
+        } else {
+            memcpy(want.bytes, before.out.bytes, op.size);
+            if (inclusive) term(&s, first, before.x.bytes);
+            scan_reduce(&op, before.x.bytes, 1, want.bytes);
+        }
+        s.wrong += !matches(&s, s.first_out.bytes, want.bytes);
+        s.checked++;
+    }
+
+    /* My last prefix */
+    if (last == first)
+        snprintf(last_value, sizeof(last_value), "-");
+    else if (s.kind == 0)
+        snprintf(last_value, sizeof(last_value), "%lld", (long long) s.prev_out.l);
+    else if (s.kind == 1)
+        snprintf(last_value, sizeof(last_value), "%.17g", s.prev_out.d);
+    else
+        snprintf(last_value, sizeof(last_value), "y = %llu", (unsigned long long) ((affine_t*) s.prev_out.bytes)->c);
+    printf("rank %d: prefixes %ld..%ld, last %s, %ld checked, %ld wrong, %.6f s%s%s\n",
+           rank, first, last - 1, last_value, s.checked, s.wrong, elapsed,
+           s.out != NULL ? ", written to " : "", s.out != NULL ? file_name : "");
+
+    MPI_Reduce(&s.wrong, &wrong, 1, MPI_LONG, MPI_SUM, MASTER, MPI_COMM_WORLD);
+    MPI_Reduce(&s.checked, &checked, 1, MPI_LONG, MPI_SUM, MASTER, MPI_COMM_WORLD);
+    MPI_Reduce(&elapsed, &max_elapsed, 1, MPI_DOUBLE, MPI_MAX, MASTER, MPI_COMM_WORLD);
+    if (rank == MASTER)
+        printf("%s %s scan of %ld terms (%s), %d ranks x %d threads: %.6f s, %.2f ns per element, %ld of %ld prefixes wrong\n",
+               op.name, inclusive ? "inclusive" : "exclusive", n, stream ? "streamed" : "in memory",
+               nprocs, omp_get_max_threads(), max_elapsed, 1e9 * max_elapsed / (n > 0 ? n : 1),
+               wrong, checked);
+
+    scan_op_free(&op);
+    if (affine_mpi_t != MPI_DATATYPE_NULL) MPI_Type_free(&affine_mpi_t);
+    MPI_Finalize();
+    return 0;
+}/*  main  */
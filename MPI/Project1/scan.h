@@ -0,0 +1,409 @@
+/* File:     scan.h
+ * Purpose:  Distributed prefix sums (scans) with any associative
+ *           operation: the running totals of mpi.c's series, not just
+ *           the last one.
+ *
+ * Usage:    scan_op_t op;
+ *           scan_op_builtin("long", "sum", &op);        or "double", max ...
+ *           scan_op_create(fn, commute, type, &identity, "name", &op);
+ *
+ *           In memory (every process scans its block of the sequence):
+ *              scan_array(&op, in, out, n, SCAN_INCLUSIVE, comm);
+ *           Streaming (elements generated and consumed block by block,
+ *           for sequences that don't fit in memory):
+ *              scan_stream(&op, first, count, block, fill, sink, ctx,
+ *                    SCAN_EXCLUSIVE, comm);
+ *
+ *           scan_op_free(&op);
+ *
+ * Compile:  with -O3 -fopenmp (and -march=native for the widest SIMD)
+ *
+ * Note:     Three levels:
+ *           1.  Within a thread, scan_local scans groups of SCAN_LANES
+ *               elements with log2(SCAN_LANES) shifted combines (level
+ *               one, which the compiler can vectorize) and then adds
+ *               the running carry to the whole group (level two), so
+ *               the chain of dependent operations is one per group
+ *               instead of one per element.
+ *           2.  Within a process, the work-efficient two-pass scan:
+ *               every thread reduces its block, the thread totals are
+ *               scanned, and every thread scans its block starting
+ *               from its carry: about 2n operations for any number of
+ *               threads.
+ *           3.  Between processes, MPI_Exscan of the process totals,
+ *               called by the master thread between the two passes
+ *               (MPI_THREAD_FUNNELED is enough).
+ *           The results stay in each process' buffer or go to its sink;
+ *           nothing is gathered.
+ *
+ *           The operation combines an earlier value with a later one,
+ *           out = earlier op later, as for MPI_User_function
+ *           (inoutvec = invec op inoutvec).  The built-in operations are
+ *           commutative and use the grouped kernels; user operations
+ *           need only be associative and are applied in order.
+ */
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+#include <mpi.h>
+
+#define SCAN_INCLUSIVE  1
+#define SCAN_EXCLUSIVE  0
+#define SCAN_LANES      8
+#define SCAN_MAX_SIZE   64     /* largest element, in bytes */
+#define SCAN_BLOCK_LOW(id,p,n)  ((long)(id)*(n)/(p))
+
+/* acc = acc op x[0] op ... op x[n-1] */
+typedef void (*scan_reduce_fn)(const void* x, long n, void* acc);
+
+/* out[i] = carry op in[0] op ... op in[i] (inclusive) or the same
+ * without in[i] (exclusive); carry becomes carry op (all of in) */
+typedef void (*scan_scan_fn)(const void* in, void* out, long n, void* carry,
+      int inclusive);
+
+typedef union {
+   unsigned char bytes[SCAN_MAX_SIZE];
+   int64_t l;
+   double d;
+} scan_value_t;
+
+typedef struct {
+   char name[32];
+   size_t size;
+   MPI_Datatype type;
+   MPI_Op mpi_op;
+   MPI_User_function* fn;      /* user operations */
+   scan_reduce_fn reduce;      /* built-in operations */
+   scan_scan_fn scan;
+   scan_value_t identity;
+   int user;
+} scan_op_t;
+
+/* Generate the grouped reduce and scan kernels of a commutative
+ * operation OP(earlier, later) on type T */
+#define SCAN_KERNELS(T, NAME, OP)                                          \
+static void scan_reduce_##NAME(const void* x_p, long n, void* acc_p) {     \
+   const T* x = x_p;                                                       \
+   T lane[SCAN_LANES], acc = *(T*) acc_p;                                  \
+   long i = 0;                                                             \
+   int k;                                                                  \
+                                                                           \
+   if (n >= 2*SCAN_LANES) {                                                \
+      for (k = 0; k < SCAN_LANES; k++) lane[k] = x[k];                     \
+      for (i = SCAN_LANES; i + SCAN_LANES <= n; i += SCAN_LANES)           \
+         for (k = 0; k < SCAN_LANES; k++) lane[k] = OP(lane[k], x[i+k]);   \
+      for (k = 0; k < SCAN_LANES; k++) acc = OP(acc, lane[k]);             \
+   }                                                                       \
+   for (; i < n; i++) acc = OP(acc, x[i]);                                 \
+   *(T*) acc_p = acc;                                                      \
+}                                                                          \
+                                                                           \
+static void scan_scan_##NAME(const void* in_p, void* out_p, long n,        \
+      void* carry_p, int inclusive) {                                      \
+   const T* in = in_p;                                                     \
+   T* out = out_p;                                                         \
+   T t[SCAN_LANES], u[SCAN_LANES], carry = *(T*) carry_p, prev;            \
+   long i;                                                                 \
+   int k, s;                                                               \
+                                                                           \
+   for (i = 0; i + SCAN_LANES <= n; i += SCAN_LANES) {                     \
+      /* Level one: scan of the group by shifted combines */               \
+      for (k = 0; k < SCAN_LANES; k++) t[k] = in[i+k];                     \
+      for (s = 1; s < SCAN_LANES; s *= 2) {                                \
+         for (k = 0; k < SCAN_LANES; k++)                                  \
+            u[k] = (k >= s) ? OP(t[k-s], t[k]) : t[k];                     \
+         for (k = 0; k < SCAN_LANES; k++) t[k] = u[k];                     \
+      }                                                                    \
+      /* Level two: the carry of the earlier groups */                     \
+      if (inclusive) {                                                     \
+         for (k = 0; k < SCAN_LANES; k++) out[i+k] = OP(carry, t[k]);      \
+      } else {                                                             \
+         out[i] = carry;                                                   \
+         for (k = 1; k < SCAN_LANES; k++) out[i+k] = OP(carry, t[k-1]);    \
+      }                                                                    \
+      carry = OP(carry, t[SCAN_LANES-1]);                                  \
+   }                                                                       \
+   for (; i < n; i++) {                                                    \
+      prev = carry;                                                        \
+      carry = OP(carry, in[i]);                                            \
+      out[i] = inclusive ? carry : prev;                                   \
+   }                                                                       \
+   *(T*) carry_p = carry;                                                  \
+}
+
+#define SCAN_SUM(a, b)   ((a) + (b))
+#define SCAN_PROD(a, b)  ((a) * (b))
+#define SCAN_MAX(a, b)   ((a) > (b) ? (a) : (b))
+#define SCAN_MIN(a, b)   ((a) < (b) ? (a) : (b))
+
+/* Wrapping arithmetic for the integer sum and product */
+#define SCAN_LSUM(a, b)  ((int64_t)((uint64_t)(a) + (uint64_t)(b)))
+#define SCAN_LPROD(a, b) ((int64_t)((uint64_t)(a) * (uint64_t)(b)))
+
+SCAN_KERNELS(int64_t, long_sum,  SCAN_LSUM)
+SCAN_KERNELS(int64_t, long_prod, SCAN_LPROD)
+SCAN_KERNELS(int64_t, long_max,  SCAN_MAX)
+SCAN_KERNELS(int64_t, long_min,  SCAN_MIN)
+SCAN_KERNELS(double, double_sum,  SCAN_SUM)
+SCAN_KERNELS(double, double_prod, SCAN_PROD)
+SCAN_KERNELS(double, double_max,  SCAN_MAX)
+SCAN_KERNELS(double, double_min,  SCAN_MIN)
+
+/*------------------------------------------------------------------
+ * Function:     scan_op_builtin
+ * Purpose:      One of the built-in operations
+ * Input args:   type:  "long" (int64_t) or "double"
+ *               name:  "sum", "prod", "max" or "min"
+ * Return val:   0, or -1 if there is no such operation
+ */
+static inline int scan_op_builtin(const char* type, const char* name, scan_op_t* op) {
+   static const char* names[4] = {"sum", "prod", "max", "min"};
+   static const scan_reduce_fn long_reduce[4] = {scan_reduce_long_sum,
+      scan_reduce_long_prod, scan_reduce_long_max, scan_reduce_long_min};
+   static const scan_scan_fn long_scan[4] = {scan_scan_long_sum,
+      scan_scan_long_prod, scan_scan_long_max, scan_scan_long_min};
+   static const scan_reduce_fn double_reduce[4] = {scan_reduce_double_sum,
+      scan_reduce_double_prod, scan_reduce_double_max, scan_reduce_double_min};
+   static const scan_scan_fn double_scan[4] = {scan_scan_double_sum,
+      scan_scan_double_prod, scan_scan_double_max, scan_scan_double_min};
+   MPI_Op mpi_ops[4] = {MPI_SUM, MPI_PROD, MPI_MAX, MPI_MIN};
+   int i;
+
+   for (i = 0; i < 4 && strcmp(name, names[i]) != 0; i++);
+   if (i == 4) return -1;
+   memset(op, 0, sizeof(*op));
+   snprintf(op->name, sizeof(op->name), "%s %s", type, name);
+   op->mpi_op = mpi_ops[i];
+   if (strcmp(type, "long") == 0) {
+      int64_t identity[4] = {0, 1, INT64_MIN, INT64_MAX};
+
+      op->size = sizeof(int64_t);
+      op->type = MPI_INT64_T;
+      op->reduce = long_reduce[i];
+      op->scan = long_scan[i];
+      op->identity.l = identity[i];
+   } else if (strcmp(type, "double") == 0) {
+      double identity[4] = {0.0, 1.0, -INFINITY, INFINITY};
+
+      op->size = sizeof(double);
+      op->type = MPI_DOUBLE;
+      op->reduce = double_reduce[i];
+      op->scan = double_scan[i];
+      op->identity.d = identity[i];
+   } else {
+      return -1;
+   }
+   return 0;
+}  /* scan_op_builtin */
+
+/*------------------------------------------------------------------
+ * Function:     scan_op_create
+ * Purpose:      A user operation: fn(in, inout, &len, &type) must set
+ *               inout[i] = in[i] op inout[i], as for MPI_Op_create
+ * Input args:   commute:  1 if op is commutative (it need not be)
+ *               identity:  e op x = x op e = x
+ */
+static inline void scan_op_create(MPI_User_function* fn, int commute, MPI_Datatype type,
+      const void* identity, const char* name, scan_op_t* op) {
+   int size;
+
+   MPI_Type_size(type, &size);
+   memset(op, 0, sizeof(*op));
+   snprintf(op->name, sizeof(op->name), "%s", name);
+   op->size = size;
+   op->type = type;
+   op->fn = fn;
+   op->user = 1;
+   memcpy(op->identity.bytes, identity, size);
+   MPI_Op_create(fn, commute, &op->mpi_op);
+}  /* scan_op_create */
+
+static inline void scan_op_free(scan_op_t* op) {
+   if (op->user) MPI_Op_free(&op->mpi_op);
+   op->user = 0;
+}  /* scan_op_free */
+
+/*------------------------------------------------------------------
+ * Function:     scan_reduce
+ * Purpose:      acc = acc op x[0] op ... op x[n-1]
+ */
+static inline void scan_reduce(const scan_op_t* op, const void* x, long n, void* acc) {
+   scan_value_t tmp;
+   MPI_Datatype type = op->type;
+   int one = 1;
+   long i;
+
+   if (op->reduce != NULL) {
+      op->reduce(x, n, acc);
+      return;
+   }
+   for (i = 0; i < n; i++) {
+      memcpy(tmp.bytes, (const char*) x + i*op->size, op->size);
+      op->fn(acc, tmp.bytes, &one, &type);
+      memcpy(acc, tmp.bytes, op->size);
+   }
+}  /* scan_reduce */
+
+/*------------------------------------------------------------------
+ * Function:     scan_local
+ * Purpose:      Scan of in[0 .. n-1] into out (which may be in) by one
+ *               thread, starting from carry; carry becomes carry op
+ *               (all of in)
+ */
+static inline void scan_local(const scan_op_t* op, const void* in, void* out, long n,
+      void* carry, int inclusive) {
+   scan_value_t x;
+   MPI_Datatype type = op->type;
+   int one = 1;
+   long i;
+
+   if (op->scan != NULL) {
+      op->scan(in, out, n, carry, inclusive);
+      return;
+   }
+   for (i = 0; i < n; i++) {
+      memcpy(x.bytes, (const char*) in + i*op->size, op->size);
+      op->fn(carry, x.bytes, &one, &type);     /* x = carry op x */
+      if (!inclusive) memcpy((char*) out + i*op->size, carry, op->size);
+      memcpy(carry, x.bytes, op->size);
+      if (inclusive) memcpy((char*) out + i*op->size, carry, op->size);
+   }
+}  /* scan_local */
+
+/*------------------------------------------------------------------
+ * Function:     scan_carries
+ * Purpose:      Called by one thread between the passes: replace the
+ *               thread totals part[0 .. threads-1] by the carry each
+ *               thread starts from, beginning with carry (after the
+ *               exclusive scan over comm when comm is not
+ *               MPI_COMM_NULL); carry becomes the carry after the last
+ *               thread
+ */
+static inline void scan_carries(const scan_op_t* op, unsigned char* part, int threads,
+      void* carry, MPI_Comm comm) {
+   scan_value_t total, before;
+   int my_rank;
+
+   if (comm != MPI_COMM_NULL) {
+      memcpy(total.bytes, op->identity.bytes, op->size);
+      scan_reduce(op, part, threads, total.bytes);
+      MPI_Exscan(total.bytes, before.bytes, 1, op->type, op->mpi_op, comm);
+      MPI_Comm_rank(comm, &my_rank);
+      if (my_rank == 0) memcpy(before.bytes, op->identity.bytes, op->size);
+      scan_reduce(op, before.bytes, 1, carry);
+   }
+   scan_local(op, part, part, threads, carry, SCAN_EXCLUSIVE);
+}  /* scan_carries */
+
+/*------------------------------------------------------------------
+ * Function:     scan_array
+ * Purpose:      Distributed scan: out = the scan of the concatenation,
+ *               in rank order, of the in arrays of all processes of
+ *               comm (MPI_COMM_NULL: of this process only), computed
+ *               by the current team of threads
+ * In/out args:  in, out:  n elements each; out may be in
+ */
+static inline void scan_array(const scan_op_t* op, const void* in, void* out, long n,
+      int inclusive, MPI_Comm comm) {
+   int max_threads = omp_get_max_threads();
+   unsigned char* part = malloc((max_threads + 1)*op->size);
+   scan_value_t carry;
+
+   memcpy(carry.bytes, op->identity.bytes, op->size);
+#  pragma omp parallel
+   {
+      int t = omp_get_thread_num(), threads = omp_get_num_threads();
+      long first = SCAN_BLOCK_LOW(t, threads, n);
+      long count = SCAN_BLOCK_LOW(t + 1, threads, n) - first;
+      unsigned char* mine = part + t*op->size;
+
+      /* Pass 1: my total */
+      memcpy(mine, op->identity.bytes, op->size);
+      scan_reduce(op, (const char*) in + first*op->size, count, mine);
+#     pragma omp barrier
+#     pragma omp master
+      scan_carries(op, part, threads, carry.bytes, comm);
+#     pragma omp barrier
+
+      /* Pass 2: my block, from my carry */
+      scan_local(op, (const char*) in + first*op->size, (char*) out + first*op->size,
+            count, mine, inclusive);
+   }
+   free(part);
+}  /* scan_array */
+
+/* Elements first .. first+count-1 of the sequence, into buf */
+typedef void (*scan_fill_fn)(void* buf, long first, long count, void* ctx);
+
+/* The scan of elements first .. first+count-1 */
+typedef void (*scan_sink_fn)(const void* buf, long first, long count, void* ctx);
+
+/*------------------------------------------------------------------
+ * Function:     scan_stream
+ * Purpose:      Distributed scan of elements first .. first+count-1 of
+ *               a generated sequence (each process its own range, in
+ *               rank order), with O(block) memory: the elements are
+ *               generated twice, once to find the process total for
+ *               MPI_Exscan and once to be scanned and passed to sink,
+ *               block by block, in order
+ * Input args:   fill:  called by every thread for its part of a block;
+ *                  must be thread safe
+ *               sink:  called by the master thread for every block
+ */
+static inline void scan_stream(const scan_op_t* op, long first, long count, long block,
+      scan_fill_fn fill, scan_sink_fn sink, void* ctx, int inclusive, MPI_Comm comm) {
+   int max_threads = omp_get_max_threads(), pass, my_rank = 0;
+   unsigned char* buf = malloc(block*op->size);
+   unsigned char* part = malloc((max_threads + 1)*op->size);
+   scan_value_t carry, total, before;
+   long start, m;
+
+   memcpy(total.bytes, op->identity.bytes, op->size);
+   for (pass = 0; pass < 2; pass++) {
+      if (pass == 1) {
+         /* The carry into my range */
+         memcpy(carry.bytes, op->identity.bytes, op->size);
+         if (comm != MPI_COMM_NULL) {
+            MPI_Exscan(total.bytes, before.bytes, 1, op->type, op->mpi_op, comm);
+            MPI_Comm_rank(comm, &my_rank);
+            if (my_rank != 0) memcpy(carry.bytes, before.bytes, op->size);
+         }
+      }
+      for (start = 0; start < count; start += m) {
+         m = (count - start < block) ? count - start : block;
+#        pragma omp parallel
+         {
+            int t = omp_get_thread_num(), threads = omp_get_num_threads();
+            long lo = SCAN_BLOCK_LOW(t, threads, m);
+            long n = SCAN_BLOCK_LOW(t + 1, threads, m) - lo;
+            unsigned char* mine = part + t*op->size;
+
+            fill(buf + lo*op->size, first + start + lo, n, ctx);
+            memcpy(mine, op->identity.bytes, op->size);
+            scan_reduce(op, buf + lo*op->size, n, mine);
+#           pragma omp barrier
+#           pragma omp master
+            {
+               if (pass == 0)
+                  scan_reduce(op, part, threads, total.bytes);
+               else
+                  scan_carries(op, part, threads, carry.bytes, MPI_COMM_NULL);
+            }
+#           pragma omp barrier
+            if (pass == 1)
+               scan_local(op, buf + lo*op->size, buf + lo*op->size, n, mine, inclusive);
+         }
+         if (pass == 1) sink(buf, first + start, m, ctx);
+      }
+   }
+   free(part);
+   free(buf);
+}  /* scan_stream */
+
+#endif /* SCAN_H */
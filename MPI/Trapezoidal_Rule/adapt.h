@@ -0,0 +1,392 @@
+/* File:     adapt.h
+ * Purpose:  Adaptive quadrature for the trapezoidal rule programs:
+ *           adaptive Simpson and 7/15-point Gauss-Kronrod, with the
+ *           pending subintervals shared among the processes by work
+ *           stealing.
+ *
+ * Usage:    adapt_opts_t opts = {ADAPT_GK15, 1e-10};
+ *           adapt_stats_t st;
+ *           total = adapt_integrate(comm, &f, a, b, &opts, &st);
+ *           (collective; every process gets the integral)
+ *
+ * Note:     An interval [x0, x1] is accepted when its error estimate is
+ *           at most tol*(x1-x0)/(b-a), so the accepted errors add up to
+ *           at most tol however the intervals end up split among the
+ *           processes.  Otherwise it is halved and both halves are
+ *           pushed on the local stack.
+ *
+ *           Each process starts with an equal piece of [a, b] and works
+ *           depth first from the top of its stack.  Every ADAPT_POLL
+ *           intervals it answers steal requests by sending the bottom
+ *           half of its stack: the oldest, widest intervals, which carry
+ *           the most remaining work.  A process with an empty stack asks
+ *           random victims until one has work to give.
+ *
+ *           Termination is detected by weights: the starting pieces
+ *           weigh 2^ADAPT_WEIGHT_BITS each and halving an interval
+ *           halves its weight, so the weights of the pending and
+ *           accepted intervals always add up to p*2^ADAPT_WEIGHT_BITS,
+ *           exactly.  Idle processes report the weight they accepted to
+ *           process 0, which tells everyone to stop once all of it is
+ *           accounted for.  An interval of weight 1 cannot be halved
+ *           again and is accepted as it is (counted in st.forced).
+ */
+#ifndef ADAPT_H
+#define ADAPT_H
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <mpi.h>
+#include "integrand.h"
+
+#define ADAPT_SIMPSON 0
+#define ADAPT_GK15    1
+
+#define ADAPT_WEIGHT_BITS 48  /* at most 48 halvings of a starting piece */
+#define ADAPT_POLL        16  /* intervals between checks for thieves */
+#define ADAPT_STACK       64  /* initial stack capacity */
+
+#define TAG_STEAL  41
+#define TAG_WORK   42
+#define TAG_CREDIT 43
+#define TAG_STOP   44
+
+typedef struct {
+   double x0, x1;
+   double f0, fm, f1;            /* Simpson: f at x0, the midpoint, x1 */
+   double est;                   /* Simpson rule on [x0, x1] */
+   unsigned long long weight;
+} adapt_interval_t;
+
+typedef struct {
+   int    rule;                  /* ADAPT_SIMPSON or ADAPT_GK15 */
+   double tol;                   /* absolute tolerance on [a, b] */
+} adapt_opts_t;
+
+typedef struct {
+   long   evals;                 /* function evaluations on this process */
+   long   accepted;              /* intervals accepted here */
+   long   forced;                /* ... of which could not be halved */
+   long   steals;                /* successful steal requests */
+   long   stolen;                /* intervals taken from others */
+   long   given;                 /* intervals given to others */
+   double busy;                  /* seconds spent refining intervals */
+   double seconds;               /* seconds in adapt_integrate */
+   double local;                 /* sum of the accepted intervals here */
+} adapt_stats_t;
+
+typedef struct {
+   adapt_interval_t* v;
+   int n, cap;
+} adapt_stack_t;
+
+/* Gauss-Kronrod 7/15 nodes on [-1, 1] (nonnegative half), Kronrod weights
+ * and the Gauss weights of the odd nodes (QUADPACK qk15) */
+static const double adapt_xgk[8] = {
+   0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+   0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+   0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+   0.207784955007898467600689403773245, 0.000000000000000000000000000000000
+};
+static const double adapt_wgk[8] = {
+   0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+   0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+   0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+   0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+};
+static const double adapt_wg[4] = {
+   0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+   0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+};
+
+/*------------------------------------------------------------------
+ * Function:     adapt_interval_type
+ * Purpose:      Build an MPI datatype for adapt_interval_t
+ */
+static void adapt_interval_type(MPI_Datatype* interval_t_p) {
+   int blocklengths[2] = {6, 1};
+   MPI_Aint displacements[2] = {offsetof(adapt_interval_t, x0),
+                                offsetof(adapt_interval_t, weight)};
+   MPI_Datatype types[2] = {MPI_DOUBLE, MPI_UNSIGNED_LONG_LONG};
+   MPI_Datatype tmp;
+
+   MPI_Type_create_struct(2, blocklengths, displacements, types, &tmp);
+   MPI_Type_create_resized(tmp, 0, sizeof(adapt_interval_t), interval_t_p);
+   MPI_Type_commit(interval_t_p);
+   MPI_Type_free(&tmp);
+}  /* adapt_interval_type */
+
+static void adapt_push(adapt_stack_t* s, const adapt_interval_t* iv) {
+   if (s->n == s->cap) {
+      s->cap *= 2;
+      s->v = realloc(s->v, s->cap * sizeof(adapt_interval_t));
+   }
+   s->v[s->n++] = *iv;
+}  /* adapt_push */
+
+/*------------------------------------------------------------------
+ * Function:     adapt_gk15
+ * Purpose:      15-point Kronrod estimate of the integral over [x0, x1];
+ *               the difference from the embedded 7-point Gauss rule is
+ *               returned in *err_p
+ */
+static double adapt_gk15(const integrand_t* f, double x0, double x1,
+      double* err_p) {
+   double center = 0.5*(x0 + x1), half = 0.5*(x1 - x0);
+   double x[15], y[15], fx, gauss, kronrod;
+   int j;
+
+   /* All 15 nodes in one batch: center, then the pairs */
+   x[0] = center;
+   for (j = 0; j < 7; j++) {
+      x[2*j+1] = center - half*adapt_xgk[j];
+      x[2*j+2] = center + half*adapt_xgk[j];
+   }
+   f->eval(15, x, y);
+
+   gauss = y[0]*adapt_wg[3];
+   kronrod = y[0]*adapt_wgk[7];
+   for (j = 0; j < 7; j++) {
+      fx = y[2*j+1] + y[2*j+2];
+      kronrod += adapt_wgk[j]*fx;
+      if (j % 2 == 1) gauss += adapt_wg[j/2]*fx;
+   }
+   *err_p = fabs((kronrod - gauss)*half);
+   return kronrod*half;
+}  /* adapt_gk15 */
+
+/*------------------------------------------------------------------
+ * Function:     adapt_process
+ * Purpose:      Refine one interval: add it to *sum_p and *done_p if
+ *               it is accurate enough, push its halves otherwise
+ * Return val:   Function evaluations used
+ */
+static int adapt_process(const integrand_t* f, const adapt_opts_t* opts,
+      double tol_per_len, adapt_interval_t* iv, adapt_stack_t* s,
+      double* sum_p, unsigned long long* done_p, adapt_stats_t* st) {
+   double xm = 0.5*(iv->x0 + iv->x1), tol = tol_per_len*(iv->x1 - iv->x0);
+   double x[2], y[2], fl, fr, left, right, err;
+   adapt_interval_t half;
+
+   if (opts->rule == ADAPT_GK15) {
+      left = adapt_gk15(f, iv->x0, iv->x1, &err);
+      if (err <= tol || iv->weight == 1) {
+         if (err > tol) st->forced++;
+         st->accepted++;
+         *sum_p += left;
+         *done_p += iv->weight;
+      } else {
+         half.weight = iv->weight/2;
+         half.f0 = half.fm = half.f1 = half.est = 0.0;
+         half.x0 = xm;   half.x1 = iv->x1;
+         adapt_push(s, &half);
+         half.x0 = iv->x0;   half.x1 = xm;
+         adapt_push(s, &half);
+      }
+      return 15;
+   }
+
+   /* Simpson: f at the quarter points gives the rule on both halves */
+   x[0] = 0.5*(iv->x0 + xm);
+   x[1] = 0.5*(xm + iv->x1);
+   f->eval(2, x, y);
+   fl = y[0];
+   fr = y[1];
+   left = (xm - iv->x0)/6.0*(iv->f0 + 4.0*fl + iv->fm);
+   right = (iv->x1 - xm)/6.0*(iv->fm + 4.0*fr + iv->f1);
+   err = (left + right - iv->est)/15.0;
+   if (fabs(err) <= tol || iv->weight == 1) {
+      if (fabs(err) > tol) st->forced++;
+      st->accepted++;
+      *sum_p += left + right + err;     /* Richardson: one order better */
+      *done_p += iv->weight;
+   } else {
+      half.weight = iv->weight/2;
+      half.x0 = xm;   half.x1 = iv->x1;
+      half.f0 = iv->fm;   half.fm = fr;   half.f1 = iv->f1;
+      half.est = right;
+      adapt_push(s, &half);
+      half.x0 = iv->x0;   half.x1 = xm;
+      half.f0 = iv->f0;   half.fm = fl;   half.f1 = iv->fm;
+      half.est = left;
+      adapt_push(s, &half);
+   }
+   return 2;
+}  /* adapt_process */
+
+/*------------------------------------------------------------------
+ * Function:     adapt_give
+ * Purpose:      Answer a steal request from thief with the bottom half
+ *               of my stack (nothing if I have fewer than two intervals)
+ */
+static void adapt_give(MPI_Comm comm, int thief, adapt_stack_t* s,
+      MPI_Datatype interval_t, adapt_stats_t* st) {
+   int count = s->n/2;
+
+   MPI_Send(s->v, count, interval_t, thief, TAG_WORK, comm);
+   if (count > 0) {
+      s->n -= count;
+      memmove(s->v, s->v + count, s->n * sizeof(adapt_interval_t));
+      st->given += count;
+   }
+}  /* adapt_give */
+
+/*------------------------------------------------------------------
+ * Function:     adapt_integrate
+ * Purpose:      Integral of f over [a, b] to within opts->tol, computed
+ *               by all processes of comm
+ * Output args:  st: this process' share of the work
+ * Return val:   The integral, on every process
+ */
+static double adapt_integrate(MPI_Comm comm, const integrand_t* f,
+      double a, double b, const adapt_opts_t* opts, adapt_stats_t* st) {
+   int my_rank, comm_sz, victim = -1, stopped = 0, flag, count, i, q;
+   unsigned long long done = 0, reported = 0, accounted = 0, credit, total;
+   double tol_per_len = opts->tol/fabs(b - a), sum = 0.0, result, t, x[3], y[3];
+   unsigned int seed;
+   adapt_stack_t s;
+   adapt_interval_t iv;
+   MPI_Datatype interval_t;
+   MPI_Request req = MPI_REQUEST_NULL;
+   MPI_Status status;
+
+   MPI_Comm_rank(comm, &my_rank);
+   MPI_Comm_size(comm, &comm_sz);
+   adapt_interval_type(&interval_t);
+   memset(st, 0, sizeof(*st));
+   st->seconds = MPI_Wtime();
+   seed = 12345u + 7919u*my_rank;
+   total = (unsigned long long) comm_sz << ADAPT_WEIGHT_BITS;
+
+   /* My equal piece of [a, b] */
+   s.cap = ADAPT_STACK;
+   s.n = 0;
+   s.v = malloc(s.cap * sizeof(adapt_interval_t));
+   iv.x0 = a + (b - a)*my_rank/comm_sz;
+   iv.x1 = (my_rank == comm_sz-1) ? b : a + (b - a)*(my_rank + 1)/comm_sz;
+   iv.weight = 1ULL << ADAPT_WEIGHT_BITS;
+   if (opts->rule == ADAPT_SIMPSON) {
+      x[0] = iv.x0;
+      x[1] = 0.5*(iv.x0 + iv.x1);
+      x[2] = iv.x1;
+      f->eval(3, x, y);
+      iv.f0 = y[0];
+      iv.fm = y[1];
+      iv.f1 = y[2];
+      iv.est = (iv.x1 - iv.x0)/6.0*(iv.f0 + 4.0*iv.fm + iv.f1);
+      st->evals += 3;
+   }
+   adapt_push(&s, &iv);
+
+   while (!stopped) {
+      /* Work through my stack, checking for thieves now and then */
+      t = MPI_Wtime();
+      while (s.n > 0) {
+         for (i = 0; i < ADAPT_POLL && s.n > 0; i++) {
+            iv = s.v[--s.n];
+            st->evals += adapt_process(f, opts, tol_per_len, &iv, &s, &sum, &done, st);
+         }
+         MPI_Iprobe(MPI_ANY_SOURCE, TAG_STEAL, comm, &flag, &status);
+         while (flag) {
+            MPI_Recv(NULL, 0, MPI_INT, status.MPI_SOURCE, TAG_STEAL, comm, MPI_STATUS_IGNORE);
+            adapt_give(comm, status.MPI_SOURCE, &s, interval_t, st);
+            MPI_Iprobe(MPI_ANY_SOURCE, TAG_STEAL, comm, &flag, &status);
+         }
+      }
+      st->busy += MPI_Wtime() - t;
+
+      /* Out of work: hand in what I finished ... */
+      if (done > reported) {
+         credit = done - reported;
+         reported = done;
+         if (my_rank == 0)
+            accounted += credit;
+         else
+            MPI_Send(&credit, 1, MPI_UNSIGNED_LONG_LONG, 0, TAG_CREDIT, comm);
+      }
+      if (my_rank == 0 && accounted == total) {
+         for (q = 1; q < comm_sz; q++)
+            MPI_Send(NULL, 0, MPI_INT, q, TAG_STOP, comm);
+         break;
+      }
+
+      /* ... and look for more */
+      if (comm_sz > 1 && req == MPI_REQUEST_NULL && victim < 0) {
+         do victim = rand_r(&seed) % comm_sz; while (victim == my_rank);
+         MPI_Isend(NULL, 0, MPI_INT, victim, TAG_STEAL, comm, &req);
+      }
+      while (s.n == 0 && !stopped) {
+         MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, comm, &status);
+         switch (status.MPI_TAG) {
+            case TAG_STEAL:   /* nothing to give */
+               MPI_Recv(NULL, 0, MPI_INT, status.MPI_SOURCE, TAG_STEAL, comm, MPI_STATUS_IGNORE);
+               adapt_give(comm, status.MPI_SOURCE, &s, interval_t, st);
+               break;
+            case TAG_WORK:
+               MPI_Get_count(&status, interval_t, &count);
+               while (s.cap < count) s.cap *= 2;
+               s.v = realloc(s.v, s.cap * sizeof(adapt_interval_t));
+               MPI_Recv(s.v, count, interval_t, status.MPI_SOURCE, TAG_WORK, comm, MPI_STATUS_IGNORE);
+               s.n = count;
+               MPI_Wait(&req, MPI_STATUS_IGNORE);
+               victim = -1;
+               if (count > 0) {
+                  st->steals++;
+                  st->stolen += count;
+               } else {
+                  do victim = rand_r(&seed) % comm_sz; while (victim == my_rank);
+                  MPI_Isend(NULL, 0, MPI_INT, victim, TAG_STEAL, comm, &req);
+               }
+               break;
+            case TAG_CREDIT:   /* process 0 only */
+               MPI_Recv(&credit, 1, MPI_UNSIGNED_LONG_LONG, status.MPI_SOURCE, TAG_CREDIT,
+                     comm, MPI_STATUS_IGNORE);
+               accounted += credit;
+               if (accounted == total) {
+                  for (q = 1; q < comm_sz; q++)
+                     MPI_Send(NULL, 0, MPI_INT, q, TAG_STOP, comm);
+                  stopped = 1;
+               }
+               break;
+            case TAG_STOP:
+               MPI_Recv(NULL, 0, MPI_INT, 0, TAG_STOP, comm, MPI_STATUS_IGNORE);
+               stopped = 1;
+               break;
+         }
+      }
+   }
+
+   /* My last steal request may still be unanswered: keep answering
+    * others (with nothing) until every process has its reply */
+   stopped = 0;
+   while (req != MPI_REQUEST_NULL) {
+      MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, comm, &status);
+      if (status.MPI_TAG == TAG_STEAL) {
+         MPI_Recv(NULL, 0, MPI_INT, status.MPI_SOURCE, TAG_STEAL, comm, MPI_STATUS_IGNORE);
+         MPI_Send(NULL, 0, interval_t, status.MPI_SOURCE, TAG_WORK, comm);
+      } else {
+         MPI_Recv(NULL, 0, interval_t, status.MPI_SOURCE, TAG_WORK, comm, MPI_STATUS_IGNORE);
+         MPI_Wait(&req, MPI_STATUS_IGNORE);
+      }
+   }
+   MPI_Ibarrier(comm, &req);
+   while (!stopped) {
+      MPI_Test(&req, &stopped, MPI_STATUS_IGNORE);
+      MPI_Iprobe(MPI_ANY_SOURCE, TAG_STEAL, comm, &flag, &status);
+      if (flag) {
+         MPI_Recv(NULL, 0, MPI_INT, status.MPI_SOURCE, TAG_STEAL, comm, MPI_STATUS_IGNORE);
+         MPI_Send(NULL, 0, interval_t, status.MPI_SOURCE, TAG_WORK, comm);
+      }
+   }
+
+   st->local = sum;
+   MPI_Allreduce(&sum, &result, 1, MPI_DOUBLE, MPI_SUM, comm);
+   st->seconds = MPI_Wtime() - st->seconds;
+   free(s.v);
+   MPI_Type_free(&interval_t);
+   return result;
+}  /* adapt_integrate */
+
+#endif /* ADAPT_H */
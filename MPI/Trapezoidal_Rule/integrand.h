@@ -0,0 +1,209 @@
+/* File:     integrand.h
+ * Purpose:  The functions the quadrature programs integrate, chosen at
+ *           run time by name instead of compiled into each program, and
+ *           evaluated a whole array of abscissae per call.
+ *
+ * Usage:    integrand_t f;
+ *           if (integrand_lookup(argv[1], &f, stderr) != 0) ...  name or lib.so:symbol
+ *           f.eval(n, x, y);                   y[i] = f(x[i]), i < n
+ *           sum = integrand_grid_sum(&f, a, h, first, count, stride);
+ *           integrand_grid_acc(&f, a, h, first, count, stride, &acc);
+ *           exact = f.antiderivative ? f.antiderivative(b) - f.antiderivative(a) : ...
+ *
+ * Note:     A user integrand is a shared object exporting
+ *              void <symbol>(int n, const double* x, double* y)
+ *           and optionally its antiderivative
+ *              double <symbol>_antiderivative(double x)
+ *           (see user_integrand.c).  "lib.so" alone means symbol
+ *           "integrand"; a name without ".so" is looked up in the
+ *           built-in table.  Since every call covers a batch of points,
+ *           the loops in the integrands vectorize: compile with -O3.
+ *           -ffast-math adds glibc's libmvec versions of sqrt, exp and
+ *           cos, but a vector lane and the scalar tail of a batch may
+ *           then give different bits for the same x, and the batch
+ *           boundaries move with the number of processes: builds whose
+ *           results must be reproducible (repro.h) must not use it.
+ *           Link with -ldl.
+ */
+#ifndef INTEGRAND_H
+#define INTEGRAND_H
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <dlfcn.h>
+#include "repro.h"
+
+#define INTEGRAND_BATCH  512     /* abscissae per call of eval */
+#define INTEGRAND_NAME   256
+#define PEAK_C   1e-6            /* width^2 of the peak of "peak" */
+#define PEAK_X   0.3
+
+typedef void (*integrand_fn)(int n, const double* x, double* y);
+
+typedef struct {
+   char         name[INTEGRAND_NAME];
+   const char*  formula;
+   integrand_fn eval;
+   double       (*antiderivative)(double x);   /* NULL if not known */
+} integrand_t;
+
+/* Built-in integrands and their antiderivatives */
+static void f_square(int n, const double* restrict x, double* restrict y) {
+   int i;
+   for (i = 0; i < n; i++) y[i] = x[i]*x[i];
+}
+static double F_square(double x) { return x*x*x/3.0; }
+
+static void f_pi(int n, const double* restrict x, double* restrict y) {
+   int i;
+   for (i = 0; i < n; i++) y[i] = 4.0/(1.0 + x[i]*x[i]);
+}
+static double F_pi(double x) { return 4.0*atan(x); }
+
+static void f_sqrt(int n, const double* restrict x, double* restrict y) {
+   int i;
+   for (i = 0; i < n; i++) y[i] = sqrt(x[i]);
+}
+static double F_sqrt(double x) { return 2.0/3.0*x*sqrt(x); }
+
+static void f_exp(int n, const double* restrict x, double* restrict y) {
+   int i;
+   for (i = 0; i < n; i++) y[i] = exp(-x[i]*x[i]);
+}
+static double F_exp(double x) { return 0.5*sqrt(4.0*atan(1.0))*erf(x); }
+
+static void f_peak(int n, const double* restrict x, double* restrict y) {
+   int i;
+   for (i = 0; i < n; i++) y[i] = 1.0/(PEAK_C + (x[i] - PEAK_X)*(x[i] - PEAK_X));
+}
+static double F_peak(double x) { return atan((x - PEAK_X)/sqrt(PEAK_C))/sqrt(PEAK_C); }
+
+static void f_osc(int n, const double* restrict x, double* restrict y) {
+   int i;
+   for (i = 0; i < n; i++) y[i] = cos(50.0*x[i]*x[i]);
+}
+
+static const integrand_t integrand_table[] = {
+   {"square", "x^2",                  f_square, F_square},
+   {"pi",     "4/(1+x^2)",            f_pi,     F_pi},
+   {"sqrt",   "sqrt(x)",              f_sqrt,   F_sqrt},
+   {"exp",    "exp(-x^2)",            f_exp,    F_exp},
+   {"peak",   "1/(1e-6+(x-0.3)^2)",   f_peak,   F_peak},
+   {"osc",    "cos(50x^2)",           f_osc,    NULL},
+};
+#define INTEGRAND_COUNT ((int)(sizeof(integrand_table)/sizeof(integrand_table[0])))
+
+/*------------------------------------------------------------------
+ * Function:     integrand_list
+ * Purpose:      Print the built-in integrands
+ */
+static inline void integrand_list(FILE* out) {
+   int k;
+
+   fprintf(out, "integrands:");
+   for (k = 0; k < INTEGRAND_COUNT; k++)
+      fprintf(out, " %s = %s%s", integrand_table[k].name, integrand_table[k].formula,
+            k < INTEGRAND_COUNT-1 ? "," : "");
+   fprintf(out, ", or lib.so[:symbol]\n");
+}  /* integrand_list */
+
+/*------------------------------------------------------------------
+ * Function:     integrand_lookup
+ * Purpose:      Find an integrand by name or load it from a shared object
+ * Input args:   spec:  built-in name, "lib.so" or "lib.so:symbol"
+ *               err:   where to say what went wrong, NULL for nowhere
+ * Output args:  f_p:   the integrand
+ * Return val:   0 on success, -1 if not found
+ */
+static inline int integrand_lookup(const char* spec, integrand_t* f_p, FILE* err) {
+   char path[INTEGRAND_NAME], symbol[INTEGRAND_NAME];
+   const char* colon;
+   void* lib;
+   int k;
+
+   for (k = 0; k < INTEGRAND_COUNT; k++) {
+      if (strcmp(spec, integrand_table[k].name) == 0) {
+         *f_p = integrand_table[k];
+         return 0;
+      }
+   }
+   if (strstr(spec, ".so") == NULL || strlen(spec) >= INTEGRAND_NAME) {
+      if (err) fprintf(err, "unknown integrand %s\n", spec);
+      return -1;
+   }
+
+   colon = strrchr(spec, ':');
+   if (colon != NULL && strstr(colon, ".so") == NULL) {
+      memcpy(path, spec, colon - spec);
+      path[colon - spec] = '\0';
+      strcpy(symbol, colon + 1);
+   } else {
+      strcpy(path, spec);
+      strcpy(symbol, "integrand");
+   }
+   lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+   if (lib == NULL) {
+      if (err) fprintf(err, "%s\n", dlerror());
+      return -1;
+   }
+   *(void**) &f_p->eval = dlsym(lib, symbol);
+   if (f_p->eval == NULL) {
+      if (err) fprintf(err, "%s: no symbol %s\n", path, symbol);
+      dlclose(lib);
+      return -1;
+   }
+   strcpy(f_p->name, spec);
+   f_p->formula = spec;
+   if (strlen(symbol) + sizeof("_antiderivative") <= INTEGRAND_NAME) {
+      strcat(symbol, "_antiderivative");
+      *(void**) &f_p->antiderivative = dlsym(lib, symbol);
+   } else {
+      f_p->antiderivative = NULL;
+   }
+   return 0;    /* the library stays loaded until the program exits */
+}  /* integrand_lookup */
+
+/*------------------------------------------------------------------
+ * Function:     integrand_grid_sum
+ * Purpose:      Sum of f(a + (first + k*stride)*h) for k = 0 .. count-1,
+ *               evaluated INTEGRAND_BATCH points per call and summed
+ *               with Neumaier compensation
+ * Input args:   first:  may be fractional, e.g. i+0.5 for midpoints
+ */
+static inline double integrand_grid_sum(const integrand_t* f, double a, double h,
+      double first, long count, long stride) {
+   double x[INTEGRAND_BATCH], y[INTEGRAND_BATCH];
+   neumaier_t sum = {0.0, 0.0};
+   long k;
+   int j, m;
+
+   for (k = 0; k < count; k += m) {
+      m = (count - k < INTEGRAND_BATCH) ? (int)(count - k) : INTEGRAND_BATCH;
+      for (j = 0; j < m; j++) x[j] = a + (first + (double)(k + j)*stride)*h;
+      f->eval(m, x, y);
+      for (j = 0; j < m; j++) neumaier_add(&sum, y[j]);
+   }
+   return neumaier_value(&sum);
+}  /* integrand_grid_sum */
+
+/*------------------------------------------------------------------
+ * Function:     integrand_grid_acc
+ * Purpose:      Like integrand_grid_sum, but add the values exactly to
+ *               a reproducible accumulator
+ */
+static inline void integrand_grid_acc(const integrand_t* f, double a, double h,
+      double first, long count, long stride, repro_acc_t* acc) {
+   double x[INTEGRAND_BATCH], y[INTEGRAND_BATCH];
+   long k;
+   int j, m;
+
+   for (k = 0; k < count; k += m) {
+      m = (count - k < INTEGRAND_BATCH) ? (int)(count - k) : INTEGRAND_BATCH;
+      for (j = 0; j < m; j++) x[j] = a + (first + (double)(k + j)*stride)*h;
+      f->eval(m, x, y);
+      for (j = 0; j < m; j++) repro_add(acc, y[j]);
+   }
+}  /* integrand_grid_acc */
+
+#endif /* INTEGRAND_H */
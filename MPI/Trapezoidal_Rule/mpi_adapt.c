@@ -0,0 +1,156 @@
+/* File:     mpi_adapt.c
+ * Purpose:  Compare adaptive quadrature (adapt.h) with the uniform
+ *           trapezoidal rule of mpi_trap3.c on integrands with sharp
+ *           features, where a uniform grid wastes most of its points
+ *           and the process owning the hard region finishes last.
+ *
+ * Input:    The integrand, the rule and the tolerance on the command line
+ * Output:   The adaptive estimate, its error, the evaluations and time
+ *           of every process, and how many trapezoids the uniform rule
+ *           needs to meet the same tolerance
+ *
+ * Compile:  mpicc -g -Wall -O3 -o mpi_adapt mpi_adapt.c -lm -ldl
+ * Run:      mpiexec -n <number of processes> ./mpi_adapt
+ *              [integrand] [simpson|gk15] [tolerance]
+ *           (integrand: see integrand.h; default peak)
+ *
+ * Algorithm:
+ *    1.  All processes run adapt_integrate, which refines subintervals
+ *        until each meets its share of the tolerance, moving pending
+ *        subintervals from busy processes to idle ones.
+ *    2.  Process 0 gathers the per-process statistics.
+ *    3.  The uniform rule is run with n = p, 2p, 4p, ... trapezoids
+ *        until it meets the tolerance, or n reaches MAX_TRAP.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* We'll be using MPI routines, definitions, etc. */
+#include <mpi.h>
+#include "adapt.h"
+
+#define TOL      1e-10
+#define MAX_TRAP (1L << 26)
+
+/* Calculate local integral  */
+double Trap(const integrand_t* f, double left_endpt, double right_endpt,
+   long trap_count, double base_len);
+
+int main(int argc, char* argv[]) {
+   int my_rank, comm_sz, q;
+   const char* name = "peak";
+   integrand_t f;
+   double exact, total_int, local_int, h, local_a, err, start, elapsed;
+   double stats[6], *all = NULL;
+   long n, local_n;
+   adapt_opts_t opts = {ADAPT_GK15, TOL};
+   adapt_stats_t st;
+
+   /* Let the system do what it needs to start up MPI */
+   MPI_Init(&argc, &argv);
+
+   /* Get my process rank */
+   MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+
+   /* Find out how many processes are being used */
+   MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+
+   if (argc > 1) name = argv[1];
+   if (argc > 2 && strcmp(argv[2], "simpson") == 0) opts.rule = ADAPT_SIMPSON;
+   if (argc > 3) opts.tol = atof(argv[3]);
+   if (integrand_lookup(name, &f, my_rank == 0 ? stderr : NULL) != 0) {
+      if (my_rank == 0) integrand_list(stderr);
+      MPI_Finalize();
+      return 1;
+   }
+
+   /* Adaptive */
+   MPI_Barrier(MPI_COMM_WORLD);
+   total_int = adapt_integrate(MPI_COMM_WORLD, &f, 0.0, 1.0, &opts, &st);
+
+   /* Without an antiderivative, measure errors against the adaptive
+    * estimate */
+   if (f.antiderivative != NULL)
+      exact = f.antiderivative(1.0) - f.antiderivative(0.0);
+   else
+      exact = total_int;
+
+   stats[0] = st.evals;
+   stats[1] = st.busy;
+   stats[2] = st.seconds;
+   stats[3] = st.steals;
+   stats[4] = st.given;
+   stats[5] = st.accepted;
+   if (my_rank == 0) all = malloc(6*comm_sz*sizeof(double));
+   MPI_Gather(stats, 6, MPI_DOUBLE, all, 6, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+   MPI_Reduce(&st.evals, &n, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+   if (my_rank == 0) {
+      err = fabs(total_int - exact);
+      printf("%s, %s rule, tolerance %.1e, %d processes\n", f.formula,
+            opts.rule == ADAPT_GK15 ? "Gauss-Kronrod 7/15" : "Simpson", opts.tol, comm_sz);
+      printf("adaptive: %.15e, error %.3e%s, %ld evaluations\n", total_int, err,
+            f.antiderivative != NULL ? "" : " (no exact value)", n);
+      printf("rank   evaluations  intervals  steals  given   busy (s)  total (s)\n");
+      for (q = 0; q < comm_sz; q++)
+         printf("%4d  %12.0f  %9.0f  %6.0f  %5.0f  %9.6f  %9.6f\n", q, all[6*q],
+               all[6*q+5], all[6*q+3], all[6*q+4], all[6*q+1], all[6*q+2]);
+      free(all);
+   }
+
+   /* Uniform, split evenly as in mpi_trap3.c: double n until it meets
+    * the same tolerance */
+   for (n = comm_sz; ; n *= 2) {
+      start = MPI_Wtime();
+      h = 1.0/n;
+      local_n = n/comm_sz;
+      local_a = my_rank*local_n*h;
+      local_int = Trap(&f, local_a, local_a + local_n*h, local_n, h);
+      elapsed = MPI_Wtime() - start;
+      MPI_Allreduce(&local_int, &total_int, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+      if (fabs(total_int - exact) <= opts.tol || n >= MAX_TRAP) break;
+   }
+   MPI_Reduce(&elapsed, &start, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+   MPI_Reduce(&elapsed, &h, 1, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+   if (my_rank == 0) {
+      printf("uniform:  %.15e, error %.3e, %ld trapezoids%s, %.6f..%.6f s per process\n",
+            total_int, fabs(total_int - exact), n,
+            fabs(total_int - exact) <= opts.tol ? "" : " (gave up)", h, start);
+   }
+
+   /* Shut down MPI */
+   MPI_Finalize();
+
+   return 0;
+} /*  main  */
+
+/*------------------------------------------------------------------
+ * Function:     Trap
+ * Purpose:      Serial function for estimating a definite integral
+ *               using the trapezoidal rule, evaluating f in batches
+ * Input args:   f
+ *               left_endpt
+ *               right_endpt
+ *               trap_count
+ *               base_len
+ * Return val:   Trapezoidal rule estimate of integral from
+ *               left_endpt to right_endpt using trap_count
+ *               trapezoids
+ */
+double Trap(
+      const integrand_t* f  /* in */,
+      double left_endpt     /* in */,
+      double right_endpt    /* in */,
+      long   trap_count     /* in */,
+      double base_len       /* in */) {
+   double estimate, ends[2] = {left_endpt, right_endpt}, f_ends[2];
+
+   f->eval(2, ends, f_ends);
+   estimate = (f_ends[0] + f_ends[1])/2.0;
+   estimate += integrand_grid_sum(f, left_endpt, base_len, 1, trap_count-1, 1);
+   estimate = estimate*base_len;
+
+   return estimate;
+} /*  Trap  */
@@ -0,0 +1,369 @@
+/* File:     mpi_cubature.c
+ * Purpose:  Tensor-product cubature over the box [a, b]^d, d = 1, 2 or
+ *           3, with the composite trapezoid, Simpson or 4-point Gauss-
+ *           Legendre rule in every dimension.  The nodes are split over
+ *           a d-dimensional MPI_Cart_create process grid, the OpenMP
+ *           threads of a process split its block along the innermost
+ *           dimension, and the partial sums are reduced one dimension at
+ *           a time along the rows of the grid.
+ *
+ * Input:    The integrand, the rule, the dimension and the number of
+ *           nodes on the command line
+ * Output:   For each dimension: the process grid, the time, the nodes
+ *           per second, the estimate and its error
+ *
+ * Compile:  mpicc -g -Wall -O3 -fopenmp -o mpi_cubature mpi_cubature.c -lm
+ * Run:      OMP_NUM_THREADS=<t> mpiexec -n <p> ./mpi_cubature
+ *              [gauss|corner|poly] [trap|simpson|gauss] [1|2|3|all] [nodes] [a b]
+ *           (default: gauss, simpson, all, 2^24 nodes, [0, 1])
+ *
+ * Algorithm:
+ *    1.  MPI_Dims_create factors p into a d-dimensional grid and each
+ *        process takes a block of the nodes along every dimension.
+ *    2.  Each thread takes a block of the process' nodes along the last
+ *        dimension and, for every combination of the outer nodes,
+ *        evaluates the integrand on its block, BATCH points per call.
+ *        Nodes and weights are computed from their indices, so no
+ *        process stores any part of the grid.
+ *    3.  The sums are reduced along the last dimension of the process
+ *        grid (MPI_Cart_sub), then along the one before it, ..., so
+ *        process (0, ..., 0) ends up with the integral.
+ *    4.  Running with dimension "all" prints one line per dimension
+ *        with about the same number of nodes in each; rerunning with
+ *        other p and OMP_NUM_THREADS gives the scaling.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* We'll be using MPI routines, definitions, etc. */
+#include <mpi.h>
+#include <omp.h>
+
+#define MAX_DIM  3
+#define NODES    (1L << 24)    /* default total number of nodes */
+#define BATCH    256           /* points per call of the integrand */
+#define GAUSS_Q  4             /* Gauss-Legendre points per cell */
+#define BLOCK_LOW(id,p,n)  ((long)(id)*(n)/(p))
+
+#define RULE_TRAP    0
+#define RULE_SIMPSON 1
+#define RULE_GAUSS   2
+
+/* Integrand: y[i] = f(x[i*dim], ..., x[i*dim+dim-1]) for i < n */
+typedef void (*cube_fn)(int n, int dim, const double* x, double* y);
+
+/* Gauss-Legendre nodes and weights on [-1, 1] */
+const double gl_node[GAUSS_Q] = {-0.861136311594052575, -0.339981043584856265,
+                                  0.339981043584856265,  0.861136311594052575};
+const double gl_weight[GAUSS_Q] = {0.347854845137453857, 0.652145154862546143,
+                                   0.652145154862546143, 0.347854845137453857};
+
+/* The integrands */
+void f_gauss(int n, int dim, const double* x, double* y);
+void f_corner(int n, int dim, const double* x, double* y);
+void f_poly(int n, int dim, const double* x, double* y);
+double Exact(const char* name, int dim, double a, double b, int* known_p);
+
+/* Rules */
+long Rule_nodes(int rule, long cells);
+void Rule_node(int rule, long cells, double a, double h, long i,
+      double* x_p, double* w_p);
+
+/* Cubature over my block */
+double Local_sum(cube_fn f, int dim, int rule, long cells, double a,
+      double h, const long lo[], const long hi[]);
+
+int main(int argc, char* argv[]) {
+   int my_rank, comm_sz, provided, rule = RULE_SIMPSON, dim, dim_first = 1,
+       dim_last = MAX_DIM, k, j, known, part_of_line;
+   int dims[MAX_DIM], periods[MAX_DIM], coords[MAX_DIM], remain[MAX_DIM];
+   const char* name = "gauss";
+   const char* rule_name[3] = {"trapezoid", "Simpson", "Gauss-Legendre"};
+   long total_nodes = NODES, nodes, cells, lo[MAX_DIM], hi[MAX_DIM];
+   double a = 0.0, b = 1.0, h, my_sum, line_sum, exact, start, elapsed, times[2];
+   cube_fn f = f_gauss;
+   MPI_Comm cart, line[MAX_DIM];
+
+   /* Start up MPI; only the master thread of each rank makes MPI calls */
+   MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+   MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+   MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+   if (provided < MPI_THREAD_FUNNELED) {
+      if (my_rank == 0) printf("MPI library does not support MPI_THREAD_FUNNELED\n");
+      MPI_Finalize();
+      return 1;
+   }
+
+   if (argc > 1) name = argv[1];
+   if (strcmp(name, "corner") == 0) f = f_corner;
+   else if (strcmp(name, "poly") == 0) f = f_poly;
+   else if (strcmp(name, "gauss") != 0) {
+      if (my_rank == 0) printf("integrand must be gauss, corner or poly\n");
+      MPI_Finalize();
+      return 1;
+   }
+   if (argc > 2) {
+      if (strcmp(argv[2], "trap") == 0) rule = RULE_TRAP;
+      else if (strcmp(argv[2], "gauss") == 0) rule = RULE_GAUSS;
+      else if (strcmp(argv[2], "simpson") != 0) {
+         if (my_rank == 0) printf("rule must be trap, simpson or gauss\n");
+         MPI_Finalize();
+         return 1;
+      }
+   }
+   if (argc > 3 && strcmp(argv[3], "all") != 0) {
+      dim_first = dim_last = atoi(argv[3]);
+      if (dim_first < 1 || dim_first > MAX_DIM) {
+         if (my_rank == 0) printf("dimension must be 1 .. %d\n", MAX_DIM);
+         MPI_Finalize();
+         return 1;
+      }
+   }
+   if (argc > 4) total_nodes = atol(argv[4]);
+   if (argc > 6) {
+      a = atof(argv[5]);
+      b = atof(argv[6]);
+   }
+
+   if (my_rank == 0) {
+      printf("%s integrand, composite %s rule on [%g, %g]^d, %d processes x %d threads\n",
+            name, rule_name[rule], a, b, comm_sz, omp_get_max_threads());
+      printf("dim  process grid   nodes/dim       nodes   seconds  Mnodes/s  (per process)"
+            "  imbalance             estimate      error\n");
+   }
+
+   for (dim = dim_first; dim <= dim_last; dim++) {
+      /* Cells per dimension for about total_nodes nodes */
+      nodes = (long) floor(pow((double) total_nodes, 1.0/dim) + 0.5);
+      cells = (rule == RULE_GAUSS) ? nodes/GAUSS_Q : nodes - 1;
+      if (rule == RULE_SIMPSON) cells += cells % 2;
+      if (cells < 2) cells = 2;
+      nodes = Rule_nodes(rule, cells);
+      h = (b - a)/cells;
+
+      /* The process grid and my block of it */
+      for (k = 0; k < dim; k++) {
+         dims[k] = 0;
+         periods[k] = 0;
+      }
+      MPI_Dims_create(comm_sz, dim, dims);
+      MPI_Cart_create(MPI_COMM_WORLD, dim, dims, periods, 1, &cart);
+      MPI_Comm_rank(cart, &my_rank);
+      MPI_Cart_coords(cart, my_rank, dim, coords);
+      for (k = 0; k < dim; k++) {
+         lo[k] = BLOCK_LOW(coords[k], dims[k], nodes);
+         hi[k] = BLOCK_LOW(coords[k] + 1, dims[k], nodes);
+         for (j = 0; j < dim; j++) remain[j] = (j == k);
+         MPI_Cart_sub(cart, remain, &line[k]);
+      }
+
+      MPI_Barrier(cart);
+      start = MPI_Wtime();
+      my_sum = Local_sum(f, dim, rule, cells, a, h, lo, hi);
+      elapsed = MPI_Wtime() - start;
+
+      /* Reduce along the last dimension, then the one before, ...; only
+       * the rows whose later coordinates are all 0 still hold sums */
+      part_of_line = 1;
+      for (k = dim-1; k >= 0; k--) {
+         if (part_of_line) {
+            MPI_Reduce(&my_sum, &line_sum, 1, MPI_DOUBLE, MPI_SUM, 0, line[k]);
+            my_sum = line_sum;
+         }
+         part_of_line = part_of_line && coords[k] == 0;
+      }
+      times[0] = elapsed;
+      times[1] = -elapsed;
+      MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : times, times, 2, MPI_DOUBLE, MPI_MAX, 0, cart);
+      start = MPI_Wtime() - start;
+      MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : &start, &start, 1, MPI_DOUBLE, MPI_MAX, 0, cart);
+
+      /* Process (0, ..., 0) is rank 0 of the grid */
+      if (my_rank == 0) {
+         char grid[32];
+         double all_nodes = pow((double) nodes, dim);
+         exact = Exact(name, dim, a, b, &known);
+         snprintf(grid, sizeof(grid), "%d", dims[0]);
+         for (k = 1; k < dim; k++)
+            snprintf(grid + strlen(grid), sizeof(grid) - strlen(grid), "x%d", dims[k]);
+         printf("%3d  %12s  %10ld  %10.0f  %8.4f  %8.2f  %13.2f  %9.3f  %.15e  ", dim, grid,
+               nodes, all_nodes, start, all_nodes/start*1e-6, all_nodes/start*1e-6/comm_sz,
+               times[0]/(-times[1] > 0.0 ? -times[1] : times[0]), my_sum);
+         if (known) printf("%.3e\n", fabs(my_sum - exact));
+         else printf("-\n");
+      }
+
+      for (k = 0; k < dim; k++) MPI_Comm_free(&line[k]);
+      MPI_Comm_free(&cart);
+   }
+
+   /* Shut down MPI */
+   MPI_Finalize();
+
+   return 0;
+} /*  main  */
+
+/*------------------------------------------------------------------
+ * Function:     Rule_nodes
+ * Purpose:      Number of nodes per dimension of a composite rule
+ */
+long Rule_nodes(int rule, long cells) {
+   return (rule == RULE_GAUSS) ? cells*GAUSS_Q : cells + 1;
+}  /* Rule_nodes */
+
+/*------------------------------------------------------------------
+ * Function:     Rule_node
+ * Purpose:      Node i of a composite rule with cells cells of width h
+ *               starting at a
+ * Output args:  x_p:  the node
+ *               w_p:  its weight
+ */
+void Rule_node(int rule, long cells, double a, double h, long i,
+      double* x_p, double* w_p) {
+   long c;
+
+   switch (rule) {
+      case RULE_TRAP:
+         *x_p = a + i*h;
+         *w_p = (i == 0 || i == cells) ? 0.5*h : h;
+         break;
+      case RULE_SIMPSON:
+         *x_p = a + i*h;
+         *w_p = (i == 0 || i == cells) ? h/3.0 : ((i % 2) ? 4.0*h/3.0 : 2.0*h/3.0);
+         break;
+      default:
+         c = i/GAUSS_Q;
+         *x_p = a + (c + 0.5*(1.0 + gl_node[i % GAUSS_Q]))*h;
+         *w_p = 0.5*h*gl_weight[i % GAUSS_Q];
+         break;
+   }
+}  /* Rule_node */
+
+/*------------------------------------------------------------------
+ * Function:     Local_sum
+ * Purpose:      Weighted sum of f over the nodes lo[k] <= i_k < hi[k]
+ *               of every dimension k; the threads split the last one
+ */
+double Local_sum(
+      cube_fn  f       /* in */,
+      int      dim     /* in */,
+      int      rule    /* in */,
+      long     cells   /* in */,
+      double   a       /* in */,
+      double   h       /* in */,
+      const long lo[]  /* in */,
+      const long hi[]  /* in */) {
+   double sum = 0.0;
+   int inner = dim-1, d;
+
+   for (d = 0; d < dim; d++)
+      if (hi[d] <= lo[d]) return 0.0;
+
+#  pragma omp parallel reduction(+: sum)
+   {
+      int my_thread = omp_get_thread_num(), thread_count = omp_get_num_threads();
+      long first = lo[inner] + BLOCK_LOW(my_thread, thread_count, hi[inner] - lo[inner]);
+      long last = lo[inner] + BLOCK_LOW(my_thread + 1, thread_count, hi[inner] - lo[inner]);
+      long idx[MAX_DIM], i;
+      double x[BATCH*MAX_DIM], y[BATCH], w[BATCH], outer_x[MAX_DIM], outer_w, wk, part;
+      int k, j, m, done = (first >= last);
+
+      for (k = 0; k < inner; k++) idx[k] = lo[k];
+      while (!done) {
+         /* The outer node (i_0, ..., i_{d-2}) */
+         outer_w = 1.0;
+         for (k = 0; k < inner; k++) {
+            Rule_node(rule, cells, a, h, idx[k], &outer_x[k], &wk);
+            outer_w *= wk;
+         }
+
+         /* My nodes along the last dimension, in batches */
+         part = 0.0;
+         for (i = first; i < last; i += m) {
+            m = (last - i < BATCH) ? (int)(last - i) : BATCH;
+            for (j = 0; j < m; j++) {
+               for (k = 0; k < inner; k++) x[j*dim + k] = outer_x[k];
+               Rule_node(rule, cells, a, h, i + j, &x[j*dim + inner], &w[j]);
+            }
+            f(m, dim, x, y);
+            for (j = 0; j < m; j++) part += w[j]*y[j];
+         }
+         sum += outer_w*part;
+
+         /* Next outer node */
+         for (k = inner-1; k >= 0; k--) {
+            if (++idx[k] < hi[k]) break;
+            idx[k] = lo[k];
+         }
+         done = (k < 0);
+      }
+   }
+
+   return sum;
+}  /* Local_sum */
+
+/*------------------------------------------------------------------
+ * Function:     f_gauss, f_corner, f_poly
+ * Purpose:      exp(-|x|^2), (1 + x_1 + ... + x_d)^-(d+1), |x|^2
+ */
+void f_gauss(int n, int dim, const double* x, double* y) {
+   int i, k;
+   double r2;
+
+   for (i = 0; i < n; i++) {
+      r2 = 0.0;
+      for (k = 0; k < dim; k++) r2 += x[i*dim + k]*x[i*dim + k];
+      y[i] = exp(-r2);
+   }
+}  /* f_gauss */
+
+void f_corner(int n, int dim, const double* x, double* y) {
+   int i, k;
+   double s, p;
+
+   for (i = 0; i < n; i++) {
+      s = 1.0;
+      for (k = 0; k < dim; k++) s += x[i*dim + k];
+      p = s*s;
+      y[i] = 1.0/((dim == 1) ? p : (dim == 2) ? p*s : p*p);
+   }
+}  /* f_corner */
+
+void f_poly(int n, int dim, const double* x, double* y) {
+   int i, k;
+   double r2;
+
+   for (i = 0; i < n; i++) {
+      r2 = 0.0;
+      for (k = 0; k < dim; k++) r2 += x[i*dim + k]*x[i*dim + k];
+      y[i] = r2;
+   }
+}  /* f_poly */
+
+/*------------------------------------------------------------------
+ * Function:     Exact
+ * Purpose:      The integral of an integrand over [a, b]^dim
+ * Output args:  known_p:  0 if there is no closed form here
+ */
+double Exact(const char* name, int dim, double a, double b, int* known_p) {
+   double one_d, fact = 1.0;
+   int k;
+
+   *known_p = 1;
+   if (strcmp(name, "gauss") == 0) {
+      one_d = 0.5*sqrt(4.0*atan(1.0))*(erf(b) - erf(a));
+      return pow(one_d, dim);
+   } else if (strcmp(name, "poly") == 0) {
+      return dim*(b*b*b - a*a*a)/3.0*pow(b - a, dim - 1);
+   }
+
+   /* corner: 1/(d+1)! on the unit cube */
+   if (a != 0.0 || b != 1.0) {
+      *known_p = 0;
+      return 0.0;
+   }
+   for (k = 2; k <= dim + 1; k++) fact *= k;
+   return 1.0/fact;
+}  /* Exact */
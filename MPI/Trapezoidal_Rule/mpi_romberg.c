@@ -0,0 +1,148 @@
+/* File:     mpi_romberg.c
+ * Purpose:  Romberg integration: instead of rerunning mpi_trap3.c with a
+ *           larger n and throwing the old evaluations away, halve the
+ *           trapezoid width level by level, evaluate f only at the new
+ *           midpoints, and extrapolate the trapezoid estimates of all
+ *           levels (Richardson) to cancel the h^2, h^4, ... error terms.
+ *
+ * Input:    The integrand, the interval and the tolerance on the command
+ *           line
+ * Output:   The trapezoid and extrapolated estimate at every level, and
+ *           their errors when the integrand has a known antiderivative
+ *
+ * Compile:  mpicc -g -Wall -O3 -o mpi_romberg mpi_romberg.c -lm -ldl
+ * Run:      mpiexec -n <number of processes> ./mpi_romberg
+ *              [integrand] [a b] [tolerance]
+ *           (integrand: see integrand.h; default pi on [0, 1])
+ *
+ * Algorithm:
+ *    1.  Level 0 is the trapezoid rule with one trapezoid.
+ *    2.  Level k has n = 2^k trapezoids of width h = (b-a)/n; its new
+ *        points are a + (2j+1)h, j = 0 .. n/2-1, split among the
+ *        processes in blocks.  Each process adds f over its block into an
+ *        exact accumulator (repro.h), and one MPI_Allreduce of the
+ *        accumulators gives
+ *           T_k = T_{k-1}/2 + h*sum.
+ *        The sum is exact before it is rounded, so the table, and the
+ *        level at which the iteration stops, are the same for any number
+ *        of processes.  Levels with fewer new points than processes are
+ *        evaluated by every process, which is cheaper than a reduction.
+ *    3.  Every process extrapolates
+ *           R_{k,m} = R_{k,m-1} + (R_{k,m-1} - R_{k-1,m-1})/(4^m - 1)
+ *        and stops when |R_{k,k} - R_{k-1,k-1}| <= tolerance (after at
+ *        least MIN_LEVEL levels, so a lucky early agreement does not
+ *        stop it) or at MAX_LEVEL.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* We'll be using MPI routines, definitions, etc. */
+#include <mpi.h>
+#include "integrand.h"
+#include "repro_mpi.h"
+
+#define TOL       1e-12
+#define MIN_LEVEL 4
+#define MAX_LEVEL 30
+#define BLOCK_LOW(id,p,n)  ((long)(id)*(n)/(p))
+
+int main(int argc, char* argv[]) {
+   int my_rank, comm_sz, k, m, converged = 0, reductions = 0;
+   long n, new_points, first, count;
+   double a = 0.0, b = 1.0, tol = TOL, h, exact = 0.0, change = 0.0;
+   double row[MAX_LEVEL+1], prev[MAX_LEVEL+1], sum;
+   double ends[2], f_ends[2], four_m, start, elapsed;
+   repro_acc_t part, total;
+   integrand_t f;
+
+   /* Let the system do what it needs to start up MPI */
+   MPI_Init(&argc, &argv);
+
+   /* Get my process rank */
+   MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+
+   /* Find out how many processes are being used */
+   MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+
+   if (integrand_lookup(argc > 1 ? argv[1] : "pi", &f, my_rank == 0 ? stderr : NULL) != 0) {
+      if (my_rank == 0) integrand_list(stderr);
+      MPI_Finalize();
+      return 1;
+   }
+   if (argc > 3) {
+      a = atof(argv[2]);
+      b = atof(argv[3]);
+   }
+   if (argc > 4) tol = atof(argv[4]);
+   if (f.antiderivative != NULL)
+      exact = f.antiderivative(b) - f.antiderivative(a);
+
+   if (my_rank == 0) {
+      printf("Romberg integration of %s from %f to %f, tolerance %.1e, %d processes\n",
+            f.formula, a, b, tol, comm_sz);
+      printf("level  trapezoids        trapezoid rule          extrapolated      change%s\n",
+            f.antiderivative != NULL ? "       error" : "");
+   }
+   start = MPI_Wtime();
+
+   /* Level 0: one trapezoid */
+   ends[0] = a;
+   ends[1] = b;
+   f.eval(2, ends, f_ends);
+   row[0] = (b - a)*(f_ends[0] + f_ends[1])/2.0;
+   n = 1;
+
+   for (k = 1; k <= MAX_LEVEL && !converged; k++) {
+      /* The new midpoints */
+      new_points = n;
+      n *= 2;
+      h = (b - a)/n;
+      repro_clear(&part);
+      if (new_points < comm_sz) {
+         integrand_grid_acc(&f, a, h, 1, new_points, 2, &part);
+         sum = repro_value(&part);
+      } else {
+         first = BLOCK_LOW(my_rank, comm_sz, new_points);
+         count = BLOCK_LOW(my_rank + 1, comm_sz, new_points) - first;
+         integrand_grid_acc(&f, a, h, 2*first + 1, count, 2, &part);
+         repro_allreduce(&part, &total, MPI_COMM_WORLD);
+         sum = repro_value(&total);
+         reductions++;
+      }
+
+      /* Extend the Romberg table by one row */
+      memcpy(prev, row, k*sizeof(double));
+      row[0] = prev[0]/2.0 + h*sum;
+      four_m = 1.0;
+      for (m = 1; m <= k; m++) {
+         four_m *= 4.0;
+         row[m] = row[m-1] + (row[m-1] - prev[m-1])/(four_m - 1.0);
+      }
+      change = fabs(row[k] - prev[k-1]);
+      converged = (k >= MIN_LEVEL && change <= tol);
+
+      if (my_rank == 0) {
+         printf("%5d  %10ld  %.15e  %.15e  %.3e", k, n, row[0], row[k], change);
+         if (f.antiderivative != NULL) printf("  %.3e", fabs(row[k] - exact));
+         printf("\n");
+      }
+   }
+   k--;
+   elapsed = MPI_Wtime() - start;
+
+   /* Print the result */
+   if (my_rank == 0) {
+      printf("%s after %d levels: %.15e, %ld evaluations, %d reductions, %.6f s\n",
+            converged ? "converged" : "NOT converged", k, row[k], n + 1, reductions, elapsed);
+      if (f.antiderivative != NULL)
+         printf("error %.3e; the trapezoid rule with the same %ld trapezoids: %.3e\n",
+               fabs(row[k] - exact), n, fabs(row[0] - exact));
+   }
+
+   /* Shut down MPI */
+   repro_free_types();
+   MPI_Finalize();
+
+   return 0;
+} /*  main  */
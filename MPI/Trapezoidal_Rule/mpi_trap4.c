@@ -9,8 +9,8 @@
  * Output:   Estimate of the integral from a to b of f(x)
  *           using the trapezoidal rule and n trapezoids.
  *
- * Compile:  mpicc -g -Wall -o mpi_trap4 mpi_trap4.c
- * Run:      mpiexec -n <number of processes> ./mpi_trap4
+ * Compile:  mpicc -g -Wall -o mpi_trap4 mpi_trap4.c -lm -ldl
+ * Run:      mpiexec -n <number of processes> ./mpi_trap4 [integrand]
  *
  * Algorithm:
  *    1.  Each process calculates "its" interval of
@@ -21,7 +21,8 @@
  *    3b. Process 0 sums the calculations received from
  *        the individual processes and prints the result.
  *
- * Note:  f(x) is all hardwired.
+ * Note:  f(x) is chosen by name on the command line (see
+ *        integrand.h); the default is x^2.
  *
  * IPP:   Section 3.5 (pp. 117 and ff.)
  */
@@ -29,6 +30,7 @@
 
 /* We'll be using MPI routines, definitions, etc. */
 #include <mpi.h>
+#include "integrand.h"
 
 /* Build a derived datatype for distributing the input data */
 void Build_mpi_type(double* a_p, double* b_p, int* n_p,
@@ -39,16 +41,14 @@ void Get_input(int my_rank, int comm_sz, double* a_p, double* b_p,
       int* n_p);
 
 /* Calculate local integral  */
-double Trap(double left_endpt, double right_endpt, int trap_count, 
-   double base_len);    
+double Trap(const integrand_t* f, double left_endpt, double right_endpt,
+   int trap_count, double base_len);
 
-/* Function we're integrating */
-double f(double x); 
-
-int main(void) {
+int main(int argc, char* argv[]) {
    int my_rank, comm_sz, n, local_n;   
    double a, b, h, local_a, local_b;
    double local_int, total_int;
+   integrand_t f;
 
    /* Let the system do what it needs to start up MPI */
    MPI_Init(NULL, NULL);
@@ -59,6 +59,14 @@ int main(void) {
    /* Find out how many processes are being used */
    MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
 
+   /* Find the function we're integrating */
+   if (integrand_lookup(argc > 1 ? argv[1] : "square", &f,
+         my_rank == 0 ? stderr : NULL) != 0) {
+      if (my_rank == 0) integrand_list(stderr);
+      MPI_Finalize();
+      return 1;
+   }
+
    Get_input(my_rank, comm_sz, &a, &b, &n);
 
    h = (b-a)/n;          /* h is the same for all processes */
@@ -69,7 +77,7 @@ int main(void) {
     * starts at: */
    local_a = a + my_rank*local_n*h;
    local_b = local_a + local_n*h;
-   local_int = Trap(local_a, local_b, local_n, h);
+   local_int = Trap(&f, local_a, local_b, local_n, h);
 
    /* Add up the integrals calculated by each process */
    MPI_Reduce(&local_int, &total_int, 1, MPI_DOUBLE, MPI_SUM, 0,
@@ -78,8 +86,8 @@ int main(void) {
    /* Print the result */
    if (my_rank == 0) {
       printf("With n = %d trapezoids, our estimate\n", n);
-      printf("of the integral from %f to %f = %.15e\n",
-          a, b, total_int);
+      printf("of the integral of %s from %f to %f = %.15e\n",
+          f.formula, a, b, total_int);
    }
 
    /* Shut down MPI */
@@ -151,8 +159,9 @@ void Get_input(
 /*------------------------------------------------------------------
  * Function:     Trap
  * Purpose:      Serial function for estimating a definite integral 
- *               using the trapezoidal rule
- * Input args:   left_endpt
+ *               using the trapezoidal rule, evaluating f in batches
+ * Input args:   f
+ *               left_endpt
  *               right_endpt
  *               trap_count 
  *               base_len
@@ -161,29 +170,17 @@ void Get_input(
  *               trapezoids
  */
 double Trap(
-      double left_endpt  /* in */, 
-      double right_endpt /* in */, 
-      int    trap_count  /* in */, 
-      double base_len    /* in */) {
-   double estimate, x; 
-   int i;
-
-   estimate = (f(left_endpt) + f(right_endpt))/2.0;
-   for (i = 1; i <= trap_count-1; i++) {
-      x = left_endpt + i*base_len;
-      estimate += f(x);
-   }
+      const integrand_t* f  /* in */,
+      double left_endpt     /* in */,
+      double right_endpt    /* in */,
+      int    trap_count     /* in */,
+      double base_len       /* in */) {
+   double estimate, ends[2] = {left_endpt, right_endpt}, f_ends[2];
+
+   f->eval(2, ends, f_ends);
+   estimate = (f_ends[0] + f_ends[1])/2.0;
+   estimate += integrand_grid_sum(f, left_endpt, base_len, 1, trap_count-1, 1);
    estimate = estimate*base_len;
 
    return estimate;
 } /*  Trap  */
-
-
-/*------------------------------------------------------------------
- * Function:    f
- * Purpose:     Compute value of function to be integrated
- * Input args:  x
- */
-double f(double x /* in */) {
-   return x*x;
-} /* f */
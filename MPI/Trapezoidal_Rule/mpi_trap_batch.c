@@ -0,0 +1,268 @@
+/* File:     mpi_trap_batch.c
+ * Purpose:  Batch version of mpi_trap4.c: estimate many integrals of
+ *           the same f in one run, so the cost of starting MPI is paid
+ *           once instead of once per integral.
+ *
+ * Input:    A list of jobs "a b n", one per line, from a file or from
+ *           stdin; blank lines and lines starting with '#' are skipped
+ * Output:   The trapezoidal rule estimate of every job, in input order,
+ *           and its error when f has a known antiderivative; the time
+ *           per integral
+ *
+ * Compile:  mpicc -g -Wall -O3 -o mpi_trap_batch mpi_trap_batch.c -lm -ldl
+ * Run:      mpiexec -n <number of processes> ./mpi_trap_batch
+ *              [integrand] [job file, or - for stdin]
+ *           e.g. awk 'BEGIN {for (i = 1; i <= 5000; i++) print 0, i/5000, 1000}' |
+ *              mpiexec -n 4 ./mpi_trap_batch pi -
+ *
+ * Algorithm:
+ *    1.  Process 0 reads the jobs into an array of the {a, b, n}
+ *        descriptors of mpi_trap4.c and broadcasts them: one MPI_Bcast
+ *        of the count and one of the array, whose derived datatype is
+ *        resized to the size of the struct.
+ *    2.  The trapezoids of all jobs are numbered one after the other,
+ *        and every process takes a block of this numbering.  A process
+ *        applies Trap to the part of each job that falls in its block,
+ *        so the work is balanced even when n varies from job to job,
+ *        and most jobs are handled by a single process.
+ *    3.  One MPI_Reduce of the vector of partial integrals gives
+ *        process 0 every estimate.
+ *
+ * Note:  f(x) is chosen by name on the command line (see integrand.h);
+ *        the default is x^2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* We'll be using MPI routines, definitions, etc. */
+#include <mpi.h>
+#include "integrand.h"
+
+#define LINE_MAX_LEN 256
+#define BLOCK_LOW(id,p,n)  ((long long)(id)*(n)/(p))
+
+/* One integration job, as in mpi_trap4.c */
+typedef struct {
+   double a, b;
+   int n;
+} job_t;
+
+/* Build a derived datatype for an array of jobs */
+void Build_mpi_type(job_t* job_p, MPI_Datatype* job_mpi_t_p);
+
+/* Read the jobs on process 0 and broadcast them */
+int Get_jobs(int my_rank, const char* file_name, job_t** jobs_p);
+
+/* Calculate local integral  */
+double Trap(const integrand_t* f, double left_endpt, double right_endpt,
+   int trap_count, double base_len);
+
+int main(int argc, char* argv[]) {
+   int my_rank, comm_sz, job_count, j;
+   long long total_traps, first, last, job_start, lo, hi;
+   double h, start, elapsed, error, max_error = 0.0;
+   double *local_int, *total_int = NULL;
+   job_t* jobs;
+   integrand_t f;
+
+   /* Let the system do what it needs to start up MPI */
+   MPI_Init(&argc, &argv);
+
+   /* Get my process rank */
+   MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+
+   /* Find out how many processes are being used */
+   MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+
+   /* Find the function we're integrating */
+   if (integrand_lookup(argc > 1 ? argv[1] : "square", &f,
+         my_rank == 0 ? stderr : NULL) != 0) {
+      if (my_rank == 0) integrand_list(stderr);
+      MPI_Finalize();
+      return 1;
+   }
+
+   job_count = Get_jobs(my_rank, argc > 2 ? argv[2] : "-", &jobs);
+   if (job_count <= 0) {
+      if (my_rank == 0 && job_count == 0) fprintf(stderr, "No jobs\n");
+      free(jobs);
+      MPI_Finalize();
+      return 1;
+   }
+
+   MPI_Barrier(MPI_COMM_WORLD);
+   start = MPI_Wtime();
+
+   /* My block of the trapezoids of all the jobs */
+   total_traps = 0;
+   for (j = 0; j < job_count; j++) total_traps += jobs[j].n;
+   first = BLOCK_LOW(my_rank, comm_sz, total_traps);
+   last = BLOCK_LOW(my_rank + 1, comm_sz, total_traps);
+
+   local_int = calloc(job_count, sizeof(double));
+   job_start = 0;
+   for (j = 0; j < job_count && job_start < last; j++) {
+      lo = (first > job_start) ? first - job_start : 0;
+      hi = (last < job_start + jobs[j].n) ? last - job_start : jobs[j].n;
+      if (lo < hi) {
+         h = (jobs[j].b - jobs[j].a)/jobs[j].n;
+         local_int[j] = Trap(&f, jobs[j].a + lo*h, jobs[j].a + hi*h,
+               (int)(hi - lo), h);
+      }
+      job_start += jobs[j].n;
+   }
+
+   /* Add up the integrals calculated by each process, all jobs at once */
+   if (my_rank == 0) total_int = malloc(job_count*sizeof(double));
+   MPI_Reduce(local_int, total_int, job_count, MPI_DOUBLE, MPI_SUM, 0,
+         MPI_COMM_WORLD);
+   elapsed = MPI_Wtime() - start;
+
+   /* Print the result */
+   if (my_rank == 0) {
+      printf("#  job             a             b           n  integral of %s%s\n",
+            f.formula, f.antiderivative != NULL ? "                  error" : "");
+      for (j = 0; j < job_count; j++) {
+         printf("%6d  %12.6g  %12.6g  %10d  %.15e", j, jobs[j].a, jobs[j].b,
+               jobs[j].n, total_int[j]);
+         if (f.antiderivative != NULL) {
+            error = fabs(total_int[j] - (f.antiderivative(jobs[j].b) - f.antiderivative(jobs[j].a)));
+            if (error > max_error) max_error = error;
+            printf("  %.3e", error);
+         }
+         printf("\n");
+      }
+      printf("# %d integrals, %lld trapezoids, %d processes: %.6f s, %.2f us per integral",
+            job_count, total_traps, comm_sz, elapsed, 1e6*elapsed/job_count);
+      if (f.antiderivative != NULL) printf(", max error %.3e", max_error);
+      printf("\n");
+   }
+
+   free(total_int);
+   free(local_int);
+   free(jobs);
+
+   /* Shut down MPI */
+   MPI_Finalize();
+
+   return 0;
+} /*  main  */
+
+/*------------------------------------------------------------------
+ * Function:     Build_mpi_type
+ * Purpose:      Build a derived datatype so that the three
+ *               values of a job can be sent in a single message,
+ *               with an extent of sizeof(job_t) so that arrays of
+ *               jobs can be sent too
+ * Input args:   job_p:  pointer to a job
+ * Output args:  job_mpi_t_p:  the new MPI datatype
+ */
+void Build_mpi_type(
+      job_t*         job_p        /* in  */,
+      MPI_Datatype*  job_mpi_t_p  /* out */) {
+
+   int array_of_blocklengths[3] = {1, 1, 1};
+   MPI_Datatype array_of_types[3] = {MPI_DOUBLE, MPI_DOUBLE, MPI_INT};
+   MPI_Aint a_addr, b_addr, n_addr;
+   MPI_Aint array_of_displacements[3] = {0};
+   MPI_Datatype struct_mpi_t;
+
+   MPI_Get_address(&job_p->a, &a_addr);
+   MPI_Get_address(&job_p->b, &b_addr);
+   MPI_Get_address(&job_p->n, &n_addr);
+   array_of_displacements[1] = b_addr-a_addr;
+   array_of_displacements[2] = n_addr-a_addr;
+   MPI_Type_create_struct(3, array_of_blocklengths,
+         array_of_displacements, array_of_types,
+         &struct_mpi_t);
+   MPI_Type_create_resized(struct_mpi_t, 0, sizeof(job_t), job_mpi_t_p);
+   MPI_Type_commit(job_mpi_t_p);
+   MPI_Type_free(&struct_mpi_t);
+}  /* Build_mpi_type */
+
+/*------------------------------------------------------------------
+ * Function:     Get_jobs
+ * Purpose:      Process 0 reads the jobs; every process gets the array
+ * Input args:   my_rank:  process rank in MPI_COMM_WORLD
+ *               file_name:  the job file, "-" for stdin
+ * Output args:  jobs_p:  the jobs, allocated here on every process
+ * Return val:   The number of jobs, -1 if the file can't be read
+ */
+int Get_jobs(
+      int          my_rank    /* in  */,
+      const char*  file_name  /* in  */,
+      job_t**      jobs_p     /* out */) {
+   MPI_Datatype job_mpi_t;
+   int job_count = 0, capacity = 0, line_no = 0;
+   char line[LINE_MAX_LEN], *p;
+   job_t job, *jobs = NULL;
+   FILE* in;
+
+   if (my_rank == 0) {
+      in = strcmp(file_name, "-") == 0 ? stdin : fopen(file_name, "r");
+      if (in == NULL) {
+         fprintf(stderr, "Can't open %s\n", file_name);
+         job_count = -1;
+      } else {
+         while (fgets(line, LINE_MAX_LEN, in) != NULL) {
+            line_no++;
+            for (p = line; *p == ' ' || *p == '\t'; p++);
+            if (*p == '#' || *p == '\n' || *p == '\0') continue;
+            if (sscanf(p, "%lf %lf %d", &job.a, &job.b, &job.n) != 3 || job.n <= 0) {
+               fprintf(stderr, "%s:%d: expected \"a b n\" with n > 0, skipped\n",
+                     file_name, line_no);
+               continue;
+            }
+            if (job_count == capacity) {
+               capacity = capacity ? 2*capacity : 1024;
+               jobs = realloc(jobs, capacity*sizeof(job_t));
+            }
+            jobs[job_count++] = job;
+         }
+         if (in != stdin) fclose(in);
+      }
+   }
+   MPI_Bcast(&job_count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+   if (my_rank != 0 && job_count > 0)
+      jobs = malloc(job_count*sizeof(job_t));
+   if (job_count > 0) {
+      Build_mpi_type(jobs, &job_mpi_t);
+      MPI_Bcast(jobs, job_count, job_mpi_t, 0, MPI_COMM_WORLD);
+      MPI_Type_free(&job_mpi_t);
+   }
+
+   *jobs_p = jobs;
+   return job_count;
+}  /* Get_jobs */
+
+/*------------------------------------------------------------------
+ * Function:     Trap
+ * Purpose:      Serial function for estimating a definite integral
+ *               using the trapezoidal rule, evaluating f in batches
+ * Input args:   f
+ *               left_endpt
+ *               right_endpt
+ *               trap_count
+ *               base_len
+ * Return val:   Trapezoidal rule estimate of integral from
+ *               left_endpt to right_endpt using trap_count
+ *               trapezoids
+ */
+double Trap(
+      const integrand_t* f  /* in */,
+      double left_endpt     /* in */,
+      double right_endpt    /* in */,
+      int    trap_count     /* in */,
+      double base_len       /* in */) {
+   double estimate, ends[2] = {left_endpt, right_endpt}, f_ends[2];
+
+   f->eval(2, ends, f_ends);
+   estimate = (f_ends[0] + f_ends[1])/2.0;
+   estimate += integrand_grid_sum(f, left_endpt, base_len, 1, trap_count-1, 1);
+   estimate = estimate*base_len;
+
+   return estimate;
+} /*  Trap  */
@@ -0,0 +1,132 @@
+/* File:     mpi_trap_repro.c
+ * Purpose:  The trapezoidal rule of mpi_trap3.c with three ways of
+ *           adding up the function values, to show which results depend
+ *           on the number of processes:
+ *              naive:    a running sum on each process, MPI_SUM
+ *              neumaier: compensated sums, reduced as (sum, compensation)
+ *                        pairs with a user-defined MPI_Op
+ *              binned:   exact fixed-point accumulators (repro.h),
+ *                        reduced with a user-defined MPI_Op
+ *           Run it with different numbers of processes: only the binned
+ *           result keeps the same bits.
+ *
+ * Input:    The integrand, n, a and b on the command line
+ * Output:   Each estimate in decimal and in hexadecimal floating point,
+ *           and its time
+ *
+ * Compile:  mpicc -g -Wall -O3 -o mpi_trap_repro mpi_trap_repro.c -lm -ldl
+ * Run:      mpiexec -n <number of processes> ./mpi_trap_repro
+ *              [integrand] [n] [a b]
+ *           (integrand: see integrand.h; default pi, 10^7, [0, 1])
+ *
+ * Note:     The abscissae are computed from their global index, a + i*h,
+ *           not from the start of each process' block as in mpi_trap3.c,
+ *           so every process count evaluates f at exactly the same
+ *           points; the weights 1/2 and h are applied once, after the
+ *           reduction.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* We'll be using MPI routines, definitions, etc. */
+#include <mpi.h>
+#include "integrand.h"
+#include "repro_mpi.h"
+
+#define N          10000000L
+#define BLOCK_LOW(id,p,n)  ((long)(id)*(n)/(p))
+
+int main(int argc, char* argv[]) {
+   int my_rank, comm_sz, method;
+   long n = N, first, last;
+   double a = 0.0, b = 1.0, h, ends[2], f_ends[2], local_sum, total_sum, start, elapsed, result[3];
+   const char* method_name[3] = {"naive", "neumaier", "binned"};
+   neumaier_t local_pair, total_pair;
+   repro_acc_t local_acc, total_acc;
+   integrand_t f;
+
+   /* Let the system do what it needs to start up MPI */
+   MPI_Init(&argc, &argv);
+
+   /* Get my process rank */
+   MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+
+   /* Find out how many processes are being used */
+   MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+
+   if (integrand_lookup(argc > 1 ? argv[1] : "pi", &f, my_rank == 0 ? stderr : NULL) != 0) {
+      if (my_rank == 0) integrand_list(stderr);
+      MPI_Finalize();
+      return 1;
+   }
+   if (argc > 2) n = atol(argv[2]);
+   if (argc > 4) {
+      a = atof(argv[3]);
+      b = atof(argv[4]);
+   }
+   h = (b-a)/n;
+
+   /* My block of the interior points 1 .. n-1; process 0 also takes
+    * the endpoints */
+   first = 1 + BLOCK_LOW(my_rank, comm_sz, n-1);
+   last = 1 + BLOCK_LOW(my_rank + 1, comm_sz, n-1);
+   ends[0] = a;
+   ends[1] = b;
+   f.eval(2, ends, f_ends);
+
+   if (my_rank == 0)
+      printf("Trapezoidal rule for %s on [%g, %g], n = %ld, %d processes\n",
+            f.formula, a, b, n, comm_sz);
+
+   for (method = 0; method < 3; method++) {
+      MPI_Barrier(MPI_COMM_WORLD);
+      start = MPI_Wtime();
+      if (method == 0) {
+         double x[INTEGRAND_BATCH], y[INTEGRAND_BATCH];
+         long i;
+         int j, m;
+
+         local_sum = (my_rank == 0) ? (f_ends[0] + f_ends[1])/2.0 : 0.0;
+         for (i = first; i < last; i += m) {
+            m = (last - i < INTEGRAND_BATCH) ? (int)(last - i) : INTEGRAND_BATCH;
+            for (j = 0; j < m; j++) x[j] = a + (i + j)*h;
+            f.eval(m, x, y);
+            for (j = 0; j < m; j++) local_sum += y[j];
+         }
+         MPI_Reduce(&local_sum, &total_sum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+      } else if (method == 1) {
+         local_pair.sum = integrand_grid_sum(&f, a, h, first, last - first, 1);
+         local_pair.comp = 0.0;
+         if (my_rank == 0) neumaier_add(&local_pair, (f_ends[0] + f_ends[1])/2.0);
+         neumaier_reduce(&local_pair, &total_pair, 0, MPI_COMM_WORLD);
+         total_sum = neumaier_value(&total_pair);
+      } else {
+         repro_clear(&local_acc);
+         integrand_grid_acc(&f, a, h, first, last - first, 1, &local_acc);
+         if (my_rank == 0) {
+            repro_add(&local_acc, f_ends[0]/2.0);
+            repro_add(&local_acc, f_ends[1]/2.0);
+         }
+         repro_reduce(&local_acc, &total_acc, 0, MPI_COMM_WORLD);
+         total_sum = repro_value(&total_acc);
+      }
+      elapsed = MPI_Wtime() - start;
+
+      /* Print the result */
+      if (my_rank == 0) {
+         result[method] = total_sum*h;
+         printf("%-9s %.17g  %a  %.4f s", method_name[method], result[method], result[method], elapsed);
+         if (f.antiderivative != NULL)
+            printf("  differs from the exact integral by %.3e",
+                  result[method] - (f.antiderivative(b) - f.antiderivative(a)));
+         printf("\n");
+      }
+   }
+
+   /* Shut down MPI */
+   repro_free_types();
+   MPI_Finalize();
+
+   return 0;
+} /*  main  */
@@ -0,0 +1,183 @@
+/* File:     omp_quad.h
+ * Purpose:  Shared-memory (OpenMP) versions of Trap and of the midpoint
+ *           rule of ../Homework2, for one process per node instead of
+ *           one per core.
+ *
+ * Usage:    omp_set_num_threads(t);
+ *           omp_quad_schedule("dynamic,256");  or OMP_SCHEDULE=...
+ *           estimate = Trap_omp(&f, a, b, n);
+ *           estimate = Midpoint_omp(&f, a, b, n);
+ *           omp_quad_binding(stdout);          where the threads run
+ *
+ * Compile:  with -fopenmp
+ *
+ * Note:     The loops over the points use schedule(runtime), so the
+ *           schedule and chunk size (in points) are chosen by
+ *           omp_quad_schedule or by OMP_SCHEDULE without recompiling.
+ *           Each thread collects the abscissae of its iterations and
+ *           evaluates f INTEGRAND_BATCH points at a time, whatever the
+ *           chunk size, and the partial sums are combined by
+ *           reduction(+), not a critical section.
+ *
+ *           Pinning is set with OMP_PROC_BIND (close, spread) and
+ *           OMP_PLACES (cores, threads, sockets) before the program
+ *           starts; omp_quad_binding shows the result.
+ */
+#ifndef OMP_QUAD_H
+#define OMP_QUAD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "integrand.h"
+
+/*------------------------------------------------------------------
+ * Function:     omp_quad_schedule
+ * Purpose:      Set the schedule of the runtime-scheduled loops from
+ *               "static", "dynamic" or "guided", optionally followed by
+ *               ",chunk"
+ * Return val:   0, or -1 if spec is not a schedule
+ */
+static inline int omp_quad_schedule(const char* spec) {
+   const char* comma = strchr(spec, ',');
+   size_t len = comma ? (size_t)(comma - spec) : strlen(spec);
+   int chunk = comma ? atoi(comma + 1) : 0;   /* 0: the default */
+   omp_sched_t kind;
+
+   if (len == 6 && strncmp(spec, "static", len) == 0)
+      kind = omp_sched_static;
+   else if (len == 7 && strncmp(spec, "dynamic", len) == 0)
+      kind = omp_sched_dynamic;
+   else if (len == 6 && strncmp(spec, "guided", len) == 0)
+      kind = omp_sched_guided;
+   else
+      return -1;
+   if (chunk < 0) return -1;
+   omp_set_schedule(kind, chunk);
+   return 0;
+}  /* omp_quad_schedule */
+
+/*------------------------------------------------------------------
+ * Function:     omp_quad_schedule_name
+ * Purpose:      The current runtime schedule as "kind,chunk"
+ */
+static inline const char* omp_quad_schedule_name(char* buf, size_t size) {
+   omp_sched_t kind;
+   int chunk;
+   const char* name;
+
+   omp_get_schedule(&kind, &chunk);
+   switch ((int) kind & ~(int) omp_sched_monotonic) {
+      case omp_sched_static:  name = "static";  break;
+      case omp_sched_dynamic: name = "dynamic"; break;
+      case omp_sched_guided:  name = "guided";  break;
+      default:                name = "auto";    break;
+   }
+   if (chunk > 0)
+      snprintf(buf, size, "%s,%d", name, chunk);
+   else
+      snprintf(buf, size, "%s", name);
+   return buf;
+}  /* omp_quad_schedule_name */
+
+/*------------------------------------------------------------------
+ * Function:     omp_grid_sum
+ * Purpose:      Sum of f(a + (first + k*stride)*h) for k = 0 .. count-1
+ *               on the current team size, the OpenMP counterpart of
+ *               integrand_grid_sum
+ */
+static inline double omp_grid_sum(const integrand_t* f, double a, double h,
+      double first, long count, long stride) {
+   double sum = 0.0;
+
+#  pragma omp parallel reduction(+: sum)
+   {
+      double x[INTEGRAND_BATCH], y[INTEGRAND_BATCH];
+      long k;
+      int j, m = 0;
+
+#     pragma omp for schedule(runtime) nowait
+      for (k = 0; k < count; k++) {
+         x[m++] = a + (first + (double) k*stride)*h;
+         if (m == INTEGRAND_BATCH) {
+            f->eval(m, x, y);
+            for (j = 0; j < m; j++) sum += y[j];
+            m = 0;
+         }
+      }
+      if (m > 0) {
+         f->eval(m, x, y);
+         for (j = 0; j < m; j++) sum += y[j];
+      }
+   }
+   return sum;
+}  /* omp_grid_sum */
+
+/*------------------------------------------------------------------
+ * Function:     Trap_omp
+ * Purpose:      Trapezoidal rule estimate of the integral of f from a to
+ *               b with n trapezoids, computed by the current team
+ */
+static inline double Trap_omp(const integrand_t* f, double a, double b, long n) {
+   double h = (b - a)/n, ends[2] = {a, b}, f_ends[2];
+
+   f->eval(2, ends, f_ends);
+   return h*((f_ends[0] + f_ends[1])/2.0 + omp_grid_sum(f, a, h, 1.0, n - 1, 1));
+}  /* Trap_omp */
+
+/*------------------------------------------------------------------
+ * Function:     Midpoint_omp
+ * Purpose:      Midpoint (rectangle) rule estimate of the integral of f
+ *               from a to b with n rectangles, computed by the current
+ *               team
+ */
+static inline double Midpoint_omp(const integrand_t* f, double a, double b, long n) {
+   double h = (b - a)/n;
+
+   return h*omp_grid_sum(f, a, h, 0.5, n, 1);
+}  /* Midpoint_omp */
+
+/*------------------------------------------------------------------
+ * Function:     omp_quad_binding
+ * Purpose:      Print the binding policy and the place (and its
+ *               processors) of every thread of a team of the current
+ *               size
+ */
+static inline void omp_quad_binding(FILE* out) {
+   static const char* policy[] = {"false", "true", "master", "close", "spread"};
+   omp_proc_bind_t bind = omp_get_proc_bind();
+   int place_count = omp_get_num_places();
+
+   fprintf(out, "proc_bind %s, %d places, %d processors\n",
+         (int) bind >= 0 && (int) bind <= 4 ? policy[bind] : "?", place_count,
+         omp_get_num_procs());
+   if (bind == omp_proc_bind_false || place_count == 0) {
+      fprintf(out, "threads are not pinned; set OMP_PROC_BIND=close|spread and OMP_PLACES=cores\n");
+      return;
+   }
+
+#  pragma omp parallel
+   {
+      int t, place = omp_get_place_num(), *ids, count, i;
+      char line[512];
+      size_t used;
+
+#     pragma omp for ordered schedule(static, 1)
+      for (t = 0; t < omp_get_num_threads(); t++) {
+#        pragma omp ordered
+         {
+            used = snprintf(line, sizeof(line), "   thread %3d: place %3d, processors", t, place);
+            count = (place >= 0) ? omp_get_place_num_procs(place) : 0;
+            ids = malloc((count > 0 ? count : 1)*sizeof(int));
+            if (count > 0) omp_get_place_proc_ids(place, ids);
+            for (i = 0; i < count && used < sizeof(line) - 12; i++)
+               used += snprintf(line + used, sizeof(line) - used, " %d", ids[i]);
+            fprintf(out, "%s\n", line);
+            free(ids);
+         }
+      }
+   }
+}  /* omp_quad_binding */
+
+#endif /* OMP_QUAD_H */
@@ -0,0 +1,118 @@
+/* File:     omp_trap.c
+ * Purpose:  Shared-memory version of the trapezoidal and midpoint rules
+ *           (omp_quad.h), with a scaling report: the time of both rules
+ *           for 1, 2, ..., max threads under each of the given loop
+ *           schedules.
+ *
+ * Input:    The integrand, n, the largest number of threads and the
+ *           schedules on the command line
+ * Output:   The thread placement, then for every rule, schedule and
+ *           number of threads: the best time of REPS runs, the speedup
+ *           and efficiency against one thread with the same schedule,
+ *           and the error when f has a known antiderivative
+ *
+ * Compile:  gcc -g -Wall -O3 -fopenmp -o omp_trap omp_trap.c -lm -ldl
+ * Run:      OMP_PROC_BIND=close OMP_PLACES=cores ./omp_trap
+ *              [integrand] [n] [max threads] [schedule[,chunk] ...]
+ *           (integrand: see integrand.h; defaults pi, 10^8, the number
+ *           of processors, and "static dynamic,4096 guided")
+ *
+ * Note:     The integral is from 0 to 1, as in ../Homework2.  With
+ *           OMP_PROC_BIND unset the threads may migrate between cores
+ *           and the timings vary; the program says so.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include "omp_quad.h"
+
+#define N     100000000L
+#define REPS  3
+#define MAX_SCHEDULES 16
+
+/* Best time of REPS runs of one rule */
+double Time_rule(int rule, const integrand_t* f, long n, double* estimate_p);
+
+int main(int argc, char* argv[]) {
+   const char* default_schedules[] = {"static", "dynamic,4096", "guided"};
+   const char* schedules[MAX_SCHEDULES];
+   const char* rule_name[2] = {"trapezoid", "midpoint"};
+   int schedule_count = 3, max_threads, threads, rule, s;
+   long n = N;
+   double exact = 0.0, estimate, elapsed, serial = 0.0;
+   char name[64];
+   integrand_t f;
+
+   if (integrand_lookup(argc > 1 ? argv[1] : "pi", &f, stderr) != 0) {
+      integrand_list(stderr);
+      return 1;
+   }
+   if (argc > 2) n = atol(argv[2]);
+   max_threads = (argc > 3) ? atoi(argv[3]) : omp_get_num_procs();
+   if (n < 1 || max_threads < 1) {
+      fprintf(stderr, "usage: %s [integrand] [n] [max threads] [schedule[,chunk] ...]\n", argv[0]);
+      return 1;
+   }
+   if (argc > 4) {
+      schedule_count = 0;
+      for (s = 4; s < argc && schedule_count < MAX_SCHEDULES; s++) {
+         if (omp_quad_schedule(argv[s]) != 0) {
+            fprintf(stderr, "Unknown schedule %s: use static, dynamic or guided, optionally ,chunk\n", argv[s]);
+            return 1;
+         }
+         schedules[schedule_count++] = argv[s];
+      }
+   } else {
+      for (s = 0; s < schedule_count; s++) schedules[s] = default_schedules[s];
+   }
+   if (f.antiderivative != NULL)
+      exact = f.antiderivative(1.0) - f.antiderivative(0.0);
+
+   printf("Integral of %s from 0 to 1, n = %ld, best of %d runs\n", f.formula, n, REPS);
+   omp_set_num_threads(max_threads);
+   omp_quad_binding(stdout);
+
+   printf("%-9s  %-14s  %7s  %10s  %7s  %10s  %22s%s\n", "rule", "schedule", "threads",
+         "time (s)", "speedup", "efficiency", "estimate", f.antiderivative != NULL ? "      error" : "");
+   for (rule = 0; rule < 2; rule++)
+      for (s = 0; s < schedule_count; s++) {
+         omp_quad_schedule(schedules[s]);
+         for (threads = 1; threads <= max_threads; threads++) {
+            omp_set_num_threads(threads);
+            elapsed = Time_rule(rule, &f, n, &estimate);
+            if (threads == 1) serial = elapsed;
+            printf("%-9s  %-14s  %7d  %10.6f  %7.2f  %9.1f%%  %.15e",
+                  rule_name[rule], omp_quad_schedule_name(name, sizeof(name)), threads,
+                  elapsed, serial/elapsed, 100.0*serial/elapsed/threads, estimate);
+            if (f.antiderivative != NULL) printf("  %.3e", fabs(estimate - exact));
+            printf("\n");
+         }
+      }
+
+   return 0;
+}  /* main */
+
+/*------------------------------------------------------------------
+ * Function:     Time_rule
+ * Purpose:      Run the trapezoidal (rule 0) or midpoint (rule 1) rule
+ *               REPS times on the current number of threads
+ * Output args:  estimate_p:  the estimate of the last run
+ * Return val:   The shortest wall clock time
+ */
+double Time_rule(
+      int                rule        /* in  */,
+      const integrand_t* f           /* in  */,
+      long               n           /* in  */,
+      double*            estimate_p  /* out */) {
+   double start, elapsed, best = 0.0;
+   int r;
+
+   for (r = 0; r < REPS; r++) {
+      start = omp_get_wtime();
+      *estimate_p = (rule == 0) ? Trap_omp(f, 0.0, 1.0, n) : Midpoint_omp(f, 0.0, 1.0, n);
+      elapsed = omp_get_wtime() - start;
+      if (r == 0 || elapsed < best) best = elapsed;
+   }
+   return best;
+}  /* Time_rule */
@@ -0,0 +1,270 @@
+/* File:     partition.h
+ * Purpose:  Divide the indices 0, 1, ..., n-1 among the p ranks of a
+ *           communicator: by blocks, cyclically, by cyclic chunks or by
+ *           weighted blocks, with the weights optionally measured.
+ *
+ * Usage:    part_parse("block-cyclic,512", &kind, &chunk);
+ *           part_init(&part, kind, n, p, chunk);    or part_weighted,
+ *           part_autotune(&part, n, probe, ctx, comm);
+ *           for (k = 0; k < part_runs(&part, rank); k++) {
+ *              part_run(&part, rank, k, &run);
+ *              sum += integrand_grid_sum(&f, a, h, run.first + 0.5,
+ *                                        run.count, run.stride);
+ *           }
+ *           part_free(&part);
+ *
+ * Layouts:  block         one run per rank, sizes differ by at most one
+ *           cyclic        one run of stride p: index i to rank i % p
+ *           block-cyclic  runs of chunk contiguous indices dealt out
+ *                         round robin: load balance of cyclic for
+ *                         cost that varies along the range, contiguous
+ *                         loops (vectorized evaluation, prefetching)
+ *                         inside each run
+ *           weighted      one run per rank, sizes proportional to the
+ *                         weights given to part_weighted (not a
+ *                         command-line layout: part_parse rejects it)
+ *           auto          weighted, with each rank's weight its measured
+ *                         throughput (part_autotune), so ranks on faster
+ *                         or less loaded nodes get more indices and all
+ *                         finish together
+ *
+ * Note:     A run is first, first + stride, ..., first + (count-1)*stride,
+ *           which is what integrand_grid_sum and the Trap functions of
+ *           this directory take.  The bounds of block are those of the
+ *           BLOCK_LOW macro of the homework programs, (r*n)/p, and a
+ *           rank's indices are BLOCK_LOW(r) <= i < BLOCK_LOW(r+1).
+ */
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <mpi.h>
+
+#define PART_CHUNK       512      /* default chunk: one batch of integrand.h */
+#define PART_PROBE_TIME  0.005    /* seconds each rank probes in part_autotune */
+
+typedef enum { PART_BLOCK, PART_CYCLIC, PART_BLOCK_CYCLIC, PART_WEIGHTED, PART_AUTO } part_kind_t;
+
+typedef struct {
+   part_kind_t kind;
+   long n, chunk;
+   int p;
+   long* bounds;        /* weighted: rank r has bounds[r] <= i < bounds[r+1] */
+} partition_t;
+
+/* One run of indices */
+typedef struct {
+   long first, count, stride;
+} part_run_t;
+
+/* Time count indices starting at first, for part_autotune; returns a
+ * result that is kept so the work isn't optimized away */
+typedef double (*part_probe_fn)(long first, long count, void* ctx);
+
+static const char* part_kind_name[] = {"block", "cyclic", "block-cyclic", "weighted", "auto"};
+
+/*------------------------------------------------------------------
+ * Function:     part_parse
+ * Purpose:      Read "block", "cyclic", "block-cyclic[,chunk]" or
+ *               "auto"
+ * Return val:   0, or -1 if spec is not a layout
+ * Note:         "weighted" is not accepted: a command line has no way to
+ *               give the weights, so call part_weighted instead
+ */
+static inline int part_parse(const char* spec, part_kind_t* kind, long* chunk) {
+   const char* comma = strchr(spec, ',');
+   size_t len = comma ? (size_t)(comma - spec) : strlen(spec);
+   int k;
+
+   *chunk = comma ? atol(comma + 1) : PART_CHUNK;
+   if (*chunk <= 0) return -1;
+   for (k = PART_BLOCK; k <= PART_AUTO; k++)
+      if (k != PART_WEIGHTED && strlen(part_kind_name[k]) == len && strncmp(spec, part_kind_name[k], len) == 0) {
+         *kind = (part_kind_t) k;
+         return 0;
+      }
+   return -1;
+}  /* part_parse */
+
+/*------------------------------------------------------------------
+ * Function:     part_weighted
+ * Purpose:      Blocks of sizes proportional to weights[0..p-1]; weights
+ *               that are negative or not finite count as 0, and if all
+ *               are 0 the blocks are equal
+ */
+static inline void part_weighted(partition_t* part, long n, int p, const double* weights) {
+   double total = 0.0, below = 0.0;
+   int r;
+
+   part->kind = PART_WEIGHTED;
+   part->n = n;
+   part->p = p;
+   part->chunk = 0;
+   part->bounds = realloc(part->bounds, (p + 1)*sizeof(long));
+   for (r = 0; r < p; r++)
+      if (isfinite(weights[r]) && weights[r] > 0.0) total += weights[r];
+   part->bounds[0] = 0;
+   for (r = 0; r < p; r++) {
+      if (total == 0.0)
+         below = r + 1.0;
+      else if (isfinite(weights[r]) && weights[r] > 0.0)
+         below += weights[r];
+      part->bounds[r+1] = (long) floor((double) n*(below/(total == 0.0 ? p : total)) + 0.5);
+      if (part->bounds[r+1] < part->bounds[r]) part->bounds[r+1] = part->bounds[r];
+      if (part->bounds[r+1] > n) part->bounds[r+1] = n;
+   }
+   part->bounds[p] = n;
+}  /* part_weighted */
+
+/*------------------------------------------------------------------
+ * Function:     part_init
+ * Purpose:      Block, cyclic or block-cyclic layout of n indices on p
+ *               ranks (weighted and auto start as block; see
+ *               part_weighted and part_autotune)
+ */
+static inline void part_init(partition_t* part, part_kind_t kind, long n, int p, long chunk) {
+   part->kind = (kind == PART_WEIGHTED || kind == PART_AUTO) ? PART_BLOCK : kind;
+   part->n = n;
+   part->p = p;
+   part->chunk = chunk > 0 ? chunk : PART_CHUNK;
+   part->bounds = NULL;
+}  /* part_init */
+
+static inline void part_free(partition_t* part) {
+   free(part->bounds);
+   part->bounds = NULL;
+}  /* part_free */
+
+/*------------------------------------------------------------------
+ * Function:     part_runs
+ * Purpose:      The number of runs of rank
+ */
+static inline long part_runs(const partition_t* part, int rank) {
+   long chunks;
+
+   switch (part->kind) {
+      case PART_BLOCK_CYCLIC:
+         chunks = (part->n + part->chunk - 1)/part->chunk;
+         return (chunks - rank + part->p - 1)/part->p;
+      default:
+         return 1;
+   }
+}  /* part_runs */
+
+/*------------------------------------------------------------------
+ * Function:     part_run
+ * Purpose:      Run k (0 <= k < part_runs) of rank
+ */
+static inline void part_run(const partition_t* part, int rank, long k, part_run_t* run) {
+   long n = part->n, p = part->p;
+
+   run->stride = 1;
+   switch (part->kind) {
+      case PART_CYCLIC:
+         run->first = rank;
+         run->count = rank < n ? (n - rank + p - 1)/p : 0;
+         run->stride = p;
+         break;
+      case PART_BLOCK_CYCLIC:
+         run->first = (k*p + rank)*part->chunk;
+         run->count = n - run->first < part->chunk ? n - run->first : part->chunk;
+         break;
+      case PART_WEIGHTED:
+         run->first = part->bounds[rank];
+         run->count = part->bounds[rank+1] - part->bounds[rank];
+         break;
+      default:
+         run->first = rank*n/p;
+         run->count = (rank + 1)*n/p - run->first;
+   }
+}  /* part_run */
+
+/*------------------------------------------------------------------
+ * Function:     part_count
+ * Purpose:      The number of indices of rank
+ */
+static inline long part_count(const partition_t* part, int rank) {
+   part_run_t run;
+   long chunks, last;
+
+   if (part->kind != PART_BLOCK_CYCLIC) {
+      part_run(part, rank, 0, &run);
+      return run.count;
+   }
+   chunks = part_runs(part, rank);
+   if (chunks == 0) return 0;
+   part_run(part, rank, chunks - 1, &run);
+   last = run.count;
+   return (chunks - 1)*part->chunk + last;
+}  /* part_count */
+
+/*------------------------------------------------------------------
+ * Function:     part_owner
+ * Purpose:      The rank that has index i
+ */
+static inline int part_owner(const partition_t* part, long i) {
+   int lo = 0, hi = part->p - 1, mid;
+
+   switch (part->kind) {
+      case PART_CYCLIC:
+         return (int)(i % part->p);
+      case PART_BLOCK_CYCLIC:
+         return (int)((i/part->chunk) % part->p);
+      case PART_WEIGHTED:
+         while (lo < hi) {                 /* last r with bounds[r] <= i */
+            mid = (lo + hi + 1)/2;
+            if (part->bounds[mid] <= i) lo = mid; else hi = mid - 1;
+         }
+         return lo;
+      default:
+         return (int)((part->p*(i + 1) - 1)/part->n);
+   }
+}  /* part_owner */
+
+/*------------------------------------------------------------------
+ * Function:     part_autotune
+ * Purpose:      Weighted layout of n indices on the ranks of comm, with
+ *               weights the throughputs the ranks measure running probe
+ *               together
+ * Note:         Collective.  Each rank runs probe on 64, 128, ... of
+ *               its block's indices until a call takes PART_PROBE_TIME;
+ *               all ranks get the same throughputs, so the same layout.
+ *               Returns the time of the probe phase, the slowest rank's.
+ */
+static inline double part_autotune(partition_t* part, long n, part_probe_fn probe, void* ctx,
+      MPI_Comm comm) {
+   double start, elapsed, rate, *rates, phase;
+   volatile double keep;
+   long count = 64, first, most;
+   int rank, p;
+
+   MPI_Comm_rank(comm, &rank);
+   MPI_Comm_size(comm, &p);
+   first = rank*n/p;
+   most = (rank + 1)*n/p - first;
+   MPI_Barrier(comm);
+   phase = MPI_Wtime();
+   for (;;) {
+      if (count > most) count = most;
+      start = MPI_Wtime();
+      keep = probe(first, count, ctx);
+      elapsed = MPI_Wtime() - start;
+      if (elapsed >= PART_PROBE_TIME || count == most) break;
+      count *= 2;
+   }
+   (void) keep;
+   rate = count > 0 && elapsed > 0.0 ? count/elapsed : 0.0;
+
+   rates = malloc(p*sizeof(double));
+   MPI_Allgather(&rate, 1, MPI_DOUBLE, rates, 1, MPI_DOUBLE, comm);
+   part_weighted(part, n, p, rates);
+   free(rates);
+   phase = MPI_Wtime() - phase;
+   MPI_Allreduce(MPI_IN_PLACE, &phase, 1, MPI_DOUBLE, MPI_MAX, comm);
+   return phase;
+}  /* part_autotune */
+
+#endif /* PARTITION_H */
@@ -0,0 +1,204 @@
+/* File:     repro.h
+ * Purpose:  Compensated and reproducible sums for the quadrature
+ *           programs, locally and across processes.
+ *
+ * Usage:    Neumaier (compensated, about twice the working precision):
+ *              neumaier_t s = {0.0, 0.0};
+ *              neumaier_add(&s, x);  ...
+ *              neumaier_value(&total)
+ *           Pairwise:
+ *              sum = repro_pairwise_sum(n, x);
+ *           Binned fixed point (exact, so reproducible):
+ *              repro_acc_t acc;
+ *              repro_clear(&acc);
+ *              repro_add(&acc, x);  ...
+ *              repro_merge(&acc, &other);   or across processes,
+ *                                           repro_allreduce (repro_mpi.h)
+ *              repro_value(&total)
+ *
+ * Note:     Floating point addition is not associative, so a sum that
+ *           is split differently among processes (or threads, or SIMD
+ *           lanes) usually changes in the last bits.  Neumaier and
+ *           pairwise summation make the error much smaller, but not
+ *           independent of the order.  repro_acc_t is: every double is
+ *           split exactly into 32-bit digits of one wide fixed-point
+ *           number covering the whole double range, 2^-1126 .. 2^1088
+ *           and beyond, with each digit kept in an int64_t so carries
+ *           can wait for up to 2^30 additions.  Integer addition is
+ *           associative, so the sum, and the double it is rounded to,
+ *           are the same bits for any number of processes and any
+ *           order of the terms, provided the terms themselves do not
+ *           change: no -ffast-math (see integrand.h).  An addition
+ *           costs a few integer operations and a reduction moves 576
+ *           bytes.
+ *
+ *           Nothing here uses MPI, so the OpenMP programs build with a
+ *           plain C compiler; the reductions are in repro_mpi.h.
+ */
+#ifndef REPRO_H
+#define REPRO_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define REPRO_DIGIT_BITS 32
+#define REPRO_DIGITS     70       /* 2240 bits */
+#define REPRO_BIAS       1126     /* bit 0 of the number is 2^-1126 */
+#define REPRO_FLUSH      (1L << 30)  /* additions between carries */
+#define REPRO_POS_INF    1
+#define REPRO_NEG_INF    2
+#define REPRO_NAN        4
+
+typedef struct {
+   double sum, comp;
+} neumaier_t;
+
+typedef struct {
+   int64_t digit[REPRO_DIGITS];   /* digit i has weight 2^(32i - REPRO_BIAS) */
+   int64_t adds;                  /* additions since the last carry */
+   int64_t nonfinite;             /* REPRO_POS_INF | REPRO_NEG_INF | REPRO_NAN */
+} repro_acc_t;
+
+/*------------------------------------------------------------------
+ * Function:     neumaier_add
+ * Purpose:      s += x, keeping the rounding error of every addition in
+ *               s->comp (Kahan-Babuska-Neumaier)
+ */
+static inline void neumaier_add(neumaier_t* s, double x) {
+   double t = s->sum + x;
+
+   if (fabs(s->sum) >= fabs(x))
+      s->comp += (s->sum - t) + x;
+   else
+      s->comp += (x - t) + s->sum;
+   s->sum = t;
+}  /* neumaier_add */
+
+static inline double neumaier_value(const neumaier_t* s) {
+   return s->sum + s->comp;
+}  /* neumaier_value */
+
+/*------------------------------------------------------------------
+ * Function:     repro_pairwise_sum
+ * Purpose:      Sum of x[0 .. n-1] by halving, with an 8-way unrolled
+ *               loop at the leaves; the error grows like log n instead
+ *               of n
+ */
+static inline double repro_pairwise_sum(long n, const double* x) {
+   double s[8];
+   long i;
+   int j;
+
+   if (n > 128)
+      return repro_pairwise_sum(n/2, x) + repro_pairwise_sum(n - n/2, x + n/2);
+   for (j = 0; j < 8; j++) s[j] = 0.0;
+   for (i = 0; i + 8 <= n; i += 8)
+      for (j = 0; j < 8; j++) s[j] += x[i + j];
+   for (; i < n; i++) s[0] += x[i];
+   return ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+}  /* repro_pairwise_sum */
+
+static inline void repro_clear(repro_acc_t* acc) {
+   memset(acc, 0, sizeof(*acc));
+}  /* repro_clear */
+
+/*------------------------------------------------------------------
+ * Function:     repro_carry
+ * Purpose:      Bring every digit but the last into [0, 2^32); the last
+ *               one keeps the sign.  The result depends only on the
+ *               value, not on how it was summed.
+ */
+static inline void repro_carry(repro_acc_t* acc) {
+   int64_t c;
+   int i;
+
+   for (i = 0; i < REPRO_DIGITS-1; i++) {
+      c = acc->digit[i] >> REPRO_DIGIT_BITS;    /* floor division */
+      acc->digit[i] -= c * ((int64_t) 1 << REPRO_DIGIT_BITS);
+      acc->digit[i+1] += c;
+   }
+   acc->adds = 0;
+}  /* repro_carry */
+
+/*------------------------------------------------------------------
+ * Function:     repro_add
+ * Purpose:      acc += x, exactly
+ */
+static inline void repro_add(repro_acc_t* acc, double x) {
+   unsigned __int128 bits;
+   int64_t mant;
+   uint64_t mag;
+   int e, pos, i;
+
+   if (x == 0.0) return;
+   if (!isfinite(x)) {
+      acc->nonfinite |= isnan(x) ? REPRO_NAN : (x > 0 ? REPRO_POS_INF : REPRO_NEG_INF);
+      return;
+   }
+   if (acc->adds >= REPRO_FLUSH) repro_carry(acc);
+
+   /* x = mant * 2^(e-53), |mant| < 2^53, also for subnormals */
+   mant = (int64_t) ldexp(frexp(x, &e), 53);
+   mag = (mant < 0) ? (uint64_t)(-mant) : (uint64_t) mant;
+   pos = e - 53 + REPRO_BIAS;
+   i = pos / REPRO_DIGIT_BITS;
+   bits = (unsigned __int128) mag << (pos % REPRO_DIGIT_BITS);
+
+   if (mant > 0) {
+      acc->digit[i]   += (int64_t)(bits & 0xffffffffu);
+      acc->digit[i+1] += (int64_t)((bits >> 32) & 0xffffffffu);
+      acc->digit[i+2] += (int64_t)(bits >> 64);
+   } else {
+      acc->digit[i]   -= (int64_t)(bits & 0xffffffffu);
+      acc->digit[i+1] -= (int64_t)((bits >> 32) & 0xffffffffu);
+      acc->digit[i+2] -= (int64_t)(bits >> 64);
+   }
+   acc->adds++;
+}  /* repro_add */
+
+/*------------------------------------------------------------------
+ * Function:     repro_merge
+ * Purpose:      acc += other
+ */
+static inline void repro_merge(repro_acc_t* acc, const repro_acc_t* other) {
+   repro_acc_t tmp = *other;
+   int i;
+
+   repro_carry(acc);
+   repro_carry(&tmp);
+   for (i = 0; i < REPRO_DIGITS; i++) acc->digit[i] += tmp.digit[i];
+   acc->nonfinite |= tmp.nonfinite;
+   repro_carry(acc);
+}  /* repro_merge */
+
+/*------------------------------------------------------------------
+ * Function:     repro_value
+ * Purpose:      The sum, rounded to a double
+ */
+static inline double repro_value(const repro_acc_t* acc) {
+   repro_acc_t tmp = *acc;
+   double value = 0.0, sign = 1.0;
+   int i;
+
+   if (tmp.nonfinite & REPRO_NAN || (tmp.nonfinite & REPRO_POS_INF && tmp.nonfinite & REPRO_NEG_INF))
+      return NAN;
+   if (tmp.nonfinite) return (tmp.nonfinite & REPRO_POS_INF) ? INFINITY : -INFINITY;
+
+   /* Work with the magnitude, so all digits add up with the same sign */
+   repro_carry(&tmp);
+   if (tmp.digit[REPRO_DIGITS-1] < 0) {
+      sign = -1.0;
+      for (i = 0; i < REPRO_DIGITS; i++) tmp.digit[i] = -tmp.digit[i];
+      repro_carry(&tmp);
+   }
+
+   /* From the top down, so the big digits are added first; the
+    * digits depend only on the exact sum, and so does the result */
+   for (i = REPRO_DIGITS-1; i >= 0; i--)
+      if (tmp.digit[i] != 0)
+         value += ldexp((double) tmp.digit[i], REPRO_DIGIT_BITS*i - REPRO_BIAS);
+   return sign*value;
+}  /* repro_value */
+
+#endif /* REPRO_H */
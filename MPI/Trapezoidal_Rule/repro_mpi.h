@@ -0,0 +1,94 @@
+/* File:     repro_mpi.h
+ * Purpose:  The sums of repro.h across the processes of a communicator.
+ *
+ * Usage:    neumaier_reduce(&s, &total, root, comm);
+ *           repro_reduce(&acc, &total, root, comm);
+ *           repro_allreduce(&acc, &total, comm);
+ *           repro_free_types();                before MPI_Finalize
+ *
+ * Note:     The MPI datatypes and operations are created on first use;
+ *           repro_free_types releases them before MPI_Finalize.
+ */
+#ifndef REPRO_MPI_H
+#define REPRO_MPI_H
+
+#include <mpi.h>
+#include "repro.h"
+
+static MPI_Datatype repro_neumaier_t = MPI_DATATYPE_NULL, repro_acc_mpi_t = MPI_DATATYPE_NULL;
+static MPI_Op repro_neumaier_op = MPI_OP_NULL, repro_acc_op = MPI_OP_NULL;
+
+/* MPI_Op: inout = in + inout, for pairs */
+static inline void repro_neumaier_merge(void* in, void* inout, int* len, MPI_Datatype* type) {
+   neumaier_t *a = in, *b = inout;
+   int i;
+
+   (void) type;
+   for (i = 0; i < *len; i++) {
+      neumaier_add(&b[i], a[i].sum);
+      b[i].comp += a[i].comp;
+   }
+}  /* repro_neumaier_merge */
+
+/* MPI_Op: inout = in + inout, for accumulators */
+static inline void repro_acc_merge(void* in, void* inout, int* len, MPI_Datatype* type) {
+   repro_acc_t *a = in, *b = inout;
+   int i;
+
+   (void) type;
+   for (i = 0; i < *len; i++) repro_merge(&b[i], &a[i]);
+}  /* repro_acc_merge */
+
+/*------------------------------------------------------------------
+ * Function:     repro_types
+ * Purpose:      Create the MPI datatypes and operations on first use
+ */
+static inline void repro_types(void) {
+   if (repro_acc_op != MPI_OP_NULL) return;
+   MPI_Type_contiguous(2, MPI_DOUBLE, &repro_neumaier_t);
+   MPI_Type_commit(&repro_neumaier_t);
+   MPI_Type_contiguous(sizeof(repro_acc_t)/sizeof(int64_t), MPI_INT64_T, &repro_acc_mpi_t);
+   MPI_Type_commit(&repro_acc_mpi_t);
+   MPI_Op_create(repro_neumaier_merge, 1, &repro_neumaier_op);
+   MPI_Op_create(repro_acc_merge, 1, &repro_acc_op);
+}  /* repro_types */
+
+static inline void repro_free_types(void) {
+   if (repro_acc_op == MPI_OP_NULL) return;
+   MPI_Type_free(&repro_neumaier_t);
+   MPI_Type_free(&repro_acc_mpi_t);
+   MPI_Op_free(&repro_neumaier_op);
+   MPI_Op_free(&repro_acc_op);
+}  /* repro_free_types */
+
+/*------------------------------------------------------------------
+ * Function:     neumaier_reduce
+ * Purpose:      Sum of the pairs of all processes of comm, on root
+ */
+static inline void neumaier_reduce(const neumaier_t* s, neumaier_t* total, int root, MPI_Comm comm) {
+   repro_types();
+   MPI_Reduce(s, total, 1, repro_neumaier_t, repro_neumaier_op, root, comm);
+}  /* neumaier_reduce */
+
+/*------------------------------------------------------------------
+ * Function:     repro_reduce, repro_allreduce
+ * Purpose:      Exact sum of the accumulators of all processes of comm,
+ *               on root or everywhere
+ */
+static inline void repro_reduce(const repro_acc_t* acc, repro_acc_t* total, int root, MPI_Comm comm) {
+   repro_acc_t mine = *acc;
+
+   repro_types();
+   repro_carry(&mine);
+   MPI_Reduce(&mine, total, 1, repro_acc_mpi_t, repro_acc_op, root, comm);
+}  /* repro_reduce */
+
+static inline void repro_allreduce(const repro_acc_t* acc, repro_acc_t* total, MPI_Comm comm) {
+   repro_acc_t mine = *acc;
+
+   repro_types();
+   repro_carry(&mine);
+   MPI_Allreduce(&mine, total, 1, repro_acc_mpi_t, repro_acc_op, comm);
+}  /* repro_allreduce */
+
+#endif /* REPRO_MPI_H */
@@ -0,0 +1,33 @@
+/* File:     user_integrand.c
+ * Purpose:  Example of an integrand loaded at run time by integrand.h:
+ *           f(x) = sqrt(|x - 1/3|), whose derivative blows up at 1/3,
+ *           with its antiderivative so the programs can print errors.
+ *
+ * Compile:  gcc -O3 -shared -fPIC -o user_integrand.so user_integrand.c -lm
+ * Run:      mpiexec -n 4 ./mpi_trap3 ./user_integrand.so
+ *           mpiexec -n 4 ./mpi_adapt ./user_integrand.so:integrand gk15
+ */
+#include <math.h>
+
+#define KINK (1.0/3.0)
+
+/*------------------------------------------------------------------
+ * Function:     integrand
+ * Purpose:      y[i] = f(x[i]) for i < n
+ */
+void integrand(int n, const double* restrict x, double* restrict y) {
+   int i;
+
+   for (i = 0; i < n; i++)
+      y[i] = sqrt(fabs(x[i] - KINK));
+}  /* integrand */
+
+/*------------------------------------------------------------------
+ * Function:     integrand_antiderivative
+ * Purpose:      F(x) with F' = f
+ */
+double integrand_antiderivative(double x) {
+   double d = x - KINK;
+
+   return (d < 0.0 ? -2.0 : 2.0)/3.0*pow(fabs(d), 1.5);
+}  /* integrand_antiderivative */